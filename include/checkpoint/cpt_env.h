@@ -16,7 +16,33 @@
 #ifndef __CHECKPOINT_CPT_ENV__
 #define __CHECKPOINT_CPT_ENV__
 
-enum { GZ_FORMAT, ZSTD_FORMAT };
+#include <stdint.h>
+
+enum { GZ_FORMAT, ZSTD_FORMAT, PAGE_FORMAT };
+
+/* A checkpoint in PAGE_FORMAT lists the non-zero pages of pmem, whose contents
+ * are kept in a page store shared by all the checkpoints of a run. Each page
+ * is stored compressed by zstd, or raw if its size is PAGE_CPT_PAGE_SIZE. */
+#define PAGE_CPT_MAGIC "NEMUPAGE"
+#define PAGE_CPT_VERSION 1
+#define PAGE_CPT_PAGE_SIZE 4096
+#define PAGE_CPT_STORE "pages.store"
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint64_t mem_size;
+  uint64_t nr_pages;
+  char store[256]; // path of the page store relative to the directory of the checkpoint
+} page_cpt_header_t;
+
+typedef struct {
+  uint64_t page; // index of the page in pmem
+  uint64_t offset; // offset of the page in the page store
+  uint32_t size;
+  uint32_t reserved;
+} page_cpt_entry_t;
 
 extern char *output_base_dir;
 extern char *config_name;
@@ -20,8 +20,12 @@
 #ifndef NEMU_SERIALIZER_H
 #define NEMU_SERIALIZER_H
 
+#include <cstdio>
+#include <sys/types.h>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 
 
 class Serializer
@@ -32,10 +36,27 @@ class Serializer
 
     void serializePMem(uint64_t inst_count);
 
+    void serializePMemPages(const std::string &filepath, uint8_t *pmem, size_t size);
+
+    // write the checkpoints of the simpoints from the snapshots taken by SimpointProfileCheckpointing
+    void takeSimpointCheckpoints(const std::map<uint64_t, double> &simpoints);
+
+    void serializePMemGz(const std::string &filepath, const uint8_t *pmem, size_t size);
+
+    void serializePMemZstd(const std::string &filepath, const uint8_t *pmem, size_t size);
+
+    // wait for the checkpoint being compressed by a forked process
+    void drain();
+
     void serializeRegs();
 
+    // load the registers written by serializeRegs() from pmem, as the restorer does
+    bool deserializeRegs();
+
     explicit Serializer();
 
+    ~Serializer();
+
     void init();
 
     bool shouldTakeCpt(uint64_t num_insts);
@@ -72,6 +93,55 @@ class Serializer
     std::map<uint64_t, double> simpoint2Weights;
 
     uint64_t nextUniformPoint;
+
+    struct PageRef
+    {
+      uint64_t offset;
+      uint32_t size; // 0 if the page is zero
+    };
+
+    struct PageDigest
+    {
+      uint64_t lo, hi;
+      bool operator==(const PageDigest &other) const { return lo == other.lo && hi == other.hi; }
+    };
+
+    struct PageDigestHash
+    {
+      size_t operator()(const PageDigest &d) const { return d.lo; }
+    };
+
+    static PageDigest digestPage(const uint8_t *page);
+    // whether the page stored at ref is the same as page
+    bool pageStoreHolds(const PageRef &ref, const uint8_t *page);
+
+    // store the pages changed since the last call to the page store, and
+    // append the changed entries of pageRefs to delta if it is not null
+    void updatePageStore(uint8_t *pmem, size_t size, std::vector<std::pair<uint64_t, PageRef>> *delta);
+    void writePageCpt(const std::string &filepath, const std::vector<PageRef> &refs, size_t size);
+
+    // page store of the checkpoints in PAGE_FORMAT, where each distinct page is stored once
+    FILE *pageStore{nullptr};
+    uint64_t pageStoreSize{0};
+    uint64_t pageStoreFlushed{0};
+    // pages of different contents may have the same digest
+    std::unordered_multimap<PageDigest, PageRef, PageDigestHash> pageStoreIndex;
+    // pages of pmem in the last checkpoint
+    std::vector<PageRef> pageRefs;
+
+    // With SimpointProfileCheckpointing, a snapshot is taken at the start of
+    // every interval. It only keeps the pages changed since the last one,
+    // whose contents are in the page store, and registers are in those pages.
+    struct Snapshot
+    {
+      uint64_t instCount;
+      std::vector<std::pair<uint64_t, PageRef>> delta;
+    };
+    std::vector<Snapshot> snapshots;
+
+    // process compressing the last checkpoint with CONFIG_CPT_ASYNC
+    pid_t drainPid{-1};
+    std::string drainPath;
 };
 
 extern Serializer serializer;
@@ -41,8 +41,12 @@
 #ifndef __CPU_SIMPLE_PROBES_SIMPOINT_HH__
 #define __CPU_SIMPLE_PROBES_SIMPOINT_HH__
 
-#include <unordered_map>
+#include <cstdio>
+#include <map>
+#include <utility>
+#include <vector>
 #include <base/output.h>
+#include <checkpoint/simpoint_cluster.h>
 
 namespace SimPointNS {
 using Addr = uint64_t;
@@ -57,23 +61,6 @@ using Addr = uint64_t;
  *  - second: PC of last inst in basic block
  */
 typedef std::pair<Addr, Addr> BasicBlockRange;
-}
-
-/** Overload hash function for BasicBlockRange type */
-namespace std {
-using SimPointNS::BasicBlockRange;
-using SimPointNS::Addr;
-template<>
-struct hash<BasicBlockRange>
-{
-  public:
-    size_t operator()(const BasicBlockRange &bb) const {
-      return hash<Addr>()(bb.first + bb.second);
-    }
-};
-}
-
-namespace SimPointNS {
 
 class SimPoint
 {
@@ -93,6 +80,12 @@ class SimPoint
 
     void profile_with_abs_icount(Addr pc, bool is_control, bool is_last_uop, uint64_t abs_icount);
 
+    /**
+     * Cluster the intervals profiled so far, write simpoints0 and weights0
+     * to the output directory, and return the weight of each simpoint.
+     */
+    std::map<uint64_t, double> chooseSimpoints();
+
   private:
     uint64_t lastICount{0};
     /** SimPoint profiling interval size in instructions */
@@ -104,11 +97,17 @@ class SimPoint
     uint64_t intervalDrift;
     /** Pointer to SimPoint BBV output stream */
     NEMUNS::OutputStream *simpointStream;
+    /** Binary BBV output, see simpoint.cpp for the format */
+    FILE *binaryFile{nullptr};
+    void *zstdCtx{nullptr};
+    std::vector<uint8_t> binaryBuf;
 
     /** Basic Block information */
     struct BBInfo
     {
-        /** Unique ID */
+        /** PC of first and last inst in BB */
+        Addr start, end;
+        /** Unique ID, 0 for an empty slot */
         uint64_t id;
         /** Num of static insts in BB */
         uint64_t insts;
@@ -116,8 +115,21 @@ class SimPoint
         uint64_t count;
     };
 
-    /** Hash table containing all previously seen basic blocks */
-    ::std::unordered_map<BasicBlockRange, BBInfo> bbMap;
+    /** Open-addressed hash table containing all previously seen basic blocks */
+    std::vector<BBInfo> bbTable;
+    uint64_t nrBB{0};
+    /** Slots of the basic blocks executed in the current interval */
+    std::vector<uint32_t> touched;
+
+    BBInfo *findBB(const BasicBlockRange &bb);
+    void growBBTable();
+    void dumpInterval();
+    void writeBinary(bool end);
+
+    /** Projected BBVs of the intervals, kept to choose simpoints in the same run */
+    SimPointCluster::Options clusterOpt;
+    std::vector<double> projectedBBVs;
+
     /** Currently executing basic block */
     BasicBlockRange currentBBV;
     /** inst count in current basic block */
@@ -0,0 +1,286 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/*
+ * SimPoint clustering shared by NEMU (--simpoint-profile-cpt) and
+ * tools/simpoint-cluster, so it only depends on the C++ library.
+ *
+ * The frequency vector of each interval is normalized and randomly projected
+ * to a few dimensions, k-means with k-means++ seeding is run for every k up
+ * to maxK and several seeds, and the smallest k whose BIC score reaches
+ * bicThreshold of the range is chosen, as SimPoint 3 does. Every (k, seed)
+ * run is an independent task of a thread pool, and each of them has its own
+ * random stream, so the result does not depend on the number of threads.
+ */
+
+#ifndef __CHECKPOINT_SIMPOINT_CLUSTER_H__
+#define __CHECKPOINT_SIMPOINT_CLUSTER_H__
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SimPointCluster
+{
+
+struct Options
+{
+  int maxK{30};
+  int nrInitSeeds{5};
+  int maxIters{1000};
+  int dim{15};
+  double bicThreshold{0.9};
+  uint64_t seedKM{493575226};
+  uint64_t seedProj{2042712918};
+  /** number of threads, 0 for the number of cores */
+  int nrJobs{0};
+};
+
+struct Result
+{
+  /** the chosen number of clusters */
+  int k;
+  /** distortion and BIC score of the best run of each k, indexed by k */
+  std::vector<double> distortion, bic;
+  /** the interval closest to the center, and the weight of each non-empty cluster */
+  std::vector<int> clusters;
+  std::vector<size_t> simpoints;
+  std::vector<double> weights;
+};
+
+static inline uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// a random number in [0, 1) from a 64-bit random value
+static inline double toUnit(uint64_t x) {
+  return (x >> 11) * (1.0 / (1ull << 53));
+}
+
+/**
+ * Normalize the BBV of an interval, given as (id, count) pairs, and add its
+ * projection to x[0, dim). The projection matrix is generated from seedProj
+ * on the fly, so the number of basic blocks need not be known in advance.
+ */
+static inline void project(const Options &opt, const std::vector<std::pair<uint64_t, uint64_t>> &bbv, double *x) {
+  double total = 0;
+  for (auto &p : bbv) total += p.second;
+  if (total == 0) return;
+  for (auto &p : bbv) {
+    double freq = p.second / total;
+    for (int d = 0; d < opt.dim; d ++) {
+      // uniform in [-1, 1)
+      double proj = toUnit(splitmix64(opt.seedProj ^ splitmix64(p.first * opt.dim + d))) * 2 - 1;
+      x[d] += freq * proj;
+    }
+  }
+}
+
+class KMeans
+{
+  public:
+    struct Clustering
+    {
+      std::vector<double> centers;
+      std::vector<int> labels;
+      double distortion;
+    };
+
+    KMeans(const Options &opt, const std::vector<double> &points)
+      : opt(opt), points(points), dim(opt.dim), n(points.size() / opt.dim) {}
+
+    double dist2(const double *a, const double *b) const {
+      double s = 0;
+      for (int d = 0; d < dim; d ++) { double t = a[d] - b[d]; s += t * t; }
+      return s;
+    }
+
+    const double *point(size_t i) const { return &points[i * dim]; }
+
+    Clustering run(int k, uint64_t seed) const {
+      Clustering c;
+      c.centers.resize(k * dim);
+      c.labels.assign(n, -1);
+      uint64_t rng = seed;
+      seedCenters(c, k, rng);
+
+      std::vector<double> sums(k * dim);
+      std::vector<size_t> sizes(k);
+      for (int iter = 0; iter < opt.maxIters; iter ++) {
+        bool changed = false;
+        c.distortion = 0;
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(sizes.begin(), sizes.end(), 0);
+        for (size_t i = 0; i < n; i ++) {
+          const double *x = point(i);
+          int best = 0;
+          double bestd = dist2(x, &c.centers[0]);
+          for (int j = 1; j < k; j ++) {
+            double d = dist2(x, &c.centers[j * dim]);
+            if (d < bestd) { bestd = d; best = j; }
+          }
+          if (c.labels[i] != best) { c.labels[i] = best; changed = true; }
+          c.distortion += bestd;
+          sizes[best] ++;
+          for (int d = 0; d < dim; d ++) sums[best * dim + d] += x[d];
+        }
+        if (!changed) break;
+        // an empty cluster keeps its center
+        for (int j = 0; j < k; j ++) {
+          if (sizes[j] == 0) continue;
+          for (int d = 0; d < dim; d ++) c.centers[j * dim + d] = sums[j * dim + d] / sizes[j];
+        }
+      }
+      return c;
+    }
+
+    // the BIC score of a clustering, with the formulation of X-means used by SimPoint
+    double bic(const Clustering &c, int k) const {
+      std::vector<size_t> sizes(k);
+      for (int l : c.labels) sizes[l] ++;
+      double R = n, M = dim;
+      double variance = R > k ? c.distortion / (R - k) : 0;
+      variance = std::max(variance, std::numeric_limits<double>::min());
+      double loglikelihood = 0;
+      for (int j = 0; j < k; j ++) {
+        double nj = sizes[j];
+        if (nj == 0) continue;
+        loglikelihood += nj * log(nj) - nj * log(R) - nj / 2 * log(2 * M_PI)
+                       - nj * M / 2 * log(variance) - (nj - k) / 2;
+      }
+      double nrParams = (k - 1) + M * k + 1;
+      return loglikelihood - nrParams / 2 * log(R);
+    }
+
+  private:
+    const Options &opt;
+    const std::vector<double> &points;
+    const int dim;
+    const size_t n;
+
+    double random(uint64_t &rng) const {
+      rng += 0x9e3779b97f4a7c15ull;
+      return toUnit(splitmix64(rng));
+    }
+
+    size_t randomPoint(uint64_t &rng) const {
+      return std::min<size_t>(random(rng) * n, n - 1);
+    }
+
+    void seedCenters(Clustering &c, int k, uint64_t &rng) const {
+      std::vector<double> mind(n);
+      std::copy_n(point(randomPoint(rng)), dim, c.centers.begin());
+      double sum = 0;
+      for (size_t i = 0; i < n; i ++) {
+        mind[i] = dist2(point(i), &c.centers[0]);
+        sum += mind[i];
+      }
+      for (int j = 1; j < k; j ++) {
+        // choose a point with the probability proportional to its squared
+        // distance to the nearest center, or any point if all of them are covered
+        size_t chosen = randomPoint(rng);
+        if (sum > 0) {
+          double r = random(rng) * sum;
+          for (size_t i = 0; i < n; i ++) {
+            r -= mind[i];
+            if (r <= 0 && mind[i] > 0) { chosen = i; break; }
+          }
+        }
+        double *center = &c.centers[j * dim];
+        std::copy_n(point(chosen), dim, center);
+        sum = 0;
+        for (size_t i = 0; i < n; i ++) {
+          mind[i] = std::min(mind[i], dist2(point(i), center));
+          sum += mind[i];
+        }
+      }
+    }
+};
+
+/** Cluster the projected BBVs, dim values for each interval. */
+static inline Result cluster(const Options &opt, const std::vector<double> &points) {
+  KMeans km(opt, points);
+  size_t n = points.size() / opt.dim;
+  int maxK = std::min<size_t>(opt.maxK, n);
+  int nrJobs = opt.nrJobs > 0 ? opt.nrJobs : std::max(1u, std::thread::hardware_concurrency());
+
+  // task t runs k-means with k = t / nrInitSeeds + 1; the larger k go first
+  // since they take longer
+  int nrTasks = maxK * opt.nrInitSeeds;
+  std::vector<KMeans::Clustering> runs(nrTasks);
+  std::atomic<int> nextTask(0);
+  auto worker = [&]() {
+    for (int t; (t = nextTask.fetch_add(1)) < nrTasks; ) {
+      t = nrTasks - 1 - t;
+      int k = t / opt.nrInitSeeds + 1;
+      runs[t] = km.run(k, splitmix64(opt.seedKM ^ splitmix64(t)));
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int i = 1; i < nrJobs; i ++) threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads) t.join();
+
+  // keep the run with the least distortion for each k
+  Result res;
+  std::vector<KMeans::Clustering *> best(maxK + 1);
+  res.distortion.resize(maxK + 1);
+  res.bic.resize(maxK + 1);
+  double minScore = INFINITY, maxScore = -INFINITY;
+  for (int k = 1; k <= maxK; k ++) {
+    for (int s = 0; s < opt.nrInitSeeds; s ++) {
+      KMeans::Clustering *c = &runs[(k - 1) * opt.nrInitSeeds + s];
+      if (best[k] == nullptr || c->distortion < best[k]->distortion) best[k] = c;
+    }
+    res.distortion[k] = best[k]->distortion;
+    res.bic[k] = km.bic(*best[k], k);
+    minScore = std::min(minScore, res.bic[k]);
+    maxScore = std::max(maxScore, res.bic[k]);
+  }
+  int k = 1;
+  double threshold = minScore + opt.bicThreshold * (maxScore - minScore);
+  while (k < maxK && res.bic[k] < threshold) k ++;
+  res.k = k;
+
+  // the simpoint of a cluster is the interval closest to its center
+  const KMeans::Clustering &c = *best[k];
+  std::vector<size_t> sizes(k), simpoint(k);
+  std::vector<double> mind(k, INFINITY);
+  for (size_t i = 0; i < n; i ++) {
+    int l = c.labels[i];
+    sizes[l] ++;
+    double d = km.dist2(km.point(i), &c.centers[l * opt.dim]);
+    if (d < mind[l]) { mind[l] = d; simpoint[l] = i; }
+  }
+  for (int j = 0; j < k; j ++) {
+    if (sizes[j] == 0) continue;
+    res.clusters.push_back(j);
+    res.simpoints.push_back(simpoint[j]);
+    res.weights.push_back((double)sizes[j] / n);
+  }
+  return res;
+}
+
+}
+
+#endif // __CHECKPOINT_SIMPOINT_CLUSTER_H__
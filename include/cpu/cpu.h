@@ -28,6 +28,13 @@ enum {
 };
 
 void cpu_exec(uint64_t n);
+struct Decode *get_last_decode();
+#ifdef CONFIG_DIFFTEST_BATCH
+// called by cpu_exec() after every instruction retired, or with trap set
+// after the exception raised by the instruction is taken
+typedef void (*commit_hook_t)(struct Decode *s, bool trap);
+void set_commit_hook(commit_hook_t hook);
+#endif
 __attribute__((noreturn)) void longjmp_exec(int cause);
 __attribute__((noreturn)) void longjmp_exception(int ex_cause);
 
@@ -37,6 +44,7 @@ enum {
 };
 void set_sys_state_flag(int flag);
 void mmu_tlb_flush(vaddr_t vaddr);
+bool tcache_has_vpage(vaddr_t vaddr);
 
 struct Decode;
 void save_globals(struct Decode *s);
@@ -44,6 +44,12 @@ enum {
   INSTR_TYPE_I, // indirect
 };
 
+enum {
+  TRACE_LINK_TAKEN  = 1, // the taken successor is the next entry in the superblock
+  TRACE_LINK_NTAKEN = 2, // the non-taken successor is the next entry in the superblock
+  TRACE_HEAD        = 4, // the first entry of a superblock
+};
+
 typedef struct Decode {
   union {
     struct {
@@ -60,24 +66,40 @@ typedef struct Decode {
   IFDEF (CONFIG_PERF_OPT, const void *EHelper);
   IFNDEF(CONFIG_PERF_OPT, void (*EHelper)(struct Decode *));
   Operand dest, src1, src2;
-  vaddr_t jnpc;
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+  vaddr_t jnpc; // kept after decoding to link the basic block again
+  IFDEF(CONFIG_TCACHE_TRACE, uint32_t edge_cnt[2]); // taken and non-taken counters
+#else
+  union {
+    vaddr_t jnpc;
+    IFDEF(CONFIG_TCACHE_TRACE, uint32_t edge_cnt[2]); // taken and non-taken counters, reuse jnpc after decoding
+  };
+#endif
   uint16_t idx_in_bb; // the number of instruction in the basic block, start from 1
   uint8_t type;
+  IFDEF(CONFIG_TCACHE_TRACE, uint8_t trace_flag);
+#ifdef CONFIG_RVV
+  // packed into the padding before isa to keep the entry within two cache lines
+  uint8_t vm : 1; // 1 for without mask; 0 for with mask
+  uint8_t src_vmode : 3;
+#endif // CONFIG_RVV
   ISADecodeInfo isa;
   IFDEF(CONFIG_DEBUG, char logbuf[80]);
-  #ifdef CONFIG_RVV
-  // for vector
+} Decode;
+
+#ifdef CONFIG_RVV
+// Fields of the vector load/store being executed. They are only valid while
+// its EHelper runs, so they are kept here instead of in every tcache entry.
+typedef struct {
   int v_width;
   int v_nf;
   int v_lsumop;
   int v_is_vx;    // 1: vector indexed load/store instruction; 0: other vector load/store instruction
-  uint32_t vm;
-  uint32_t src_vmode;
-  rtlreg_t tmp_reg[4];
   void *last_access_host_addr;
-  #endif // CONFIG_RVV
+} vldst_state_t;
 
-} Decode;
+extern vldst_state_t vldst;
+#endif // CONFIG_RVV
 
 
 #define id_src1 (&s->src1)
@@ -135,13 +157,16 @@ static inline def_DHelper(empty) {}
 #define TAB(idx, tab) IDTAB(idx, empty, tab)
 #define EMPTY(idx) TAB(idx, inv)
 
+// Do not jump out of the loop: a goto leaves a branch prediction hint before
+// every pattern test, which stops GCC from converting the chain of tests into
+// a switch. Consecutive patterns testing the same bits then compile to a jump
+// table instead of sequential comparisons.
 __attribute__((always_inline))
 static inline void pattern_decode(const char *str, int len,
     uint64_t *key, uint64_t *mask, uint64_t *shift) {
   uint64_t __key = 0, __mask = 0, __shift = 0;
 #define macro(i) \
-  if ((i) >= len) goto finish; \
-  else { \
+  if ((i) < len) { \
     char c = str[i]; \
     if (c != ' ') { \
       Assert(c == '0' || c == '1' || c == '?', \
@@ -160,7 +185,6 @@ static inline void pattern_decode(const char *str, int len,
 #define macro64(i) macro32(i); macro32((i) + 32)
   macro64(0);
 #undef macro
-finish:
   *key = __key >> __shift;
   *mask = __mask >> __shift;
   *shift = __shift;
@@ -39,6 +39,7 @@ word_t isa_reg_str2val(const char *name, bool *success);
 // exec
 struct Decode;
 int isa_fetch_decode(struct Decode *s);
+void isa_decode_relocate(struct Decode *s, sword_t delta);
 void isa_hostcall(uint32_t id, rtlreg_t *dest, const rtlreg_t *src1,
     const rtlreg_t *src2, word_t imm);
 
@@ -85,6 +86,7 @@ void isa_difftest_guided_exec(void *guide);
 #endif
 
 void isa_difftest_query_ref(void *result_buffer, uint64_t type);
+uint64_t isa_difftest_exec_batch(void *ring, uint64_t ring_size, uint64_t *tail, uint64_t n);
 #ifdef CONFIG_BR_LOG
 void *isa_difftest_query_br_log(void);
 #endif // CONFIG_BR_LOG
@@ -23,5 +23,8 @@ word_t hosttlb_read(struct Decode *s, vaddr_t vaddr, int len, int type);
 void hosttlb_write(struct Decode *s, vaddr_t vaddr, int len, word_t data);
 void hosttlb_init();
 void hosttlb_flush(vaddr_t vaddr);
+void hosttlb_flush_wpage(paddr_t paddr);
+void hosttlb_set_vmid(int vmid);
+void hosttlb_flush_vmid(int vmid);
 
 #endif
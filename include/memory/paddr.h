@@ -60,6 +60,9 @@ static inline bool in_pmem(paddr_t addr) {
 
 word_t paddr_read(paddr_t addr, int len, int type, int mode, vaddr_t vaddr);
 void paddr_write(paddr_t addr, int len, word_t data, int mode, vaddr_t vaddr);
+/* write [buf, buf + len) to pmem for a device, e.g. by DMA, which keeps the
+ * dirty pages and the decoded instructions up to date as paddr_write() does */
+void paddr_dma_write(paddr_t addr, size_t len, const void *buf);
 bool check_paddr(paddr_t addr, int len, int type, int mode, vaddr_t vaddr);
 /* 该函数专门为读 bitmap 而设置*/
 word_t bitmap_read(paddr_t addr, int type, int mode);
@@ -78,6 +81,73 @@ void set_pmem(bool pass_pmem_from_dut, uint8_t *_pmem);
 void * get_sparsemm();
 #endif
 
+#ifdef CONFIG_MEM_COW
+#include <memory/vaddr.h>
+/* pages of pmem written since the map was cleared, one bit for each page */
+extern uint64_t *pmem_dirty_map;
+/* the same since the last snapshot saved or loaded by the monitor */
+extern uint64_t *pmem_snapshot_map;
+
+static inline void pmem_dirty_mark(paddr_t addr, size_t len) {
+  size_t idx = (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+  size_t end = (addr - CONFIG_MBASE + len - 1) >> PAGE_SHIFT;
+  for (; idx <= end; idx ++) {
+    pmem_dirty_map[idx / 64] |= 1ul << (idx % 64);
+    pmem_snapshot_map[idx / 64] |= 1ul << (idx % 64);
+  }
+}
+
+static inline bool pmem_is_dirty(paddr_t addr) {
+  size_t idx = (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+  return (pmem_dirty_map[idx / 64] >> (idx % 64)) & 1;
+}
+
+void pmem_dirty_clear();
+void pmem_snapshot_clear();
+
+/* Fork to take a snapshot of the whole machine. The forked process returns the
+ * number of times it has been rolled back to this snapshot, and the calling
+ * process waits for it and exits with its status. */
+int snapshot_take();
+/* Drop the state since the last snapshot and go on running from it. */
+void snapshot_rollback();
+#endif
+
+/* Register state outside CPU_state and pmem, e.g. CSRs and device registers,
+ * to be saved in snapshot files. loaded() is called after it is loaded. */
+void snapshot_add_state(const char *name, void *addr, size_t size, void (*loaded)());
+/* Save the whole machine to a snapshot file. Unless full is set, only the pages
+ * written since the last snapshot saved or loaded are saved if possible, and
+ * that snapshot has to be kept to load this one. */
+void snapshot_save(const char *path, bool full);
+void snapshot_load(const char *path);
+
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+#include <memory/vaddr.h>
+/* pages of pmem holding instructions decoded in the tcache */
+extern uint8_t *tcache_page_map;
+extern size_t tcache_nr_page;
+void tcache_page_write(paddr_t addr, size_t len);
+
+static inline bool tcache_is_code_page(paddr_t addr) {
+  size_t idx = (addr - CONFIG_MBASE) >> PAGE_SHIFT;
+  return idx < tcache_nr_page && tcache_page_map[idx] != 0;
+}
+#endif
+
+#ifdef CONFIG_DEBUG
+/* Watchpoints without registers are only evaluated again after a store to
+ * the physical memory they read, see src/monitor/watchpoint.c. */
+extern int wp_nr_ref;
+extern bool wp_need_scan;
+void wp_check_store(paddr_t addr, int len);
+bool wp_is_watched_page(paddr_t addr);
+
+static inline void wp_store(paddr_t addr, int len) {
+  if (unlikely(wp_nr_ref > 0)) wp_check_store(addr, len);
+}
+#endif
+
 #ifdef CONFIG_DIFFTEST_STORE_COMMIT
 
 typedef struct {
@@ -87,7 +157,7 @@ typedef struct {
 } store_commit_t;
 
 /**
- * In the implementation, CPP queue is used for store commit maintenance.
+ * In the implementation, a ring growing on demand is used for store commit maintenance.
  * */
 void store_commit_queue_push(uint64_t addr, uint64_t data, int len, int cross_page_store);
 
@@ -100,6 +170,12 @@ void store_commit_queue_push(uint64_t addr, uint64_t data, int len, int cross_pa
  */
 store_commit_t store_commit_queue_pop(int *flag);
 int check_store_commit(uint64_t *addr, uint64_t *data, uint8_t *mask);
+/**
+ * Check n stores given by the DUT in order, stop at the first mismatch.
+ * @return the index of the first mismatched store, whose slot is filled with
+ *         the store of NEMU, or n if all of them match
+ */
+int check_store_commit_batch(uint64_t *addr, uint64_t *data, uint8_t *mask, int n);
 #endif
 
 //#define CONFIG_MEMORY_REGION_ANALYSIS
@@ -10,7 +10,6 @@
 #include <string>
 #include <map>
 #include <functional>
-#include <tuple>
 #endif
 
 // comm functions
@@ -47,6 +46,13 @@ typedef uint64_t paddr_t;
 #endif
 // typedef MUXDEF(CONFIG_ISA64, uint64_t, uint32_t) word_t;
 
+typedef void (*zero_page_hook_func)(const u_int8_t *zero_page);
+
+// pages are indexed by a 3-level radix table covering 56-bit physical addresses
+#define SP_PAGE_SHIFT 12
+#define SP_PAGE_SIZE  (1ul << SP_PAGE_SHIFT)
+#define SP_PAGE_MASK  (SP_PAGE_SIZE - 1)
+
 #ifdef __cplusplus
 
 // sparse ram define
@@ -69,6 +75,10 @@ inline void vassert(bool c, std::string msg)
 
 typedef std::function<void (paddr_t addr, size_t len, void *bytes)> copy_mem_func;
 
+#define SP_TBL_BITS   14
+#define SP_DIR_BITS   14
+#define SP_ROOT_BITS  (56 - SP_PAGE_SHIFT - SP_DIR_BITS - SP_TBL_BITS)
+
 class SparseRam
 {
     typedef struct 
@@ -77,17 +87,16 @@ class SparseRam
         paddr_t end;
         u_int8_t * blk;
     } sp_mm_blk;
-    
+
+    typedef u_int8_t *sp_pg_tbl[1 << SP_TBL_BITS];
+    typedef sp_pg_tbl *sp_pg_dir[1 << SP_DIR_BITS];
+
 public:
     unsigned block_size;
-    std::map<paddr_t, u_int8_t *> mem;
     std::map<std::string, sp_mm_blk *> big_block;
 
     ~SparseRam();
-    SparseRam(u_int block_count = 4, u_int chunk_size=1024){
-        this->block_size = block_count * chunk_size;
-        DEBUG("init SparseRam with block_size= %.2f kB (chunk_size=%d)", float(this->block_size)/1024.0, chunk_size);
-    }
+    SparseRam(u_int block_count = 4, u_int chunk_size=1024);
  
     bool load_bin(const char *file, paddr_t addr);
     bool load_elf(const char *file);
@@ -101,6 +110,9 @@ public:
     void write(paddr_t addr, int len, word_t data);
     void copy(SparseRam *dst);
 
+    u_int8_t *host_addr(paddr_t addr, bool write);
+    void set_zero_page_hook(zero_page_hook_func hook);
+
     endianness_t get_target_endianness();
 
     void copy_nzero_bytes(copy_mem_func copy_handler);
@@ -109,11 +121,19 @@ public:
     void print_info();
 
 private:
-    u_int max_cache_size = 5;
-    std::map<paddr_t, std::tuple<u_int8_t*, u_long>> cache;
-    bool _fast_count(paddr_t index);
-    u_int8_t *_fast_mem(paddr_t index);
-    void __update_cache(paddr_t index, u_int8_t*m);
+    sp_pg_dir **root;
+    size_t nr_pages = 0;
+    // the last page found, which serves most of the word accesses
+    paddr_t last_pn = (paddr_t)-1;
+    u_int8_t *last_page = NULL;
+    // pages not written yet are read through the shared zero page, and
+    // the hook drops those references once a new page is allocated
+    static const u_int8_t zero_page[SP_PAGE_SIZE];
+    bool zero_page_lent = false;
+    zero_page_hook_func zero_page_hook = NULL;
+    u_int8_t *_page_find(paddr_t pn);
+    u_int8_t *_page_alloc(paddr_t pn);
+    void _page_foreach(std::function<void (paddr_t addr, u_int8_t *page)> handler);
     sp_mm_blk *_blk_find(paddr_t addr);
     bool _blk_read(paddr_t addr, size_t len, void* bytes);
     bool _blk_write(paddr_t addr, size_t len, const void* bytes);
@@ -138,6 +158,8 @@ extern "C"
     void   sparse_mem_info(void* self);
     void   sparse_mem_copy(void *dst, void *src);
     void*  sparse_mem_blk_get(void *self, char *name);
+    u_int8_t* sparse_mem_host_addr(void *self, paddr_t addr, int write);
+    void   sparse_mem_set_zero_page_hook(void *self, zero_page_hook_func hook);
     int    sparse_mem_blk_add(void *self, char *name, paddr_t start, paddr_t end);
     int    file_is_elf(const char *fn);
 
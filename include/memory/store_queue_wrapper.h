@@ -10,16 +10,56 @@
 extern "C" {
 #endif
 
-void store_queue_push(store_commit_t store_commit);
-void store_queue_pop();
-store_commit_t store_queue_fornt();
-store_commit_t store_queue_back();
-size_t store_queue_size();
-bool store_queue_empty();
+#define STORE_QUEUE_SIZE CONFIG_DIFFTEST_STORE_QUEUE_SIZE
+#define STORE_QUEUE_MASK (STORE_QUEUE_SIZE - 1)
+
+// A ring of committed stores. Entries are produced and consumed by the
+// thread running the guest, head and tail only increase, so pushing a store
+// only allocates when the ring is full and never takes a lock.
+typedef struct {
+  store_commit_t *entry;
+  uint64_t mask;
+  uint64_t head, tail;
+  uint64_t nr_overflow;
+} store_queue_t;
+
+extern store_queue_t store_queue;
+
+void store_queue_overflow();
+uint64_t store_queue_nr_overflow();
+// pop at most n stores into buf, return the number of stores popped
+size_t store_queue_drain(store_commit_t *buf, size_t n);
+
+static inline size_t store_queue_size() {
+  return store_queue.tail - store_queue.head;
+}
+
+static inline bool store_queue_empty() {
+  return store_queue.tail == store_queue.head;
+}
+
+static inline void store_queue_push(store_commit_t store_commit) {
+  // the ring grows if the DUT does not check the queue in time
+  if (unlikely(store_queue_size() > store_queue.mask)) store_queue_overflow();
+  store_queue.entry[store_queue.tail & store_queue.mask] = store_commit;
+  store_queue.tail ++;
+}
+
+static inline void store_queue_pop() {
+  store_queue.head ++;
+}
+
+static inline store_commit_t store_queue_fornt() {
+  return store_queue.entry[store_queue.head & store_queue.mask];
+}
+
+static inline store_commit_t store_queue_back() {
+  return store_queue.entry[(store_queue.tail - 1) & store_queue.mask];
+}
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif //NEMU_STORE_QUEUE_WRAPPER_H
 #endif //CONFIG_DIFFTEST_STORE_COMMIT
+#endif //NEMU_STORE_QUEUE_WRAPPER_H
@@ -24,6 +24,7 @@ word_t vaddr_read(struct Decode *s, vaddr_t addr, int len, int mmu_mode);
 void vaddr_write(struct Decode *s, vaddr_t addr, int len, word_t data, int mmu_mode);
 
 word_t vaddr_read_safe(vaddr_t addr, int len);
+paddr_t vaddr_ifetch_paddr(vaddr_t addr);
 
 #define PAGE_SHIFT        12
 #define PAGE_SIZE         (1ul << PAGE_SHIFT)
@@ -0,0 +1,122 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/*
+ * Binary traces written by --bin-trace, shared with tools/bintrace.
+ *
+ * A trace is a sequence of zstd frames, which decompress to a header followed
+ * by fixed-size records of the kind given in the header. Each frame holds a
+ * whole number of records. Addresses are virtual addresses.
+ */
+
+#ifndef __PROFILING_BINTRACE_H__
+#define __PROFILING_BINTRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define BINTRACE_MAGIC "NEMUTRC1"
+#define BINTRACE_NR_MEM 2
+
+enum { BINTRACE_NONE = 0, BINTRACE_INST, BINTRACE_BB };
+
+// the type of a control instruction, the same as INSTR_TYPE_* in cpu/decode.h
+enum { BINTRACE_TYPE_N = 0, BINTRACE_TYPE_J, BINTRACE_TYPE_B, BINTRACE_TYPE_I };
+
+typedef struct {
+  char magic[8];
+  uint32_t kind;        // BINTRACE_INST or BINTRACE_BB
+  uint32_t record_size; // bytes of a record
+} bintrace_header_t;
+
+// one instruction
+typedef struct {
+  uint64_t pc;
+  uint32_t instr;   // the encoding, with the unused upper bytes cleared
+  uint8_t len;      // bytes of the instruction
+  uint8_t type;     // BINTRACE_TYPE_*
+  uint8_t taken;    // the next instruction is not at pc + len
+  uint8_t nr_load;  // number of loads, only the first BINTRACE_NR_MEM addresses are kept
+  uint8_t nr_store; // number of stores, likewise
+  uint8_t pad[7];
+  uint64_t load[BINTRACE_NR_MEM];
+  uint64_t store[BINTRACE_NR_MEM];
+} bintrace_inst_t;
+
+// one basic block, recorded at the control instruction ending it
+typedef struct {
+  uint64_t pc;      // the control instruction
+  uint64_t target;  // the next instruction
+  uint64_t icount;  // instructions executed up to the end of the block
+  uint8_t type;     // BINTRACE_TYPE_*
+  uint8_t taken;
+  uint8_t pad[6];
+} bintrace_bb_t;
+
+#ifdef CONFIG_BIN_TRACE
+extern int bintrace_kind;
+
+// records are written to [bintrace_ptr, bintrace_end) of the chunk being filled
+extern uint8_t *bintrace_ptr, *bintrace_end;
+// loads and stores of the instruction being executed
+extern bintrace_inst_t bintrace_cur;
+
+void bintrace_init(const char *file, int kind);
+void bintrace_submit();
+void bintrace_flush();
+void bintrace_fork_child();
+void bintrace_close();
+
+static inline void *bintrace_alloc(int size) {
+  if (bintrace_ptr + size > bintrace_end) bintrace_submit();
+  void *p = bintrace_ptr;
+  bintrace_ptr += size;
+  return p;
+}
+
+static inline void bintrace_mem(uint64_t addr, bool is_store) {
+  if (bintrace_kind != BINTRACE_INST) return;
+  uint8_t *nr = is_store ? &bintrace_cur.nr_store : &bintrace_cur.nr_load;
+  if (*nr < BINTRACE_NR_MEM) (is_store ? bintrace_cur.store : bintrace_cur.load)[*nr] = addr;
+  if (*nr < UINT8_MAX) (*nr) ++;
+}
+
+// also called to forget the accesses of an instruction raising an exception
+static inline void bintrace_mem_reset() {
+  if (bintrace_cur.nr_load == 0 && bintrace_cur.nr_store == 0) return;
+  bintrace_cur.nr_load = bintrace_cur.nr_store = 0;
+  memset(bintrace_cur.load, 0, sizeof(bintrace_cur.load));
+  memset(bintrace_cur.store, 0, sizeof(bintrace_cur.store));
+}
+
+static inline void bintrace_inst(uint64_t pc, uint32_t instr, int len, int type, bool taken) {
+  bintrace_inst_t *r = bintrace_alloc(sizeof(bintrace_inst_t));
+  bintrace_cur.pc = pc;
+  bintrace_cur.instr = instr;
+  bintrace_cur.len = len;
+  bintrace_cur.type = type;
+  bintrace_cur.taken = taken;
+  *r = bintrace_cur;
+  bintrace_mem_reset();
+}
+
+static inline void bintrace_bb(uint64_t pc, uint64_t target, uint64_t icount, int type, bool taken) {
+  bintrace_bb_t *r = bintrace_alloc(sizeof(bintrace_bb_t));
+  *r = (bintrace_bb_t){ .pc = pc, .target = target, .icount = icount, .type = type, .taken = taken };
+}
+#endif // CONFIG_BIN_TRACE
+
+#endif // __PROFILING_BINTRACE_H__
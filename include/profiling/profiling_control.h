@@ -8,17 +8,27 @@ enum ProfilingState{
     SimpointProfiling,
 };
 
+enum SimpointBBVFormat{
+    BBV_TEXT_FORMAT = 0,
+    BBV_BINARY_FORMAT,
+};
+
 enum CheckpointState{
     NoCheckpoint=0,
     SimpointCheckpointing,
     UniformCheckpointing,
     ManualOneShotCheckpointing,
     ManualUniformCheckpointing,
+    // take a snapshot at every interval while profiling, and keep the
+    // snapshots of the simpoints chosen at the end
+    SimpointProfileCheckpointing,
 };
 
 extern int profiling_state;
+extern int simpoint_bbv_format;
 extern int checkpoint_state;
 extern bool checkpoint_restoring;
+extern bool checkpoint_native_restore;
 extern uint64_t checkpoint_interval;
 extern uint64_t warmup_interval;
 
@@ -0,0 +1,110 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/*
+ * Streaming reader of the zstd files written by NEMU, e.g. binary BBVs and
+ * traces, shared by the tools reading them.
+ */
+
+#ifndef __PROFILING_ZSTD_READER_H__
+#define __PROFILING_ZSTD_READER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zstd.h>
+
+typedef struct {
+  FILE *fp;
+  ZSTD_DCtx *dctx;
+  uint8_t *inbuf, *outbuf;
+  size_t inbuf_size, outbuf_size;
+  ZSTD_inBuffer input;
+  size_t outpos, outend;
+  // the last call filled the output buffer, so zstd may hold more output
+  bool pending;
+  // set when the stream is corrupted
+  const char *error;
+} zstd_reader_t;
+
+// the reader owns fp from now on
+static inline void zstd_reader_init(zstd_reader_t *r, FILE *fp) {
+  memset(r, 0, sizeof(*r));
+  r->fp = fp;
+  r->dctx = ZSTD_createDCtx();
+  r->inbuf_size = ZSTD_DStreamInSize();
+  r->outbuf_size = ZSTD_DStreamOutSize();
+  r->inbuf = (uint8_t *)malloc(r->inbuf_size);
+  r->outbuf = (uint8_t *)malloc(r->outbuf_size);
+  r->input.src = r->inbuf;
+}
+
+// decompress more output, return false at the end of the file or on errors
+static inline bool zstd_reader_refill(zstd_reader_t *r) {
+  while (r->error == NULL) {
+    // the input is only read when zstd has flushed all the output it holds
+    if (r->input.pos == r->input.size && !r->pending) {
+      r->input.size = fread(r->inbuf, 1, r->inbuf_size, r->fp);
+      r->input.pos = 0;
+      if (r->input.size == 0) return false;
+    }
+    ZSTD_outBuffer output;
+    output.dst = r->outbuf;
+    output.size = r->outbuf_size;
+    output.pos = 0;
+    size_t ret = ZSTD_decompressStream(r->dctx, &output, &r->input);
+    if (ZSTD_isError(ret)) {
+      r->error = ZSTD_getErrorName(ret);
+      return false;
+    }
+    r->pending = output.pos == output.size;
+    r->outpos = 0;
+    r->outend = output.pos;
+    if (output.pos > 0) return true;
+  }
+  return false;
+}
+
+// return the next byte, or -1 at the end of the file or on errors
+static inline int zstd_reader_getc(zstd_reader_t *r) {
+  if (r->outpos == r->outend && !zstd_reader_refill(r)) return -1;
+  return r->outbuf[r->outpos ++];
+}
+
+// copy the next len bytes to dst, return false if the file ends before
+static inline bool zstd_reader_read(zstd_reader_t *r, void *dst, size_t len) {
+  uint8_t *p = (uint8_t *)dst;
+  while (len > 0) {
+    if (r->outpos == r->outend && !zstd_reader_refill(r)) return false;
+    size_t n = r->outend - r->outpos;
+    if (n > len) n = len;
+    memcpy(p, r->outbuf + r->outpos, n);
+    r->outpos += n;
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+static inline void zstd_reader_close(zstd_reader_t *r) {
+  ZSTD_freeDCtx(r->dctx);
+  fclose(r->fp);
+  free(r->inbuf);
+  free(r->outbuf);
+}
+
+#endif
@@ -98,6 +98,13 @@ extern char log_asmbuf[80];
 
 word_t expr(char *e, bool *success);
 
+// an expression compiled once to be evaluated many times, freed by free()
+typedef struct ExprProg ExprProg;
+ExprProg *expr_compile(char *e); // NULL if the expression is bad
+bool expr_use_reg(ExprProg *p);
+// ref_hook, if not NULL, is called with each memory range read by the expression
+word_t expr_eval(ExprProg *p, void (*ref_hook)(vaddr_t addr, int len));
+
 // ----------- iqueue -----------
 void iqueue_commit(vaddr_t pc, uint8_t *instr_buf, uint8_t ilen);
 void iqueue_dump();
@@ -107,6 +114,7 @@ extern "C" {
 #endif
 bool is_gz_file(const char *filename);
 bool is_zstd_file(const char *filename);
+bool is_page_cpt_file(const char *filename);
 #ifdef __cplusplus
 }
 #endif
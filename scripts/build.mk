@@ -50,7 +50,11 @@ OBJS = $(COBJS) $(XOBJS)
 endif
 
 ifdef CONFIG_MEM_COMPRESS
-LDFLAGS += -lzstd
+LDFLAGS += -lzstd -lpthread
+endif
+
+ifdef CONFIG_BIN_TRACE
+LDFLAGS += -lzstd -lpthread
 endif
 
 # Compilation patterns
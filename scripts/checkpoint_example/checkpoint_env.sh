@@ -4,6 +4,8 @@ export NEMU_HOME=
 export NEMU=$NEMU_HOME/build/riscv64-nemu-interpreter
 export GCPT=$NEMU_HOME/resource/gcpt_restore/build/gcpt.bin
 export SIMPOINT=$NEMU_HOME/resource/simpoint/simpoint_repo/bin/simpoint
+# used instead of $SIMPOINT if built, run `make -C tools/simpoint-cluster`
+export SIMPOINT_CLUSTER=$NEMU_HOME/tools/simpoint-cluster/build/simpoint-cluster
 
 export BBL_PATH=
 export LOG_PATH=$NEMU_HOME/checkpoint_example_result/logs
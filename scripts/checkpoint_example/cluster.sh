@@ -15,6 +15,15 @@ cluster(){
     log=$LOG_PATH/cluster_logs/cluster
     mkdir -p $log
 
+    if [ -x "$SIMPOINT_CLUSTER" ]; then
+        bbv=$PROFILING_RES/${workload}/simpoint_bbv.gz
+        [ -f $bbv ] || bbv=$PROFILING_RES/${workload}/simpoint_bbv.zst
+        $SIMPOINT_CLUSTER -o $CLUSTER -k 30 -n 2 -i 1000 \
+            --seed-km ${random1} --seed-proj ${random2} $bbv \
+            > $log/${workload}-out.txt 2> $log/${workload}-err.txt
+        return
+    fi
+
     $SIMPOINT \
         -loadFVFile $PROFILING_RES/${workload}/simpoint_bbv.gz \
         -saveSimpoints $CLUSTER/simpoints0 -saveSimpointWeights $CLUSTER/weights0 \
@@ -0,0 +1,64 @@
+#***************************************************************************************
+# Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+#
+# NEMU is licensed under Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#          http://license.coscl.org.cn/MulanPSL2
+#
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+# EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+# MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+#
+# See the Mulan PSL v2 for more details.
+#**************************************************************************************/
+
+# Regression tests, included by the Makefile for the test goal only. Each
+# tests/<name>.c or .cpp is linked with the objects of NEMU except nemu-main.o,
+# and `make test` runs the tests enabled by the current configuration. A test of
+# a SHARE build calls the difftest API directly.
+
+TESTS-$(CONFIG_DECODE_CACHE) += decode-cache
+TESTS-$(CONFIG_DIFFTEST_STORE_COMMIT) += store-queue
+TESTS-$(CONFIG_RV_GUEST_TLB) += snapshot-gtlb
+TESTS-$(CONFIG_MEM_COMPRESS) += page-cpt
+TESTS-$(CONFIG_ISA_riscv64) += decode-table
+TESTS-$(CONFIG_DIFFTEST_BATCH) += exec-batch
+TESTS-$(CONFIG_USE_SPARSEMM) += sparseram
+ifndef CONFIG_SHARE
+TESTS-$(CONFIG_DEBUG) += dma-watchpoint
+TESTS-$(CONFIG_RVH) += snapshot-vmid
+endif
+
+TEST_DIR  = $(BUILD_DIR)/tests-$(NAME)$(SO)
+TEST_BINS = $(addprefix $(TEST_DIR)/, $(TESTS-y))
+# the object of each test, which is kept after the test is linked
+TEST_SRCS = $(wildcard $(addprefix tests/, $(addsuffix .c, $(TESTS-y)) $(addsuffix .cpp, $(TESTS-y))))
+TEST_MAIN_OBJS = $(patsubst %.c, $(OBJ_DIR)/%.o, $(patsubst %.cpp, $(OBJ_DIR)/%.opp, $(TEST_SRCS)))
+TEST_OBJS = $(filter-out $(OBJ_DIR)/src/nemu-main.o, $(OBJS))
+TEST_LDFLAGS = $(filter-out -shared, $(LDFLAGS))
+
+# objects of NEMU replaced by the test itself
+TEST_EXCLUDE = $(TEST_EXCLUDE-$(notdir $@))
+TEST_EXCLUDE-decode-table = $(OBJ_DIR)/src/isa/riscv64/instr/decode.o
+
+$(TEST_DIR)/%: $(OBJ_DIR)/tests/%.o $(TEST_OBJS) $(LIBS)
+	@echo + LD $@
+	@mkdir -p $(@D)
+	@$(LD) -o $@ $< $(filter-out $(TEST_EXCLUDE), $(TEST_OBJS)) $(TEST_LDFLAGS) $(LIBS)
+
+$(TEST_DIR)/%: $(OBJ_DIR)/tests/%.opp $(TEST_OBJS) $(LIBS)
+	@echo + LD $@
+	@mkdir -p $(@D)
+	@$(LD) -o $@ $< $(filter-out $(TEST_EXCLUDE), $(TEST_OBJS)) $(TEST_LDFLAGS) $(LIBS)
+
+-include $(wildcard $(OBJ_DIR)/tests/*.d)
+
+test: $(TEST_BINS)
+	@for t in $(TEST_BINS); do \
+	  echo + TEST $$(basename $$t); \
+	  (cd $(TEST_DIR) && $$t) || exit 1; \
+	done
+
+.SECONDARY: $(TEST_MAIN_OBJS)
+.PHONY: test
@@ -33,8 +33,12 @@
 #include <string>
 #include <zlib.h>
 
+#include <algorithm>
 #include <fcntl.h>
 #include <fstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 #include <gcpt_restore/src/restore_rom_addr.h>
 #include <zstd.h>
 
@@ -67,11 +71,18 @@ Serializer::Serializer() :
 extern "C" {
 uint8_t *get_pmem();
 word_t paddr_read(paddr_t addr, int len, int type, int mode, vaddr_t vaddr);
+void paddr_write(paddr_t addr, int len, word_t data, int mode, vaddr_t vaddr);
+void restore_cpt_mret();
+uint64_t clint_cpt_mtime();
+uint64_t clint_cpt_mtimecmp();
 uint8_t *guest_to_host(paddr_t paddr);
 #include <debug.h>
 extern bool log_enable();
 extern void log_flush();
 extern unsigned long MEMORY_SIZE;
+#ifdef CONFIG_MEM_COW
+#include <memory/paddr.h>
+#endif
 }
 
 #ifdef CONFIG_MEM_COMPRESS
@@ -95,6 +106,14 @@ void Serializer::serializePMem(uint64_t inst_count) {
   Log("Put gcpt restorer %s to start of pmem", restorer);
   }
 
+  if (checkpoint_state == SimpointProfileCheckpointing) {
+    // kept in the page store until the simpoints are chosen
+    snapshots.push_back(Snapshot{inst_count, {}});
+    updatePageStore(pmem, PMEM_SIZE, &snapshots.back().delta);
+    regDumped = false;
+    return;
+  }
+
   string filepath;
 
   if (checkpoint_state == SimpointCheckpointing) {
@@ -106,65 +125,354 @@ void Serializer::serializePMem(uint64_t inst_count) {
 
   if (compress_file_format == GZ_FORMAT) {
     filepath += "_.gz";
-    gzFile compressed_mem = gzopen(filepath.c_str(), "wb");
-    if (compressed_mem == nullptr) {
-      cerr << "Failed to open " << filepath << endl;
-      xpanic("Can't open physical memory checkpoint file!\n");
-    } else {
-      cout << "Opening " << filepath << " as checkpoint output file" << endl;
+  } else if (compress_file_format == ZSTD_FORMAT) {
+    filepath += "_.zstd";
+  } else if (compress_file_format == PAGE_FORMAT) {
+    filepath += "_.pages";
+  } else {
+    xpanic("You need to specify the compress file format using: --checkpoint-format\n");
+  }
+
+  if (compress_file_format == PAGE_FORMAT) {
+    // the page store is updated by every checkpoint, so it is written inline
+    serializePMemPages(filepath, pmem, PMEM_SIZE);
+  } else {
+#ifdef CONFIG_CPT_ASYNC
+    drain();
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+      xpanic("Cannot fork to compress the checkpoint: %s\n", strerror(errno));
     }
+    if (pid == 0) {
+      // pmem of this process stays as it was at the fork
+      if (compress_file_format == GZ_FORMAT) serializePMemGz(filepath, pmem, PMEM_SIZE);
+      else serializePMemZstd(filepath, pmem, PMEM_SIZE);
+      fflush(NULL);
+      _exit(0);
+    }
+    drainPid = pid;
+    drainPath = filepath;
+    Log("Checkpoint queued: %s is compressed in process %d\n", filepath.c_str(), pid);
+    regDumped = false;
+    return;
+#else
+    if (compress_file_format == GZ_FORMAT) serializePMemGz(filepath, pmem, PMEM_SIZE);
+    else serializePMemZstd(filepath, pmem, PMEM_SIZE);
+#endif
+  }
 
-    uint64_t pass_size = 0;
+  Log("Checkpoint done!\n");
+  regDumped = false;
+}
+
+// compress [src, src + len) into dst as a complete gzip member
+static bool gzip_chunk(const uint8_t *src, size_t len, std::vector<uint8_t> &dst) {
+  z_stream zs = {};
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  dst.resize(deflateBound(&zs, len));
+  zs.next_in = (Bytef *)src;
+  zs.avail_in = len;
+  zs.next_out = dst.data();
+  zs.avail_out = dst.size();
+  int ret = deflate(&zs, Z_FINISH);
+  dst.resize(zs.total_out);
+  deflateEnd(&zs);
+  return ret == Z_STREAM_END;
+}
 
-    for (uint64_t written = 0; written < PMEM_SIZE; written += pass_size) {
-      pass_size = numeric_limits<int>::max() < ((int64_t)PMEM_SIZE - (int64_t)written)
-                    ? numeric_limits<int>::max()
-                    : ((int64_t)PMEM_SIZE - (int64_t)written);
+// Concatenated gzip members are read back by gzread() as one stream,
+// so chunks of pmem are compressed independently in parallel.
+void Serializer::serializePMemGz(const string &filepath, const uint8_t *pmem, size_t size) {
+  const size_t chunk_size = 16 * 1024 * 1024;
+  const unsigned nr_thread = CONFIG_CPT_COMPRESS_THREADS;
 
-      if (gzwrite(compressed_mem, pmem + written, (uint32_t)pass_size) != (int)pass_size) {
+  FILE *fp = fopen(filepath.c_str(), "wb");
+  if (fp == nullptr) {
+    cerr << "Failed to open " << filepath << endl;
+    xpanic("Can't open physical memory checkpoint file!\n");
+  } else {
+    cout << "Opening " << filepath << " as checkpoint output file" << endl;
+  }
+
+  std::vector<std::vector<uint8_t>> out(nr_thread);
+  std::vector<char> ok(nr_thread);
+  for (size_t base = 0; base < size; base += chunk_size * nr_thread) {
+    std::vector<std::thread> workers;
+    unsigned n = 0;
+    for (; n < nr_thread && base + n * chunk_size < size; n++) {
+      size_t offset = base + n * chunk_size;
+      size_t len = std::min(chunk_size, size - offset);
+      workers.emplace_back([&, n, offset, len] { ok[n] = gzip_chunk(pmem + offset, len, out[n]); });
+    }
+    for (auto &w : workers) {
+      w.join();
+    }
+    for (unsigned i = 0; i < n; i++) {
+      if (!ok[i] || fwrite(out[i].data(), 1, out[i].size(), fp) != out[i].size()) {
         xpanic("Write failed on physical memory checkpoint file\n");
       }
-      Log("Written 0x%lx bytes\n", pass_size);
     }
+  }
+
+  if (fclose(fp)) {
+    xpanic("Close failed on physical memory checkpoint file\n");
+  }
+}
+
+// Chunks of pmem are compressed in parallel as independent frames recording
+// their sizes, which load_zstd_img() decompresses in parallel as well.
+void Serializer::serializePMemZstd(const string &filepath, const uint8_t *pmem, size_t size) {
+  const size_t chunk_size = 16 * 1024 * 1024;
+  const unsigned nr_thread = CONFIG_CPT_COMPRESS_THREADS;
+
+  FILE *compress_file = fopen(filepath.c_str(), "wb");
+  if (compress_file == nullptr) {
+    xpanic("Cannot open %s: %s\n", filepath.c_str(), strerror(errno));
+  }
 
-    if (gzclose(compressed_mem)) {
-      xpanic("Close failed on physical memory checkpoint file\n");
+  std::vector<std::vector<uint8_t>> out(nr_thread, std::vector<uint8_t>(ZSTD_compressBound(chunk_size)));
+  std::vector<size_t> csize(nr_thread);
+  for (size_t base = 0; base < size; base += chunk_size * nr_thread) {
+    std::vector<std::thread> workers;
+    unsigned n = 0;
+    for (; n < nr_thread && base + n * chunk_size < size; n++) {
+      size_t offset = base + n * chunk_size;
+      size_t len = std::min(chunk_size, size - offset);
+      workers.emplace_back([&, n, offset, len] {
+        csize[n] = ZSTD_compress(out[n].data(), out[n].size(), pmem + offset, len, 1);
+      });
     }
-  } else if (compress_file_format == ZSTD_FORMAT) {
-    filepath += "_.zstd";
-    // zstd compress
-    size_t const compress_buffer_size = ZSTD_compressBound(PMEM_SIZE);
-    void *const compress_buffer = malloc(compress_buffer_size);
-    assert(compress_buffer);
+    for (auto &w : workers) {
+      w.join();
+    }
+    for (unsigned i = 0; i < n; i++) {
+      if (ZSTD_isError(csize[i])) {
+        xpanic("Compress failed: %s\n", ZSTD_getErrorName(csize[i]));
+      }
+      if (fwrite(out[i].data(), 1, csize[i], compress_file) != csize[i]) {
+        xpanic("file write error: %s : %s \n", filepath.c_str(), strerror(errno));
+      }
+    }
+  }
+
+  if (fclose(compress_file)) {
+    xpanic("file close error: %s : %s \n", filepath.c_str(), strerror(errno));
+  }
+}
 
-    size_t const compress_size = ZSTD_compress(compress_buffer, compress_buffer_size, pmem, PMEM_SIZE, 1);
-    assert(compress_size <= compress_buffer_size && compress_size != 0);
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// two independent 64-bit lanes, so that distinct pages rarely collide
+Serializer::PageDigest Serializer::digestPage(const uint8_t *page) {
+  auto *p = (const uint64_t *)page;
+  uint64_t lo = 0x9e3779b97f4a7c15ul, hi = 0xc2b2ae3d27d4eb4ful;
+  for (unsigned i = 0; i < PAGE_CPT_PAGE_SIZE / sizeof(uint64_t); i++) {
+    lo = rotl64(lo ^ p[i], 31) * 0x9e3779b97f4a7c15ul;
+    hi = rotl64(hi + p[i], 27) * 0xc2b2ae3d27d4eb4ful + i;
+  }
+  return PageDigest{lo ^ (lo >> 29), hi ^ (hi >> 32)};
+}
 
-    FILE *compress_file = fopen(filepath.c_str(), "wb");
-    size_t fw_size = fwrite(compress_buffer, 1, compress_size, compress_file);
+static bool page_is_zero(const uint8_t *page) {
+  auto *p = (const uint64_t *)page;
+  for (unsigned i = 0; i < PAGE_CPT_PAGE_SIZE / sizeof(uint64_t); i++) {
+    if (p[i] != 0) return false;
+  }
+  return true;
+}
 
-    if (fw_size != (size_t)compress_size) {
-      free(compress_buffer);
-      xpanic("file write error: %s : %s \n", filepath.c_str(), strerror(errno));
+bool Serializer::pageStoreHolds(const PageRef &ref, const uint8_t *page) {
+  if (ref.offset + ref.size > pageStoreFlushed) {
+    if (fflush(pageStore)) {
+      xpanic("Write failed on page store: %s\n", strerror(errno));
     }
+    pageStoreFlushed = pageStoreSize;
+  }
+  static std::vector<uint8_t> stored(PAGE_CPT_PAGE_SIZE), buf(PAGE_CPT_PAGE_SIZE);
+  uint8_t *data = ref.size == PAGE_CPT_PAGE_SIZE ? stored.data() : buf.data();
+  if (pread(fileno(pageStore), data, ref.size, ref.offset) != (ssize_t)ref.size) {
+    xpanic("Read failed on page store: %s\n", strerror(errno));
+  }
+  if (ref.size != PAGE_CPT_PAGE_SIZE &&
+      ZSTD_decompress(stored.data(), PAGE_CPT_PAGE_SIZE, data, ref.size) != PAGE_CPT_PAGE_SIZE) {
+    xpanic("Decompress failed on page store at offset %lu\n", ref.offset);
+  }
+  return memcmp(stored.data(), page, PAGE_CPT_PAGE_SIZE) == 0;
+}
 
-    if (fclose(compress_file)) {
-      free(compress_buffer);
-      xpanic("file close error: %s : %s \n", filepath.c_str(), strerror(errno));
+void Serializer::updatePageStore(uint8_t *pmem, size_t size, std::vector<std::pair<uint64_t, PageRef>> *delta) {
+  const size_t nr_page = size / PAGE_CPT_PAGE_SIZE;
+  if (pageStore == nullptr) {
+    string store_path = pathManager.getWorkloadPath() + PAGE_CPT_STORE;
+    // read as well to compare the pages of the same digest
+    pageStore = fopen(store_path.c_str(), "w+b");
+    if (pageStore == nullptr) {
+      xpanic("Cannot open page store %s: %s\n", store_path.c_str(), strerror(errno));
     }
+    pageRefs.assign(nr_page, PageRef{0, 0});
+  }
 
-    free(compress_buffer);
-  } else {
-    xpanic("You need to specify the compress file format using: --checkpoint-format\n");
+#ifdef CONFIG_MEM_COW
+  // pages written by serializeRegs() and the restorer
+  pmem_dirty_mark(CONFIG_MBASE, VECTOR_REG_DONE - BOOT_CODE + sizeof(uint64_t));
+#endif
+
+  static ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  std::vector<uint8_t> buf(ZSTD_compressBound(PAGE_CPT_PAGE_SIZE));
+  uint64_t nr_new = 0, nr_dup = 0, nr_changed = 0;
+  for (size_t i = 0; i < nr_page; i++) {
+#ifdef CONFIG_MEM_COW
+    // a page not written since the last checkpoint is the same as in it
+    if (pmem_dirty_map[i / 64] == 0) {
+      i |= 63;
+      continue;
+    }
+    if (!pmem_is_dirty(CONFIG_MBASE + i * PAGE_CPT_PAGE_SIZE)) {
+      continue;
+    }
+#endif
+    PageRef &ref = pageRefs[i];
+    PageRef old = ref;
+    const uint8_t *page = pmem + i * PAGE_CPT_PAGE_SIZE;
+    if (page_is_zero(page)) {
+      ref.size = 0;
+    } else {
+      PageDigest digest = digestPage(page);
+      auto range = pageStoreIndex.equal_range(digest);
+      auto it = range.first;
+      while (it != range.second && !pageStoreHolds(it->second, page)) it++;
+      if (it != range.second) {
+        ref = it->second;
+        nr_dup++;
+      } else {
+        size_t csize = ZSTD_compressCCtx(cctx, buf.data(), buf.size(), page, PAGE_CPT_PAGE_SIZE, 1);
+        const void *data = buf.data();
+        if (ZSTD_isError(csize) || csize >= PAGE_CPT_PAGE_SIZE) {
+          csize = PAGE_CPT_PAGE_SIZE;
+          data = page;
+        }
+        if (fwrite(data, 1, csize, pageStore) != csize) {
+          xpanic("Write failed on page store: %s\n", strerror(errno));
+        }
+        ref = PageRef{pageStoreSize, (uint32_t)csize};
+        pageStoreSize += csize;
+        pageStoreIndex.emplace(digest, ref);
+        nr_new++;
+      }
+    }
+    if (ref.offset != old.offset || ref.size != old.size) {
+      nr_changed++;
+      if (delta) delta->emplace_back(i, ref);
+    }
+  }
+  if (fflush(pageStore)) {
+    xpanic("Write failed on page store: %s\n", strerror(errno));
   }
+  pageStoreFlushed = pageStoreSize;
+  IFDEF(CONFIG_MEM_COW, pmem_dirty_clear());
+  Log("%lu pages changed: %lu new, %lu deduplicated, page store size = %lu",
+      nr_changed, nr_new, nr_dup, pageStoreSize);
+}
 
-  Log("Checkpoint done!\n");
-  regDumped = false;
+void Serializer::writePageCpt(const string &filepath, const std::vector<PageRef> &refs, size_t size) {
+  std::vector<page_cpt_entry_t> entries;
+  for (size_t i = 0; i < refs.size(); i++) {
+    if (refs[i].size != 0) {
+      entries.push_back(page_cpt_entry_t{i, refs[i].offset, refs[i].size, 0});
+    }
+  }
+
+  page_cpt_header_t header = {};
+  memcpy(header.magic, PAGE_CPT_MAGIC, sizeof(header.magic));
+  header.version = PAGE_CPT_VERSION;
+  header.page_size = PAGE_CPT_PAGE_SIZE;
+  header.mem_size = size;
+  header.nr_pages = entries.size();
+  snprintf(header.store, sizeof(header.store), "../%s", PAGE_CPT_STORE);
+
+  FILE *fp = fopen(filepath.c_str(), "wb");
+  if (fp == nullptr) {
+    xpanic("Cannot open %s: %s\n", filepath.c_str(), strerror(errno));
+  }
+  cout << "Opening " << filepath << " as checkpoint output file" << endl;
+  if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+      fwrite(entries.data(), sizeof(page_cpt_entry_t), entries.size(), fp) != entries.size()) {
+    xpanic("file write error: %s : %s \n", filepath.c_str(), strerror(errno));
+  }
+  if (fclose(fp)) {
+    xpanic("file close error: %s : %s \n", filepath.c_str(), strerror(errno));
+  }
+  Log("Checkpoint has %lu pages", entries.size());
+}
+
+void Serializer::serializePMemPages(const string &filepath, uint8_t *pmem, size_t size) {
+  updatePageStore(pmem, size, nullptr);
+  writePageCpt(filepath, pageRefs, size);
+}
+
+void Serializer::takeSimpointCheckpoints(const std::map<uint64_t, double> &simpoints) {
+  if (snapshots.empty()) {
+    Log("No snapshot is taken, no checkpoint is written");
+    return;
+  }
+  // the pages of a snapshot are those of the previous one with its delta applied
+  std::vector<PageRef> refs(pageRefs.size(), PageRef{0, 0});
+  size_t nr_applied = 0;
+  simpoint2Weights = simpoints;
+  while (!simpoint2Weights.empty()) {
+    uint64_t simpoint = simpoint2Weights.begin()->first;
+    double weight = simpoint2Weights.begin()->second;
+    // a snapshot is taken every interval, so the warmup is rounded up to intervals
+    uint64_t point = simpoint * intervalSize <= warmupIntervalSize ? 0 : simpoint * intervalSize - warmupIntervalSize;
+    size_t idx = std::min(point / intervalSize, snapshots.size() - 1);
+    for (; nr_applied <= idx; nr_applied++) {
+      for (auto &d : snapshots[nr_applied].delta) refs[d.first] = d.second;
+    }
+
+    pathManager.setCheckpointingOutputDir();
+    string filepath = pathManager.getOutputPath() + "_" + to_string(simpoint) + "_" + to_string(weight) + "_.pages";
+    Log("Taking the checkpoint of simpoint %lu from the snapshot @ instruction count %lu",
+        simpoint, snapshots[idx].instCount);
+    writePageCpt(filepath, refs, MEMORY_SIZE);
+    simpoint2Weights.erase(simpoint2Weights.begin());
+  }
+  snapshots.clear();
+}
+
+void Serializer::drain() {
+  if (drainPid < 0) {
+    return;
+  }
+  int status;
+  pid_t pid = waitpid(drainPid, &status, 0);
+  // a process forked by snapshot_take() does not own the compressing process
+  if (pid < 0 && errno == ECHILD) {
+    drainPid = -1;
+    return;
+  }
+  if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    xpanic("Checkpoint failed: %s is not written by process %d\n", drainPath.c_str(), drainPid);
+  }
+  Log("Checkpoint done: %s\n", drainPath.c_str());
+  drainPid = -1;
 }
 #else
 void Serializer::serializePMem(uint64_t inst_count) {}
+
+void Serializer::takeSimpointCheckpoints(const std::map<uint64_t, double> &simpoints) {
+  xpanic("You should enable CONFIG_MEM_COMPRESS in menuconfig");
+}
+
+void Serializer::drain() {}
 #endif
 
+Serializer::~Serializer() {
+  drain();
+}
+
 #ifdef CONFIG_MEM_COMPRESS
 extern void csr_writeback();
 
@@ -258,18 +566,64 @@ void Serializer::serializeRegs() {
   Log("Record mode flag: 0x%lx at addr 0x%x", cpu.mode, MODE_CPT_ADDR);
 
   auto *mtime = (uint64_t *) (get_pmem() + MTIMEAddr);
-  extern word_t paddr_read(paddr_t addr, int len, int type, int mode, vaddr_t vaddr);
-  *mtime = ::paddr_read(CLINT_MMIO+0xBFF8, 8, MEM_TYPE_READ, MODE_M, CLINT_MMIO+0xBFF8);
+  *mtime = clint_cpt_mtime();
   Log("Record time: 0x%lx at addr 0x%x", cpu.mode, MTIME_CPT_ADDR);
 
   auto *mtime_cmp = (uint64_t *) (get_pmem() + MTIMECMPAddr);
-  *mtime_cmp = ::paddr_read(CLINT_MMIO+0x4000, 8, MEM_TYPE_READ, MODE_M, CLINT_MMIO+0x4000);
+  *mtime_cmp = clint_cpt_mtimecmp();
   Log("Record time: 0x%lx at addr 0x%x", cpu.mode, MTIME_CMP_CPT_ADDR);
 
   regDumped = true;
 }
+
+bool Serializer::deserializeRegs() {
+  auto *flag = (uint64_t *)(get_pmem() + CptFlagAddr);
+  if (*flag != CPT_MAGIC_BUMBER) {
+    Log("No register found in the checkpoint (flag: 0x%lx)", *flag);
+    return false;
+  }
+
+  auto *intRegCpt = (uint64_t *)(get_pmem() + IntRegStartAddr);
+  for (unsigned i = 1; i < 32; i++) {
+    cpu.gpr[i]._64 = *(intRegCpt + i);
+  }
+
+#ifndef CONFIG_FPU_NONE
+  auto *floatRegCpt = (uint64_t *)(get_pmem() + FloatRegStartAddr);
+  for (unsigned i = 0; i < 32; i++) {
+    cpu.fpr[i]._64 = *(floatRegCpt + i);
+  }
+#endif  // CONFIG_FPU_NONE
+
+#ifdef CONFIG_RVV
+  auto *vectorRegCpt = (uint64_t *)(get_pmem() + VecRegStartAddr);
+  for (unsigned i = 0; i < 32; i++) {
+    for (unsigned j = 0; j < VENUM64; j++) {
+      cpu.vr[i]._64[j] = *(vectorRegCpt + (i * VENUM64) + j);
+    }
+  }
+#endif // CONFIG_RVV
+
+  // mstatus and mepc have been prepared for the mret of the restorer
+  auto *csrCpt = (uint64_t *)(get_pmem() + CSRStartAddr);
+  memcpy(csr_array, csrCpt, 4096 * sizeof(uint64_t));
+  cpu.mode = MODE_M;
+
+  auto *mtime = (uint64_t *)(get_pmem() + MTIMEAddr);
+  auto *mtime_cmp = (uint64_t *)(get_pmem() + MTIMECMPAddr);
+  ::paddr_write(CLINT_MMIO+0x4000, 8, *mtime_cmp, MODE_M, CLINT_MMIO+0x4000);
+  ::paddr_write(CLINT_MMIO+0xBFF8, 8, *mtime, MODE_M, CLINT_MMIO+0xBFF8);
+
+  restore_cpt_mret();
+  Log("Restored registers from checkpoint memory, pc = 0x%lx, mode = %ld", cpu.pc, cpu.mode);
+  return true;
+}
 #else
 void Serializer::serializeRegs() {}
+
+bool Serializer::deserializeRegs() {
+  xpanic("You should enable CONFIG_MEM_COMPRESS in menuconfig");
+}
 #endif
 
 void Serializer::serialize(uint64_t inst_count) {
@@ -310,6 +664,18 @@ void Serializer::init() {
     intervalSize = checkpoint_interval;
     Log("Taking uniform checkpionts with interval %lu", checkpoint_interval);
     nextUniformPoint = intervalSize;
+  } else if (checkpoint_state == SimpointProfileCheckpointing) {
+    assert(checkpoint_interval);
+    intervalSize = checkpoint_interval;
+    warmupIntervalSize = warmup_interval;
+    Log("Taking a snapshot every %lu instructions, checkpoints of simpoints are taken at the end", checkpoint_interval);
+    nextUniformPoint = 0;
+    if (compress_file_format != PAGE_FORMAT) {
+      Log("Snapshots are kept in the page store, checkpoints are written in the pages format");
+      compress_file_format = PAGE_FORMAT;
+    }
+    // the output directory is set for each simpoint at the end
+    return;
   }
   pathManager.setCheckpointingOutputDir();
 }
@@ -335,6 +701,7 @@ bool Serializer::instrsCouldTakeCpt(uint64_t num_insts) {
       return true;
     case ManualUniformCheckpointing:
     case UniformCheckpointing:
+    case SimpointProfileCheckpointing:
       if (num_insts >= nextUniformPoint) {
         Log("Should take cpt now: %lu", num_insts);
         return true;
@@ -364,13 +731,15 @@ void Serializer::notify_taken(uint64_t i) {
   } else if (checkpoint_state == ManualUniformCheckpointing || checkpoint_state == UniformCheckpointing) {
     nextUniformPoint += intervalSize;
     pathManager.setCheckpointingOutputDir();
+  } else if (checkpoint_state == SimpointProfileCheckpointing) {
+    nextUniformPoint += intervalSize;
   }
 }
 
 Serializer serializer;
 uint64_t Serializer::next_index(){
   uint64_t index=0;
-  if (checkpoint_state==SimpointCheckpointing&&!serializer.simpoint2Weights.empty()) {
+  if ((checkpoint_state==SimpointCheckpointing||checkpoint_state==SimpointProfileCheckpointing)&&!serializer.simpoint2Weights.empty()) {
     index=serializer.simpoint2Weights.begin()->first;
   }else if(checkpoint_state==UniformCheckpointing||checkpoint_state==ManualUniformCheckpointing){
     index=nextUniformPoint;
@@ -400,4 +769,8 @@ void serialize_reg_to_mem() {
   serializer.serializeRegs();
 }
 
+bool deserialize_reg_from_mem() {
+  return serializer.deserializeRegs();
+}
+
 }
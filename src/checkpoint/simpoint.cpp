@@ -46,7 +46,12 @@
 #include <vector>
 
 #include <checkpoint/simpoint.h>
+#include <checkpoint/path_manager.h>
+#include <checkpoint/serializer.h>
 #include <profiling/profiling_control.h>
+#ifdef CONFIG_MEM_COMPRESS
+#include <zstd.h>
+#endif
 
 namespace SimPointNS
 {
@@ -61,6 +66,31 @@ extern FILE *log_fp;
 extern bool enable_small_log;
 }
 
+/*
+ * The binary BBV is a zstd stream of
+ *   "NEMUBBV1", varint(interval size),
+ * followed by one record per interval
+ *   varint(n), n * (varint(id - previous id), varint(count))
+ * with the ids in increasing order. tools/bbv-convert turns it into the
+ * text format "T:id:count :id:count ...".
+ */
+static const char bbvMagic[8] = {'N', 'E', 'M', 'U', 'B', 'B', 'V', '1'};
+
+static inline void putVarint(std::vector<uint8_t> &buf, uint64_t v) {
+  while (v >= 0x80) {
+    buf.push_back((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  buf.push_back(v);
+}
+
+static inline uint64_t hashBB(const BasicBlockRange &bb) {
+  uint64_t x = bb.first ^ (bb.second * 0x9e3779b97f4a7c15ull);
+  x ^= x >> 29;
+  x *= 0xbf58476d1ce4e5b9ull;
+  return x ^ (x >> 32);
+}
+
 SimPoint::SimPoint()
     : intervalCount(0),
       intervalDrift(0),
@@ -72,6 +102,13 @@ SimPoint::SimPoint()
 SimPoint::~SimPoint() {
   if (simpointStream)
     NEMUNS::simout.close(simpointStream);
+  if (binaryFile) {
+    writeBinary(true);
+    fclose(binaryFile);
+  }
+#ifdef CONFIG_MEM_COMPRESS
+  ZSTD_freeCCtx((ZSTD_CCtx *)zstdCtx);
+#endif
 }
 
 void
@@ -81,6 +118,23 @@ SimPoint::init() {
     assert(checkpoint_interval);
     intervalSize = checkpoint_interval;
     Log("Doing simpoint profiling with interval %lu", intervalSize);
+    bbTable.resize(1 << 12);
+
+    if (simpoint_bbv_format == BBV_BINARY_FORMAT) {
+#ifdef CONFIG_MEM_COMPRESS
+      auto path = pathManager.getOutputPath() + "/simpoint_bbv.zst";
+      binaryFile = fopen(path.c_str(), "wb");
+      if (!binaryFile)
+        xpanic("unable to open SimPoint profile_file %s\n", path.c_str());
+      zstdCtx = ZSTD_createCCtx();
+      binaryBuf.insert(binaryBuf.end(), bbvMagic, bbvMagic + sizeof(bbvMagic));
+      putVarint(binaryBuf, intervalSize);
+#else
+      xpanic("You should enable CONFIG_MEM_COMPRESS in menuconfig");
+#endif
+      return;
+    }
+
     auto path = pathManager.getOutputPath() + "/simpoint_bbv.gz";
 
     using NEMUNS::simout;
@@ -100,6 +154,29 @@ SimPoint::profile_with_abs_icount(Addr pc, bool is_control, bool is_last_uop, ui
   lastICount = abs_icount;
 }
 
+SimPoint::BBInfo *
+SimPoint::findBB(const BasicBlockRange &bb) {
+  size_t mask = bbTable.size() - 1;
+  size_t idx = hashBB(bb) & mask;
+  while (bbTable[idx].id != 0 && (bbTable[idx].start != bb.first || bbTable[idx].end != bb.second)) {
+    idx = (idx + 1) & mask;
+  }
+  return &bbTable[idx];
+}
+
+void
+SimPoint::growBBTable() {
+  std::vector<BBInfo> old(bbTable.size() * 2);
+  old.swap(bbTable);
+  touched.clear();
+  for (auto &info : old) {
+    if (info.id == 0) continue;
+    BBInfo *slot = findBB(BasicBlockRange(info.start, info.end));
+    *slot = info;
+    if (info.count != 0) touched.push_back(slot - bbTable.data());
+  }
+}
+
 void
 SimPoint::profile(Addr pc, bool is_control, bool is_last_uop, unsigned instr_count) {
 
@@ -120,45 +197,26 @@ SimPoint::profile(Addr pc, bool is_control, bool is_last_uop, unsigned instr_cou
   if (is_control) {
     currentBBV.second = pc;
 
-    auto map_itr = bbMap.find(currentBBV);
+    if ((nrBB + 1) * 2 > bbTable.size()) growBBTable();
+    BBInfo *info = findBB(currentBBV);
     Logsp("Finding BB 0x%lx -> 0x%lx", currentBBV.first, currentBBV.second);
-    if (map_itr == bbMap.end()) {
+    if (info->id == 0) {
       // If a new (previously unseen) basic block is found,
-      // add a new unique id, record num of insts and insert into bbMap.
-      BBInfo info;
-      info.id = bbMap.size() + 1;
-      info.insts = currentBBVInstCount;
-      info.count = currentBBVInstCount;
-      bbMap.insert(::std::make_pair(currentBBV, info));
-    } else {
-      // If basic block is seen before, just increment the count by the
-      // number of insts in basic block.
-      BBInfo &info = map_itr->second;
-      info.count += currentBBVInstCount;
+      // add a new unique id, record num of insts and insert into bbTable.
+      nrBB ++;
+      *info = BBInfo{currentBBV.first, currentBBV.second, nrBB, currentBBVInstCount, 0};
     }
+    // Increment the count by the number of insts in basic block, and
+    // remember the basic blocks executed in this interval.
+    if (info->count == 0 && currentBBVInstCount != 0) touched.push_back(info - bbTable.data());
+    info->count += currentBBVInstCount;
     currentBBVInstCount = 0;
 
     // Reached end of interval if the sum of the current inst count
     // (intervalCount) and the excessive inst count from the previous
     // interval (intervalDrift) is greater than/equal to the interval size.
     if (intervalCount + intervalDrift >= intervalSize) {
-      // summarize interval and display BBV info
-      std::vector<std::pair<uint64_t, uint64_t> > counts;
-      for (auto map_itr = bbMap.begin(); map_itr != bbMap.end(); ++map_itr) {
-        BBInfo &info = map_itr->second;
-        if (info.count != 0) {
-          counts.push_back(std::make_pair(info.id, info.count));
-          info.count = 0;
-        }
-      }
-      std::sort(counts.begin(), counts.end());
-
-      // Print output BBV info
-      *simpointStream->stream() << "T";
-      for (auto cnt_itr = counts.begin(); cnt_itr != counts.end(); ++cnt_itr) {
-        *simpointStream->stream() << ":" << cnt_itr->first << ":" << cnt_itr->second << " ";
-      }
-      *simpointStream->stream() << "\n";
+      dumpInterval();
       Logsp("Simpoint profilied %lu instrs", intervalCount);
 
       intervalDrift = (intervalCount + intervalDrift) - intervalSize;
@@ -167,6 +225,92 @@ SimPoint::profile(Addr pc, bool is_control, bool is_last_uop, unsigned instr_cou
   }
 }
 
+void
+SimPoint::dumpInterval() {
+  // summarize interval and display BBV info
+  std::sort(touched.begin(), touched.end(),
+      [this](uint32_t a, uint32_t b) { return bbTable[a].id < bbTable[b].id; });
+
+  if (checkpoint_state == SimpointProfileCheckpointing) {
+    std::vector<std::pair<uint64_t, uint64_t>> bbv;
+    for (auto idx : touched) bbv.emplace_back(bbTable[idx].id, bbTable[idx].count);
+    projectedBBVs.resize(projectedBBVs.size() + clusterOpt.dim, 0);
+    SimPointCluster::project(clusterOpt, bbv, &projectedBBVs[projectedBBVs.size() - clusterOpt.dim]);
+  }
+
+  if (binaryFile) {
+    putVarint(binaryBuf, touched.size());
+    uint64_t prev = 0;
+    for (auto idx : touched) {
+      BBInfo &info = bbTable[idx];
+      putVarint(binaryBuf, info.id - prev);
+      putVarint(binaryBuf, info.count);
+      prev = info.id;
+      info.count = 0;
+    }
+    if (binaryBuf.size() >= (1 << 20)) writeBinary(false);
+  } else {
+    // Print output BBV info
+    std::ostream &os = *simpointStream->stream();
+    os << "T";
+    for (auto idx : touched) {
+      BBInfo &info = bbTable[idx];
+      os << ":" << info.id << ":" << info.count << " ";
+      info.count = 0;
+    }
+    os << "\n";
+  }
+  touched.clear();
+}
+
+void
+SimPoint::writeBinary(bool end) {
+#ifdef CONFIG_MEM_COMPRESS
+  ZSTD_CCtx *cctx = (ZSTD_CCtx *)zstdCtx;
+  std::vector<uint8_t> out(ZSTD_CStreamOutSize());
+  ZSTD_inBuffer input = { binaryBuf.data(), binaryBuf.size(), 0 };
+  ZSTD_EndDirective mode = end ? ZSTD_e_end : ZSTD_e_continue;
+  bool finished;
+  do {
+    ZSTD_outBuffer output = { out.data(), out.size(), 0 };
+    size_t remaining = ZSTD_compressStream2(cctx, &output, &input, mode);
+    if (ZSTD_isError(remaining))
+      xpanic("Failed to compress SimPoint BBV: %s\n", ZSTD_getErrorName(remaining));
+    if (fwrite(out.data(), 1, output.pos, binaryFile) != output.pos)
+      xpanic("Write failed on SimPoint profile_file\n");
+    finished = end ? (remaining == 0) : (input.pos == input.size);
+  } while (!finished);
+  binaryBuf.clear();
+#endif
+}
+
+std::map<uint64_t, double>
+SimPoint::chooseSimpoints() {
+  std::map<uint64_t, double> simpoints;
+  size_t nr_interval = projectedBBVs.size() / clusterOpt.dim;
+  if (nr_interval == 0) {
+    Log("No interval is profiled, no simpoint is chosen");
+    return simpoints;
+  }
+  auto res = SimPointCluster::cluster(clusterOpt, projectedBBVs);
+  Log("Clustered %lu intervals into %d clusters", nr_interval, res.k);
+
+  auto dir = pathManager.getWorkloadPath();
+  FILE *sf = fopen((dir + "simpoints0").c_str(), "w");
+  FILE *wf = fopen((dir + "weights0").c_str(), "w");
+  if (!sf || !wf)
+    xpanic("unable to open simpoints0 and weights0 in %s\n", dir.c_str());
+  for (size_t i = 0; i < res.clusters.size(); i++) {
+    fprintf(sf, "%lu %d\n", res.simpoints[i], res.clusters[i]);
+    fprintf(wf, "%f %d\n", res.weights[i], res.clusters[i]);
+    simpoints[res.simpoints[i]] = res.weights[i];
+    Log("Simpoint %d: @ %lu, weight: %f", res.clusters[i], res.simpoints[i], res.weights[i]);
+  }
+  fclose(sf);
+  fclose(wf);
+  return simpoints;
+}
+
 }
 
 SimPointNS::SimPoint simpoit_obj;
@@ -185,5 +329,12 @@ void simpoint_profiling(uint64_t pc, bool is_control, uint64_t abs_instr_count)
   xpanic("You should enable CONFIG_MEM_COMPRESS in menuconfig");
 #endif
 }
+
+void simpoint_profiling_finish() {
+  if (checkpoint_state != SimpointProfileCheckpointing) return;
+  serializer.takeSimpointCheckpoints(simpoit_obj.chooseSimpoints());
+  // the simpoints are chosen and taken only once
+  checkpoint_state = NoCheckpoint;
+}
 #endif
 }
@@ -19,13 +19,18 @@
 #include <cpu/exec.h>
 #include <cpu/difftest.h>
 #include <cpu/decode.h>
+#include <device/mmio.h>
 #include <memory/host-tlb.h>
+#include <memory/paddr.h>
+#include <memory/sparseram.h>
+#include <memory/vaddr.h>
 #include <isa-all-instr.h>
 #include <locale.h>
 #include <setjmp.h>
 #include <unistd.h>
 #include <generated/autoconf.h>
 #include <profiling/profiling_control.h>
+#include <profiling/bintrace.h>
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -42,6 +47,7 @@
 CPU_state cpu = {};
 uint64_t g_nr_guest_instr = 0;
 uint64_t g_nr_vst = 0, g_nr_vst_unit = 0, g_nr_vst_unit_optimized = 0;
+IFDEF(CONFIG_RV_GUEST_TLB, extern uint64_t g_nr_gtlb_hit, g_nr_gtlb_miss, g_nr_gtlb_flush);
 static uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 const rtlreg_t rzero = 0;
@@ -55,7 +61,7 @@ static inline void debug_hook(vaddr_t pc, const char *asmbuf) {
   }
 
   void scan_watchpoint(vaddr_t pc);
-  scan_watchpoint(pc);
+  if (unlikely(wp_need_scan)) scan_watchpoint(pc);
 }
 #endif
 
@@ -66,6 +72,15 @@ static Decode *prev_s;
 
 void save_globals(Decode *s) { IFDEF(CONFIG_PERF_OPT, prev_s = s); }
 
+// the instruction executed last, or being executed when an exception is raised
+Decode *get_last_decode() { return prev_s; }
+
+#ifdef CONFIG_DIFFTEST_BATCH
+static commit_hook_t commit_hook = NULL;
+
+void set_commit_hook(commit_hook_t hook) { commit_hook = hook; }
+#endif
+
 uint64_t get_abs_instr_count() {
 #if defined(CONFIG_ENABLE_INSTR_CNT)
   int n_batch = n_remain_total >= BATCH_SIZE ? BATCH_SIZE : n_remain_total;
@@ -96,6 +111,14 @@ void monitor_statistic() {
   Log("total guest instructions = %'ld", g_nr_guest_instr);
   Log("vst count = %'ld, vst unit count = %'ld, vst unit optimized count = %'ld",
       g_nr_vst, g_nr_vst_unit, g_nr_vst_unit_optimized);
+#ifdef CONFIG_RV_GUEST_TLB
+  Log("guest TLB hit = %'ld, miss = %'ld, flush = %'ld",
+      g_nr_gtlb_hit, g_nr_gtlb_miss, g_nr_gtlb_flush);
+#endif
+#ifdef CONFIG_DIFFTEST_STORE_COMMIT
+  if (store_queue_nr_overflow() > 0)
+    Log("store commit queue overflow = %'ld", store_queue_nr_overflow());
+#endif
   if (g_timer > 0)
     Log("simulation frequency = %'ld instr/s",
         g_nr_guest_instr * 1000000 / g_timer);
@@ -105,17 +128,38 @@ void monitor_statistic() {
 #else
   Log("CONFIG_ENABLE_INSTR_CNT is not defined");
 #endif
+  IFDEF(CONFIG_DEVICE, mmio_statistic());
   fflush(stdout);
 }
 
 static word_t g_ex_cause = 0;
 static int g_sys_state_flag = 0;
 
-void set_sys_state_flag(int flag) { g_sys_state_flag |= flag; }
+#ifdef CONFIG_DECODE_CACHE
+typedef struct {
+  Decode s;
+  const uint8_t *host; // bytes of the instruction in pmem
+  uint64_t gen;
+  int mode;
+} DecodeCacheEntry;
+
+static DecodeCacheEntry decode_cache[CONFIG_DECODE_CACHE_SIZE];
+static uint64_t decode_cache_gen = 1; // entries of older generations are invalid
+
+static void decode_cache_flush() { decode_cache_gen ++; }
+#endif
+
+void set_sys_state_flag(int flag) {
+  g_sys_state_flag |= flag;
+  IFDEF(CONFIG_DECODE_CACHE, if (flag & SYS_STATE_FLUSH_TCACHE) decode_cache_flush());
+}
 
 void mmu_tlb_flush(vaddr_t vaddr) {
   hosttlb_flush(vaddr);
-  if (vaddr == 0)
+  // the memory read by watchpoints may be mapped to other places
+  IFDEF(CONFIG_DEBUG, wp_need_scan = true);
+  IFDEF(CONFIG_DECODE_CACHE, decode_cache_flush());
+  if (vaddr == 0 || MUXDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_has_vpage(vaddr), false))
     set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
 }
 
@@ -137,10 +181,30 @@ _Noreturn void longjmp_exception(int ex_cause) {
 static bool manual_cpt_quit = false;
 #define FILL_EXEC_TABLE(name) [concat(EXEC_ID_, name)] = &&concat(exec_, name),
 
+#ifdef CONFIG_TCACHE_TRACE
+Decode *tcache_trace_form(Decode *s);
+// stay in the superblock if the edge is stitched
+#define trace_follow(s, next, link)                                            \
+  if (s->trace_flag & (link)) {                                                \
+    s = next;                                                                  \
+    goto finish_label;                                                         \
+  }
+#define trace_taken(s)                                                         \
+  (unlikely(++s->edge_cnt[0] == CONFIG_TCACHE_TRACE_THRESHOLD)                 \
+       ? tcache_trace_form(s)                                                  \
+       : s->tnext)
+#define trace_ntaken(s) (s->edge_cnt[1]++, s->ntnext)
+#else
+#define trace_follow(s, next, link)
+#define trace_taken(s) s->tnext
+#define trace_ntaken(s) s->ntnext
+#endif
+
 #define rtl_j(s, target)                                                       \
   do {                                                                         \
+    trace_follow(s, s->tnext, TRACE_LINK_TAKEN);                               \
     IFDEF(CONFIG_ENABLE_INSTR_CNT, n -= s->idx_in_bb);                         \
-    s = s->tnext;                                                              \
+    s = trace_taken(s);                                                        \
     is_ctrl = true;                                                            \
     br_taken = true;                                                           \
     goto end_of_bb;                                                            \
@@ -155,22 +219,29 @@ static bool manual_cpt_quit = false;
   } while (0)
 #define rtl_jrelop(s, relop, src1, src2, target)                               \
   do {                                                                         \
-    IFDEF(CONFIG_ENABLE_INSTR_CNT, n -= s->idx_in_bb);                         \
-    is_ctrl = true;                                                            \
     if (interpret_relop(relop, *src1, *src2)) {                                \
-      s = s->tnext;                                                            \
+      trace_follow(s, s->tnext, TRACE_LINK_TAKEN);                             \
+      IFDEF(CONFIG_ENABLE_INSTR_CNT, n -= s->idx_in_bb);                       \
+      s = trace_taken(s);                                                      \
       br_taken = true;                                                         \
-    } else                                                                     \
-      s = s->ntnext;                                                           \
+    } else {                                                                   \
+      trace_follow(s, s->ntnext, TRACE_LINK_NTAKEN);                           \
+      IFDEF(CONFIG_ENABLE_INSTR_CNT, n -= s->idx_in_bb);                       \
+      s = trace_ntaken(s);                                                     \
+    }                                                                          \
+    is_ctrl = true;                                                            \
     goto end_of_bb;                                                            \
   } while (0)
 
 #define rtl_priv_next(s)                                                       \
   do {                                                                         \
     if (g_sys_state_flag) {                                                    \
-      s = (g_sys_state_flag & SYS_STATE_FLUSH_TCACHE)                          \
-              ? tcache_handle_flush(s->snpc)                                   \
-              : s + 1;                                                         \
+      if (g_sys_state_flag & SYS_STATE_FLUSH_TCACHE) {                         \
+        IFDEF(CONFIG_ENABLE_INSTR_CNT, n -= s->idx_in_bb);                     \
+        s = tcache_handle_flush(s->snpc);                                      \
+      } else {                                                                 \
+        s = s + 1;                                                             \
+      }                                                                        \
       g_sys_state_flag = 0;                                                    \
       goto end_of_loop;                                                        \
     }                                                                          \
@@ -203,6 +274,12 @@ static inline Decode *jr_fetch(Decode *s, vaddr_t target) {
 }
 
 static inline void debug_difftest(Decode *_this, Decode *next) {
+#ifdef CONFIG_BIN_TRACE
+  if (bintrace_kind == BINTRACE_INST) {
+    bintrace_inst(_this->pc, _this->isa.instr.val, _this->snpc - _this->pc,
+                  _this->type, next->pc != _this->snpc);
+  }
+#endif
   IFDEF(CONFIG_IQUEUE, iqueue_commit(_this->pc, (void *)&_this->isa.instr.val,
                                      _this->snpc - _this->pc));
   IFDEF(CONFIG_DEBUG, debug_hook(_this->pc, _this->logbuf));
@@ -214,6 +291,11 @@ static inline void debug_difftest(Decode *_this, Decode *next) {
 #ifndef CONFIG_SHARE
 uint64_t per_bb_profile(Decode *prev_s, Decode *s, bool control_taken) {
   uint64_t abs_inst_count = get_abs_instr_count();
+#ifdef CONFIG_BIN_TRACE
+  if (bintrace_kind == BINTRACE_BB) {
+    bintrace_bb(prev_s->pc, s->pc, abs_inst_count, prev_s->type, control_taken);
+  }
+#endif
   // workload_loaded set from nemu_trap
   if (profiling_state == SimpointProfiling && (workload_loaded||donot_skip_boot)) {
     simpoint_profiling(prev_s->pc, true, abs_inst_count);
@@ -256,6 +338,8 @@ uint64_t per_bb_profile(Decode *prev_s, Decode *s, bool control_taken) {
       break;
   case SimpointCheckpointing:
       break;
+  case SimpointProfileCheckpointing:
+      break;
   }
 
   cpu.pc = s->pc;
@@ -294,7 +378,7 @@ static int execute(int n) {
   __attribute__((unused)) bool br_taken = false;
   __attribute__((unused)) bool is_ctrl = false;
   while (true) {
-#if defined(CONFIG_DEBUG) || defined(CONFIG_DIFFTEST) || defined(CONFIG_IQUEUE)
+#if defined(CONFIG_DEBUG) || defined(CONFIG_DIFFTEST) || defined(CONFIG_IQUEUE) || defined(CONFIG_BIN_TRACE)
     this_s = s;
 #endif
     __attribute__((unused)) rtlreg_t ls0, ls1, ls2;
@@ -530,6 +614,57 @@ uint64_t lightqs_restore_reg_snapshot(uint64_t n) {
 
 #endif // CONFIG_LIGHTQS
 
+#ifdef CONFIG_DECODE_CACHE
+static inline int decode_cache_mode() {
+  // float instructions are decoded as illegal with mstatus.FS off, and
+  // loads and stores are decoded to access memory with or without
+  // translation, which also depends on mstatus.MPRV and MPP
+  extern bool fp_enable();
+  return cpu.mode | MUXDEF(CONFIG_RVH, cpu.v << 2, 0) | fp_enable() << 3 | isa_mmu_state() << 4;
+}
+
+static inline bool decode_cache_bypass() {
+  // triggers on instruction fetch are checked while fetching
+  return MUXDEF(CONFIG_RV_SDTRIG, cpu.TM->check_timings.bf || cpu.TM->check_timings.af, false);
+}
+
+static bool decode_cacheable(Decode *s) {
+  int len = s->snpc - s->pc;
+  // an all-zero instruction may come from a sparse page not allocated yet
+  if (s->isa.instr.val == 0 || (s->pc & PAGE_MASK) + len > PAGE_SIZE) return false;
+#ifdef CONFIG_RVV
+  // vector instructions are decoded with vtype
+  uint32_t opcode = s->isa.instr.val & 0x7f, width = s->isa.instr.i.funct3;
+  if (opcode == 0x57) return false;
+  if ((opcode == 0x07 || opcode == 0x27) && (width == 0 || width >= 5)) return false;
+#endif
+  return true;
+}
+
+static void fetch_decode_cached(Decode *s, vaddr_t pc) {
+  DecodeCacheEntry *e = &decode_cache[(pc >> 1) & (CONFIG_DECODE_CACHE_SIZE - 1)];
+  bool bypass = decode_cache_bypass();
+  if (e->gen == decode_cache_gen && e->s.pc == pc && e->mode == decode_cache_mode() && !bypass &&
+      memcmp(e->host, &e->s.isa.instr.val, e->s.snpc - pc) == 0) {
+    *s = e->s;
+    return;
+  }
+
+  // an exception on fetching leaves the entry as it is
+  fetch_decode(s, pc);
+  if (bypass || !decode_cacheable(s)) return;
+  paddr_t paddr = vaddr_ifetch_paddr(pc);
+  if (!in_pmem(paddr)) return;
+  const uint8_t *host = MUXDEF(CONFIG_USE_SPARSEMM, sparse_mem_host_addr(get_sparsemm(), paddr, false),
+      guest_to_host(paddr));
+  if (host == NULL) return;
+  e->s = *s;
+  e->host = host;
+  e->gen = decode_cache_gen;
+  e->mode = decode_cache_mode();
+}
+#endif
+
 static int execute(int n) {
   static Decode s;
   prev_s = &s;
@@ -538,7 +673,7 @@ static int execute(int n) {
     printf("ahead pc %lx %lx\n", g_nr_guest_instr, cpu.pc);
 #endif // CONFIG_LIGHTQS_DEBUG
     cpu.amo = false;
-    fetch_decode(&s, cpu.pc);
+    MUXDEF(CONFIG_DECODE_CACHE, fetch_decode_cached, fetch_decode)(&s, cpu.pc);
     cpu.debug.current_pc = s.pc;
     cpu.pc = s.snpc;
 #ifdef CONFIG_TVAL_EX_II
@@ -552,6 +687,12 @@ static int execute(int n) {
 #endif
     s.EHelper(&s);
     g_nr_guest_instr++;
+    IFDEF(CONFIG_DIFFTEST_BATCH, if (commit_hook) commit_hook(&s, false));
+#ifdef CONFIG_BIN_TRACE
+    if (bintrace_kind == BINTRACE_INST) {
+      bintrace_inst(s.pc, s.isa.instr.val, s.snpc - s.pc, s.type, cpu.pc != s.snpc);
+    }
+#endif
 #ifdef CONFIG_BR_LOG
 #ifdef CONFIG_LIGHTQS_DEBUG
     if (g_nr_guest_instr == 10000) {
@@ -602,7 +743,8 @@ static void update_global() {
 /* Simulate how the CPU works. */
 void cpu_exec(uint64_t n) {
 #ifndef CONFIG_LIGHTQS
-  IFDEF(CONFIG_SHARE, assert(n <= 1));
+  // the DUT checks every instruction, unless they are reported to the commit hook
+  IFDEF(CONFIG_SHARE, assert(n <= 1 || MUXDEF(CONFIG_DIFFTEST_BATCH, commit_hook != NULL, false)));
 #endif
   g_print_step = (n < MAX_INSTR_TO_PRINT);
   switch (nemu_state.state) {
@@ -630,6 +772,9 @@ void cpu_exec(uint64_t n) {
 #ifdef CONFIG_PERF_OPT
     update_global();
 #endif
+    // the exception may be raised in the middle of an indexed vector access
+    IFDEF(CONFIG_RVV, vldst.v_is_vx = 0);
+    IFDEF(CONFIG_BIN_TRACE, bintrace_mem_reset());
     Loge("After update_global, n_remain: %i, n_remain_total: %li", n_remain,
          n_remain_total);
   }
@@ -657,6 +802,7 @@ void cpu_exec(uint64_t n) {
       cpu.pc = raise_intr(g_ex_cause, prev_s->pc);
       cpu.amo = false; // clean up
       IFDEF(CONFIG_PERF_OPT, tcache_handle_exception(cpu.pc));
+      IFDEF(CONFIG_DIFFTEST_BATCH, if (commit_hook) commit_hook(prev_s, true));
       IFDEF(CONFIG_SHARE, break);
     } else {
       word_t intr = MUXDEF(CONFIG_SHARE, INTR_EMPTY, isa_query_intr());
@@ -705,6 +851,7 @@ void cpu_exec(uint64_t n) {
   uint64_t timer_end = get_time();
   g_timer += timer_end - timer_start;
 
+  extern void simpoint_profiling_finish();
   switch (nemu_state.state) {
   case NEMU_RUNNING:
     nemu_state.state = NEMU_STOP;
@@ -724,10 +871,12 @@ void cpu_exec(uint64_t n) {
         nemu_state.halt_pc);
     Log("trap code:%d", nemu_state.halt_ret);
     monitor_statistic();
+    if (nemu_state.state == NEMU_END) simpoint_profiling_finish();
     break;
   case NEMU_QUIT:
 #ifndef CONFIG_SHARE
     monitor_statistic();
+    simpoint_profiling_finish();
     extern char *mapped_cpt_file; // defined in paddr.c
     if (mapped_cpt_file != NULL) {
       extern void serialize_reg_to_mem();
@@ -153,12 +153,29 @@ int difftest_store_commit(uint64_t *saddr, uint64_t *sdata, uint8_t *smask) {
   return 0;
 #endif
 }
+
+int difftest_store_commit_batch(uint64_t *saddr, uint64_t *sdata, uint8_t *smask, int n) {
+#ifdef CONFIG_DIFFTEST_STORE_COMMIT
+  return check_store_commit_batch(saddr, sdata, smask, n);
+#else
+  return n;
+#endif
+}
 #endif
 
 void difftest_exec(uint64_t n) {
   cpu_exec(n);
 }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+// execute at most n instructions, and write a record of each of them to
+// ring[*tail % ring_size] with *tail increased, return the number of records written;
+// the batch stops early after an exception or at the end of the program
+uint64_t difftest_exec_batch(void *ring, uint64_t ring_size, uint64_t *tail, uint64_t n) {
+  return isa_difftest_exec_batch(ring, ring_size, tail, n);
+}
+#endif
+
 #ifdef CONFIG_REF_STATUS
 int difftest_status() {
   switch (nemu_state.state) {
@@ -15,6 +15,13 @@
 
 #include <cpu/decode.h>
 #include <cpu/cpu.h>
+#include <profiling/profiling_control.h>
+#include <profiling/bintrace.h>
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+#include <memory/paddr.h>
+#include <memory/host-tlb.h>
+#include <stdlib.h>
+#endif
 
 #ifdef CONFIG_PERF_OPT
 
@@ -24,12 +31,15 @@ typedef struct bb_t {
   Decode *s;
   struct bb_t *next;
   vaddr_t pc;
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, uint32_t epoch); // the flush epoch in which the basic block is linked
 } bb_t;
 
 enum { BB_RECORD_TYPE_NTAKEN = 1, BB_RECORD_TYPE_TAKEN };
 
-static Decode tcache_pool[CONFIG_TCACHE_SIZE] = {};
+// aligned to cache lines, so that a 128-byte Decode never straddles three of them
+static Decode tcache_pool[CONFIG_TCACHE_SIZE] __attribute__((aligned(64))) = {};
 static int tc_idx = 0;
+static int tc_end = CONFIG_TCACHE_SIZE;
 static Decode tcache_bb_pool[TCACHE_BB_SIZE] = {};
 static Decode *tcache_bb_freelist = NULL;
 static bb_t bb_pool[CONFIG_BB_POOL_SIZE] = {};
@@ -37,18 +47,54 @@ static int bb_idx = 0;
 static bb_t bb_list [CONFIG_BB_LIST_SIZE] = {};
 static const void *g_exec_nemu_decode;
 
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+#define TCACHE_GEN_SIZE (CONFIG_TCACHE_SIZE / CONFIG_TCACHE_NR_GEN)
+#define TCACHE_NR_DIRTY 64
+#define TCACHE_VPAGE_FILTER_SIZE 4096
+
+enum { TC_PAGE_CODE = 1, TC_PAGE_DIRTY = 2 };
+enum {
+  TC_META_1PAGE = 1, // the whole basic block is fetched from the page of its head
+  TC_META_CROSS = 2, // the instruction crosses a page boundary
+  TC_META_DEAD  = 4, // the instruction is fetched from a page written after decoding
+};
+
+typedef struct {
+  paddr_t pg;  // guest physical page the instruction is fetched from
+  paddr_t pg2; // guest physical page of the second half of an instruction crossing pages
+  uint8_t ctx; // decoding context, only valid at the head of a basic block
+  uint8_t flag;
+} tc_meta_t;
+
+uint8_t *tcache_page_map = NULL;
+size_t tcache_nr_page = 0;
+static tc_meta_t tc_meta[CONFIG_TCACHE_SIZE] = {};
+static paddr_t tc_dirty[TCACHE_NR_DIRTY] = {};
+static int tc_nr_dirty = 0;
+static uint32_t tcache_epoch = 0;
+static int tc_gen = 0;
+static uint64_t tc_vpage_filter[TCACHE_VPAGE_FILTER_SIZE / 64] = {};
+#endif
+
+#ifdef CONFIG_TCACHE_PHYS_INDEX
+#define TCACHE_PHYS_SIZE (CONFIG_TCACHE_SIZE / 4)
+static Decode *tc_phys[TCACHE_PHYS_SIZE] = {};
+#endif
+
 static inline Decode* tcache_entry_init(Decode *s, vaddr_t pc) {
   s->tnext = s->ntnext = NULL;
   s->type = 0;
+  IFDEF(CONFIG_TCACHE_TRACE, s->trace_flag = 0);
   s->pc = pc;
   s->EHelper = g_exec_nemu_decode;
   return s;
 }
 
 static inline Decode* tcache_new(vaddr_t pc) {
-  if (tc_idx == CONFIG_TCACHE_SIZE) return NULL;
-  assert(tc_idx < CONFIG_TCACHE_SIZE);
+  if (tc_idx == tc_end) return NULL;
+  assert(tc_idx < tc_end);
   Decode *s = &tcache_pool[tc_idx];
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, tc_meta[tc_idx].flag = 0);
   tc_idx ++;
   return tcache_entry_init(s, pc);
 }
@@ -104,29 +150,45 @@ static struct bb_t* bb_insert(vaddr_t pc, Decode *fill) {
       // first time
       head->s = fill;
       head->pc = pc;
+      IFDEF(CONFIG_TCACHE_INCR_FLUSH, head->epoch = tcache_epoch);
       return head;
     }
   }
   // second time
   bb_t *bb = bb_new(head->s, head->pc, head->next);
   if (bb == NULL) return NULL;
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, bb->epoch = head->epoch);
   head->s = fill;
   head->pc = pc;
   head->next = bb;
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, head->epoch = tcache_epoch);
   return head;
 }
 
+static inline bool bb_is_linked(bb_t *bb) {
+  return MUXDEF(CONFIG_TCACHE_INCR_FLUSH, bb->epoch == tcache_epoch, true);
+}
+
+static inline void bb_swap(bb_t *head, bb_t *bb) {
+  Decode *tmp_s = bb->s; vaddr_t tmp_pc = bb->pc;
+  bb->s = head->s; bb->pc = head->pc;
+  head->s = tmp_s; head->pc = tmp_pc;
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+  uint32_t tmp_epoch = bb->epoch;
+  bb->epoch = head->epoch;
+  head->epoch = tmp_epoch;
+#endif
+}
+
 static bb_t* bb_find(vaddr_t pc) {
   bb_t *bb = bb_hash(pc);
-  if (likely(bb->pc == pc)) return bb;
+  if (likely(bb->pc == pc && bb_is_linked(bb))) return bb;
   bb_t *head = bb;
   do {
     bb = bb->next;
     if (bb == (void *)-1ul) return NULL;
-    if (bb->pc == pc) {
-      Decode *tmp_s = bb->s; vaddr_t tmp_pc = bb->pc;
-      bb->s = head->s; bb->pc = head->pc;
-      head->s = tmp_s; head->pc = tmp_pc;
+    if (bb->pc == pc && bb_is_linked(bb)) {
+      bb_swap(head, bb);
       return head;
     }
   } while (1);
@@ -145,11 +207,256 @@ static void tcache_bb_fetch(Decode *_this, int is_taken, vaddr_t jpc) {
   }
 }
 
-void tcache_flush() {
-  tc_idx = 0;
-  bb_idx = 0;
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+static inline tc_meta_t* tcache_meta(Decode *s) {
+  return &tc_meta[s - tcache_pool];
+}
+
+static inline uint8_t tcache_ctx() {
+  return isa_mmu_state() IFDEF(CONFIG_RVH, | (cpu.v << 2));
+}
+
+static inline paddr_t tcache_fetch_page(vaddr_t pc) {
+  return vaddr_ifetch_paddr(pc) & ~PAGE_MASK;
+}
+
+static inline size_t tcache_page_idx(paddr_t pg) {
+  return (pg - CONFIG_MBASE) >> PAGE_SHIFT;
+}
+
+static inline bool tcache_page_is_dirty(paddr_t pg) {
+  size_t idx = tcache_page_idx(pg);
+  return idx < tcache_nr_page && (tcache_page_map[idx] & TC_PAGE_DIRTY);
+}
+
+static void tcache_page_add(paddr_t pg) {
+  size_t idx = tcache_page_idx(pg);
+  if (idx >= tcache_nr_page || tcache_page_map[idx] != 0) return;
+  tcache_page_map[idx] = TC_PAGE_CODE;
+  hosttlb_flush_wpage(pg); // later stores to this page should take the slowpath to be tracked
+}
+
+void tcache_page_write(paddr_t addr, size_t len) {
+  paddr_t pg;
+  for (pg = addr & ~PAGE_MASK; pg < addr + len; pg += PAGE_SIZE) {
+    size_t idx = tcache_page_idx(pg);
+    if (idx >= tcache_nr_page || tcache_page_map[idx] != TC_PAGE_CODE) continue;
+    tcache_page_map[idx] |= TC_PAGE_DIRTY;
+    if (tc_nr_dirty < TCACHE_NR_DIRTY) tc_dirty[tc_nr_dirty] = pg;
+    tc_nr_dirty ++;
+  }
+}
+
+static inline int tcache_vpage_idx(vaddr_t vaddr) {
+  return (vaddr >> PAGE_SHIFT) % TCACHE_VPAGE_FILTER_SIZE;
+}
+
+static inline void tcache_vpage_add(vaddr_t vaddr) {
+  int idx = tcache_vpage_idx(vaddr);
+  tc_vpage_filter[idx / 64] |= 1ull << (idx % 64);
+}
+
+// whether some basic block linked since the last flush may be fetched from this virtual page
+bool tcache_has_vpage(vaddr_t vaddr) {
+  int idx = tcache_vpage_idx(vaddr);
+  return (tc_vpage_filter[idx / 64] >> (idx % 64)) & 1;
+}
+
+// record the page where the newly decoded instruction is fetched from
+static void tcache_meta_fill(Decode *s, bool is_head) {
+  static vaddr_t vpn = 0;
+  static paddr_t pg = 0;
+  tc_meta_t *m = tcache_meta(s);
+  if (is_head || (s->pc >> PAGE_SHIFT) != vpn) {
+    vpn = s->pc >> PAGE_SHIFT;
+    pg = tcache_fetch_page(s->pc);
+  }
+  m->pg = pg;
+  m->flag = 0;
+  if (is_head) m->ctx = tcache_ctx();
+  tcache_page_add(pg);
+  tcache_vpage_add(s->pc);
+  if (((s->snpc - 1) >> PAGE_SHIFT) != vpn) {
+    m->pg2 = tcache_fetch_page(s->pc + 2);
+    m->flag = TC_META_CROSS;
+    tcache_page_add(m->pg2);
+    tcache_vpage_add(s->pc + 2);
+  }
+}
+
+// check whether the basic block or superblock [s, end) is fetched from a single page
+static void tcache_meta_head(Decode *s, Decode *end) {
+  tc_meta_t *m = tcache_meta(s);
+  Decode *t;
+  m->flag |= TC_META_1PAGE;
+  for (t = s; t < end; t ++) {
+    if ((t->pc >> PAGE_SHIFT) != (s->pc >> PAGE_SHIFT) || (tcache_meta(t)->flag & TC_META_CROSS)) {
+      m->flag &= ~TC_META_1PAGE;
+      break;
+    }
+  }
+}
+
+#ifdef CONFIG_TCACHE_TRACE
+#define tcache_is_stitched(s, link) ((s)->trace_flag & (link))
+#else
+#define tcache_is_stitched(s, link) 0
+#endif
+
+static inline bool tcache_is_bb_end(Decode *s) {
+  return s->type != INSTR_TYPE_N && !tcache_is_stitched(s, TRACE_LINK_TAKEN | TRACE_LINK_NTAKEN);
+}
+
+static bool tcache_is_dead(Decode *s) {
+  for (; ; s ++) {
+    if (tcache_meta(s)->flag & TC_META_DEAD) return true;
+    if (tcache_is_bb_end(s)) return false;
+  }
+}
+
+// the links of a basic block decoded before the last flush may point to
+// basic blocks which are no longer valid, so resolve them again
+static void tcache_relink(Decode *s) {
+  for (; ; s ++) {
+    switch (s->type) {
+      case INSTR_TYPE_J:
+        if (!tcache_is_stitched(s, TRACE_LINK_TAKEN)) tcache_bb_fetch(s, true, s->jnpc);
+        break;
+      case INSTR_TYPE_B:
+        if (!tcache_is_stitched(s, TRACE_LINK_TAKEN)) tcache_bb_fetch(s, true, s->jnpc);
+        if (!tcache_is_stitched(s, TRACE_LINK_NTAKEN)) {
+          tcache_bb_fetch(s, false, s->snpc + MUXDEF(__ISA_mips32__, 4, 0));
+        }
+        break;
+      case INSTR_TYPE_I: s->tnext = s->ntnext = s; break;
+      default: continue;
+    }
+    if (tcache_is_bb_end(s)) return;
+  }
+}
+
+#ifdef CONFIG_TCACHE_PHYS_INDEX
+static inline Decode** tcache_phys_slot(paddr_t paddr, uint8_t ctx) {
+  return &tc_phys[((paddr / CONFIG_ILEN_MIN) ^ ctx) % TCACHE_PHYS_SIZE];
+}
+
+// index the basic block or superblock `s` by the physical address of its head
+static void tcache_phys_add(Decode *s) {
+  tc_meta_t *m = tcache_meta(s);
+  if (m->flag & TC_META_1PAGE) *tcache_phys_slot(m->pg | (s->pc & PAGE_MASK), m->ctx) = s;
+}
+
+// Look for a basic block fetched from `paddr` in the same context, which may
+// be decoded at another virtual address, e.g. the same library mapped by
+// another process. Copy it to `pc` with its pc-relative operands moved.
+static Decode* bb_share(vaddr_t pc, paddr_t paddr, uint8_t ctx) {
+  Decode *src = *tcache_phys_slot(paddr, ctx);
+  if (src == NULL) return NULL;
+  int idx = src - tcache_pool;
+  if (idx >= tc_idx && idx < tc_end) return NULL; // evicted
+  tc_meta_t *m = tcache_meta(src);
+  if (!(m->flag & TC_META_1PAGE) || m->ctx != ctx) return NULL;
+  if ((m->pg | (src->pc & PAGE_MASK)) != paddr || tcache_is_dead(src)) return NULL;
+
+  int start = tc_idx;
+  sword_t delta = pc - src->pc;
+  Decode *p, *t;
+  for (p = src; ; p ++) {
+    t = tcache_new(p->pc + delta);
+    if (t == NULL) { tc_idx = start; return NULL; }
+    *t = *p;
+    *tcache_meta(t) = *tcache_meta(p);
+    t->pc += delta;
+    t->snpc += delta;
+    t->jnpc += delta;
+    isa_decode_relocate(t, delta);
+    if (tcache_is_stitched(t, TRACE_LINK_TAKEN)) t->tnext = t + 1;
+    if (tcache_is_stitched(t, TRACE_LINK_NTAKEN)) t->ntnext = t + 1;
+    IFDEF(CONFIG_TCACHE_TRACE, t->edge_cnt[0] = t->edge_cnt[1] = 0);
+    if (tcache_is_bb_end(t)) break;
+  }
+
+  Decode *s = &tcache_pool[start];
+  if (bb_insert(pc, s) == NULL) { tc_idx = start; return NULL; }
+  tcache_relink(s);
+  tcache_vpage_add(pc);
+  Logtb("Share basic block at pc = " FMT_WORD " with pc = " FMT_WORD, src->pc, pc);
+  return s;
+}
+#endif
+
+// Look for a basic block decoded before the last flush, which is fetched
+// from the same physical page in the same context, and link it again
+// instead of decoding it. Note that fetching the page may raise the same
+// exception as decoding the instruction.
+static Decode* bb_adopt(vaddr_t pc) {
+  bb_t *head = bb_hash(pc), *bb;
+  paddr_t pg = (paddr_t)-1;
+  uint8_t ctx = tcache_ctx();
+  for (bb = head; bb != (void *)-1ul; bb = bb->next) {
+    if (bb->pc != pc) continue;
+    tc_meta_t *m = tcache_meta(bb->s);
+    if (!(m->flag & TC_META_1PAGE) || m->ctx != ctx) continue;
+    if (pg == (paddr_t)-1) pg = tcache_fetch_page(pc);
+    if (m->pg != pg || tcache_is_dead(bb->s)) continue;
+    bb->epoch = tcache_epoch;
+    if (bb != head) bb_swap(head, bb);
+    Decode *s = head->s;
+    tcache_relink(s); // note that this may reorder the chain
+    tcache_vpage_add(pc);
+    return s;
+  }
+#ifdef CONFIG_TCACHE_PHYS_INDEX
+  if (pg == (paddr_t)-1) pg = tcache_fetch_page(pc);
+  return bb_share(pc, pg | (pc & PAGE_MASK), ctx);
+#else
+  return NULL;
+#endif
+}
+
+// drop the basic blocks in [lo, hi) or fetched from written pages from the basic block list
+static void bb_rebuild(Decode *lo, Decode *hi) {
+  static bb_t live[CONFIG_BB_LIST_SIZE + CONFIG_BB_POOL_SIZE];
+  int i, n = 0;
+  for (i = 0; i < CONFIG_BB_LIST_SIZE; i ++) {
+    bb_t *bb = &bb_list[i];
+    if (bb->pc == (vaddr_t)-1ul) continue;
+    for (; bb != (void *)-1ul; bb = bb->next) {
+      if ((bb->s >= lo && bb->s < hi) || tcache_is_dead(bb->s)) continue;
+      live[n ++] = *bb;
+    }
+  }
   memset(bb_list, -1, sizeof(bb_list));
+  bb_idx = 0;
+  for (i = n - 1; i >= 0; i --) { // keep the order in each chain
+    bb_t *bb = bb_insert(live[i].pc, live[i].s);
+    assert(bb != NULL);
+    bb->epoch = live[i].epoch;
+  }
+}
+
+static void tcache_drop_dirty() {
+  int i;
+  for (i = 0; i < CONFIG_TCACHE_SIZE; i ++) {
+    tc_meta_t *m = &tc_meta[i];
+    if (tcache_page_is_dirty(m->pg) || ((m->flag & TC_META_CROSS) && tcache_page_is_dirty(m->pg2))) {
+      m->flag |= TC_META_DEAD;
+    }
+  }
+  for (i = 0; i < tc_nr_dirty; i ++) {
+    tcache_page_map[tcache_page_idx(tc_dirty[i])] = 0;
+  }
+  Logtb("Drop instructions on %d written pages from tcache", tc_nr_dirty);
+  tc_nr_dirty = 0;
+  bb_rebuild(NULL, NULL);
+}
 
+static inline int tcache_gen_end(int gen) {
+  return gen == CONFIG_TCACHE_NR_GEN - 1 ? CONFIG_TCACHE_SIZE : (gen + 1) * TCACHE_GEN_SIZE;
+}
+#endif
+
+static void tcache_bb_freelist_init() {
   int i;
   for (i = 0; i < TCACHE_BB_SIZE - 1; i ++) {
     tcache_bb_pool[i].list_next = &tcache_bb_pool[i + 1];
@@ -158,6 +465,51 @@ void tcache_flush() {
   tcache_bb_freelist = &tcache_bb_pool[0];
 }
 
+void tcache_flush() {
+  tc_idx = 0;
+  bb_idx = 0;
+  memset(bb_list, -1, sizeof(bb_list));
+  tcache_bb_freelist_init();
+
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+  tc_gen = 0;
+  tc_end = tcache_gen_end(0);
+  tcache_epoch = 0;
+  tc_nr_dirty = 0;
+  memset(tcache_page_map, 0, tcache_nr_page);
+  memset(tc_vpage_filter, 0, sizeof(tc_vpage_filter));
+#endif
+  IFDEF(CONFIG_TCACHE_PHYS_INDEX, memset(tc_phys, 0, sizeof(tc_phys)));
+}
+
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+// unlink all basic blocks, which are linked again on their next execution
+static void tcache_new_epoch() {
+  tcache_epoch ++;
+  tcache_bb_freelist_init();
+  memset(tc_vpage_filter, 0, sizeof(tc_vpage_filter));
+}
+
+static void tcache_invalidate() {
+  if (tc_nr_dirty > TCACHE_NR_DIRTY || tcache_epoch == UINT32_MAX) {
+    tcache_flush();
+    return;
+  }
+  if (tc_nr_dirty > 0) tcache_drop_dirty();
+  tcache_new_epoch();
+}
+
+// evict the oldest generation to make room for new basic blocks
+static void tcache_evict() {
+  tc_gen = (tc_gen + 1) % CONFIG_TCACHE_NR_GEN;
+  tc_idx = tc_gen * TCACHE_GEN_SIZE;
+  tc_end = tcache_gen_end(tc_gen);
+  bb_rebuild(&tcache_pool[tc_idx], &tcache_pool[tc_end]);
+  tcache_new_epoch();
+  Logtb("Evict generation %d of tcache", tc_gen);
+}
+#endif
+
 enum { TCACHE_BB_BUILDING, TCACHE_RUNNING };
 static int tcache_state = TCACHE_RUNNING;
 static Decode *bb_now = NULL, *bb_now_record = NULL;
@@ -188,6 +540,15 @@ Decode* tcache_decode(Decode *s) {
       tcache_patch_and_free(s, bb->s);
       return bb->s;
     }
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+    s->idx_in_bb = 1;
+    save_globals(s);
+    Decode *adopted = bb_adopt(thispc);
+    if (adopted != NULL) { // decoded before the last flush
+      tcache_patch_and_free(s, adopted);
+      return adopted;
+    }
+#endif
 
     Decode *old = s;
     s = tcache_new(thispc);
@@ -202,6 +563,7 @@ Decode* tcache_decode(Decode *s) {
   save_globals(s);
   s->idx_in_bb = idx_in_bb;
   fetch_decode(s, thispc); // note that exception may happen!
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_meta_fill(s, s == bb_now));
 
   if (s->type == INSTR_TYPE_N) {
     Decode *next = tcache_new(s->snpc);
@@ -211,6 +573,8 @@ Decode* tcache_decode(Decode *s) {
     // the end of the basic block
     bb_t *ret = bb_insert(bb_now->pc, bb_now);
     if (ret == NULL) { goto full; } // basic block list is full
+    IFDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_meta_head(bb_now, s + 1));
+    IFDEF(CONFIG_TCACHE_PHYS_INDEX, tcache_phys_add(bb_now));
     tcache_patch_and_free(bb_now_record, bb_now);
     bb_now = bb_now_record = NULL;
 
@@ -223,6 +587,7 @@ Decode* tcache_decode(Decode *s) {
       case INSTR_TYPE_I: s->tnext = s->ntnext = s; break; // update dynamically
       default: assert(0);
     }
+    IFDEF(CONFIG_TCACHE_TRACE, s->edge_cnt[0] = s->edge_cnt[1] = 0);
     tcache_state = TCACHE_RUNNING;
   }
 
@@ -230,7 +595,7 @@ Decode* tcache_decode(Decode *s) {
   return s;
 
 full:
-  tcache_flush();
+  MUXDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_evict, tcache_flush)();
   s = tcache_bb_new(thispc); // decode this instruction again
   s->idx_in_bb = idx_in_bb;
   save_globals(s);
@@ -239,6 +604,107 @@ full:
   longjmp_exec(NEMU_EXEC_AGAIN);
 }
 
+#ifdef CONFIG_TCACHE_TRACE
+static inline bool tcache_is_decoded(Decode *s) {
+  return s->EHelper != g_exec_nemu_decode;
+}
+
+static bool tcache_bb_avail(int n) {
+  Decode *s = tcache_bb_freelist;
+  for (; n > 0 && s != NULL; n --) { s = s->list_next; }
+  return n == 0;
+}
+
+// the successor to stitch after the control instruction `s`, or NULL to end the superblock here
+static Decode* trace_next_bb(Decode *s, int len, int *link) {
+  if (len >= CONFIG_TCACHE_TRACE_MAX_LEN) return NULL;
+  Decode *next;
+  switch (s->type) {
+    case INSTR_TYPE_J: next = s->tnext; *link = TRACE_LINK_TAKEN; break;
+    case INSTR_TYPE_B:
+      if (s->edge_cnt[0] == 0 && s->edge_cnt[1] == 0) return NULL;
+      if (s->edge_cnt[0] >= s->edge_cnt[1]) { next = s->tnext; *link = TRACE_LINK_TAKEN; }
+      else { next = s->ntnext; *link = TRACE_LINK_NTAKEN; }
+      break;
+    default: return NULL;
+  }
+  // only stitch forward edges to decoded basic blocks, which keeps superblocks acyclic
+  if (!tcache_is_decoded(next) || (next->trace_flag & TRACE_HEAD) || next->pc <= s->pc) return NULL;
+  return next;
+}
+
+// Copy the basic blocks along the most frequently executed path from the
+// target of the hot backward edge `src` into a contiguous superblock.
+// Stitched control instructions are marked in `trace_flag` and fall through
+// to the next entry, while the other directions become side exits.
+__attribute__((noinline))
+Decode* tcache_trace_form(Decode *src) {
+  Decode *head = src->tnext;
+  if (profiling_state != NoProfiling || checkpoint_state != NoCheckpoint) return head;
+  // stitched edges skip per_bb_profile()
+  if (MUXDEF(CONFIG_BIN_TRACE, bintrace_kind == BINTRACE_BB, false)) return head;
+  if (head->pc > src->pc || !tcache_is_decoded(head) || (head->trace_flag & TRACE_HEAD)) return head;
+
+  int start = tc_idx;
+  int len = 0, nr_exit = 0;
+  Decode *p = head;
+  while (true) {
+    Decode *t = tcache_new(p->pc);
+    if (t == NULL) { tc_idx = start; return head; }
+    *t = *p;
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+    *tcache_meta(t) = *tcache_meta(p);
+    tcache_meta(t)->flag &= ~TC_META_1PAGE; // only valid at the head of the superblock
+#endif
+    t->idx_in_bb = ++ len;
+    t->trace_flag = 0;
+    if (p->type == INSTR_TYPE_N) { p ++; continue; }
+
+    int link = 0;
+    Decode *next = trace_next_bb(p, len, &link);
+    nr_exit += (p->type == INSTR_TYPE_B) + (next == NULL && p->type != INSTR_TYPE_I);
+    if (next == NULL) break;
+    t->trace_flag = link;
+    p = next;
+  }
+
+  // every side exit may need a basic block record to decode its target
+  if (!tcache_bb_avail(nr_exit)) { tc_idx = start; return head; }
+
+  Decode *trace = &tcache_pool[start];
+  trace->trace_flag |= TRACE_HEAD;
+  bb_t *bb = bb_find(head->pc);
+  if (bb != NULL) { bb->s = trace; }
+
+  Decode *t;
+  for (t = trace; t < &tcache_pool[tc_idx]; t ++) {
+    vaddr_t tpc = t->tnext != NULL ? t->tnext->pc : 0;
+    vaddr_t ntpc = t->ntnext != NULL ? t->ntnext->pc : 0;
+    switch (t->type) {
+      case INSTR_TYPE_J:
+        if (t->trace_flag & TRACE_LINK_TAKEN) { t->tnext = t + 1; }
+        else { tcache_bb_fetch(t, true, tpc); }
+        break;
+      case INSTR_TYPE_B:
+        if (t->trace_flag & TRACE_LINK_TAKEN) { t->tnext = t + 1; }
+        else { tcache_bb_fetch(t, true, tpc); }
+        if (t->trace_flag & TRACE_LINK_NTAKEN) { t->ntnext = t + 1; }
+        else { tcache_bb_fetch(t, false, ntpc); }
+        break;
+      case INSTR_TYPE_I: t->tnext = t->ntnext = t; break;
+      default: continue;
+    }
+    t->edge_cnt[0] = t->edge_cnt[1] = 0;
+  }
+
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_meta_head(trace, &tcache_pool[tc_idx]));
+  IFDEF(CONFIG_TCACHE_PHYS_INDEX, tcache_phys_add(trace));
+  Logtb("Form superblock at pc = " FMT_WORD " with %d instructions", head->pc, len);
+  src->tnext = trace;
+  return trace;
+}
+#endif
+
 static Decode ex = {};
 
 void tcache_handle_exception(vaddr_t jpc) {
@@ -248,12 +714,25 @@ void tcache_handle_exception(vaddr_t jpc) {
 }
 
 Decode* tcache_handle_flush(vaddr_t snpc) {
-  tcache_flush();
+  MUXDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_invalidate, tcache_flush)();
   tcache_handle_exception(snpc);
   return ex.tnext;
 }
 
 Decode* tcache_init(const void *exec_nemu_decode, vaddr_t reset_vector) {
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+  tcache_nr_page = MEMORY_SIZE >> PAGE_SHIFT;
+  tcache_page_map = calloc(tcache_nr_page, 1);
+  assert(tcache_page_map != NULL);
+#endif
+  size_t entry_size = sizeof(Decode) + MUXDEF(CONFIG_TCACHE_INCR_FLUSH, sizeof(tc_meta_t), 0);
+  Log("tcache layout: %zu bytes per cached instruction (Decode %zu%s), "
+      "%d + %d entries, %zu KiB in total",
+      entry_size, sizeof(Decode),
+      MUXDEF(CONFIG_TCACHE_INCR_FLUSH, " + metadata", ""),
+      CONFIG_TCACHE_SIZE, TCACHE_BB_SIZE,
+      (entry_size * CONFIG_TCACHE_SIZE + sizeof(Decode) * TCACHE_BB_SIZE +
+       sizeof(bb_pool) + sizeof(bb_list)) >> 10);
   tcache_flush();
   g_exec_nemu_decode = exec_nemu_decode;
   return tcache_bb_new(reset_vector);
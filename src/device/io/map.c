@@ -16,6 +16,7 @@
 
 #include <isa.h>
 #include <memory/host.h>
+#include <memory/paddr.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
 
@@ -30,6 +31,8 @@ uint8_t* new_space(int size) {
   size = (size + (PAGE_SIZE - 1)) & ~PAGE_MASK;
   p_space += size;
   assert(p_space - io_space < IO_SPACE_MAX);
+  // the registers of all the devices
+  snapshot_add_state("io", io_space, p_space - io_space, NULL);
   return p;
 }
 
@@ -46,6 +49,7 @@ static inline void invoke_callback(io_callback_t c, paddr_t offset, int len, boo
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
+  map->nr_read ++;
   paddr_t offset = addr - map->low;
   invoke_callback(map->callback, offset, len, false); // prepare data to read
   return host_read(map->space + offset, len);
@@ -54,6 +58,7 @@ word_t map_read(paddr_t addr, int len, IOMap *map) {
 void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
+  map->nr_write ++;
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
   invoke_callback(map->callback, offset, len, true);
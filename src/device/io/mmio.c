@@ -17,31 +17,63 @@
 
 #define NR_MAP 16
 
+// sorted by the lowest address, so the map of an address is found by binary search
 static IOMap maps[NR_MAP] = {};
 static int nr_map = 0;
+static IOMap *last_map = NULL;
 
 static inline IOMap* fetch_mmio_map(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  // most devices are accessed several times in a row, e.g. polling loops
+  if (likely(last_map != NULL && map_inside(last_map, addr))) {
+    difftest_skip_ref();
+    return last_map;
+  }
+  int l = 0, r = nr_map - 1;
+  while (l <= r) {
+    int mid = (l + r) / 2;
+    if (addr < maps[mid].low) r = mid - 1;
+    else if (addr > maps[mid].high) l = mid + 1;
+    else {
+      difftest_skip_ref();
+      last_map = &maps[mid];
+      return last_map;
+    }
+  }
+  return NULL;
 }
 
 bool is_in_mmio(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? false : true);
+  return fetch_mmio_map(addr) != NULL;
 }
 
 /* device interface */
 void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_callback_t callback) {
   assert(nr_map < NR_MAP);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
+  IOMap map = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
+  int i;
+  for (i = nr_map; i > 0 && maps[i - 1].low > map.low; i --) {
+    maps[i] = maps[i - 1];
+  }
+  Assert((i == 0 || maps[i - 1].high < map.low) && (i == nr_map || map.high < maps[i + 1].low),
+      "mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "] overlaps with another map",
+      map.name, map.low, map.high);
+  maps[i] = map;
+  last_map = NULL;
   // Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
-  //     maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  //     maps[i].name, maps[i].low, maps[i].high);
   // fflush(stdout);
 
   nr_map ++;
 }
 
+void mmio_statistic() {
+  for (int i = 0; i < nr_map; i ++) {
+    if (maps[i].nr_read + maps[i].nr_write == 0) continue;
+    Log("mmio map '%s': read = %'ld, write = %'ld", maps[i].name, maps[i].nr_read, maps[i].nr_write);
+  }
+}
+
 /* bus interface */
 __attribute__((noinline))
 word_t mmio_read(paddr_t addr, int len) {
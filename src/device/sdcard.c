@@ -15,6 +15,7 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <memory/paddr.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -123,6 +124,11 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
   }
 }
 
+// the image is read and written at the position of the data register
+static void sdcard_snapshot_loaded() {
+  if (fp && !read_ext_csd) fseek(fp, (blk_addr << 9) + addr, SEEK_SET);
+}
+
 void init_sdcard() {
   base = (uint32_t *)new_space(0x80);
   add_mmio_map("sdhci", CONFIG_SDCARD_CTL_MMIO, base, 0x80, sdcard_io_handler);
@@ -138,4 +144,10 @@ void init_sdcard() {
   } else {
       Log("Using sdcard image: %s", img);
   }
+
+  snapshot_add_state("sdcard.blkcnt", &blkcnt, sizeof(blkcnt), NULL);
+  snapshot_add_state("sdcard.blk_addr", &blk_addr, sizeof(blk_addr), NULL);
+  snapshot_add_state("sdcard.addr", &addr, sizeof(addr), NULL);
+  snapshot_add_state("sdcard.write_cmd", &write_cmd, sizeof(write_cmd), NULL);
+  snapshot_add_state("sdcard.read_ext_csd", &read_ext_csd, sizeof(read_ext_csd), sdcard_snapshot_loaded);
 }
@@ -16,6 +16,7 @@
 
 #include <utils.h>
 #include <device/map.h>
+#include <memory/paddr.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 // NOTE: this is compatible to 16550
@@ -141,5 +142,8 @@ void init_serial() {
 #ifdef CONFIG_SERIAL_INPUT_FIFO
   init_fifo();
   preset_input();
+  snapshot_add_state("serial.queue", queue, sizeof(queue), NULL);
+  snapshot_add_state("serial.f", &f, sizeof(f), NULL);
+  snapshot_add_state("serial.r", &r, sizeof(r), NULL);
 #endif
 }
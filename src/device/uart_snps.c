@@ -1,5 +1,6 @@
 #include <utils.h>
 #include <device/map.h>
+#include <memory/paddr.h>
 
 // #define CH_OFFSET 0
 // #define UARTLITE_RX_FIFO  0x0
@@ -177,5 +178,8 @@ void init_uart_snps() {
 #ifdef CONFIG_UART_SNPS_INPUT_FIFO
   init_fifo();
   preset_input();
+  snapshot_add_state("uart_snps.queue", queue, sizeof(queue), NULL);
+  snapshot_add_state("uart_snps.f", &f, sizeof(f), NULL);
+  snapshot_add_state("uart_snps.r", &r, sizeof(r), NULL);
 #endif
 }
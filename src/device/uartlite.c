@@ -15,6 +15,7 @@
 
 #include <utils.h>
 #include <device/map.h>
+#include <memory/paddr.h>
 
 #define CH_OFFSET 0
 #define UARTLITE_RX_FIFO  0x0
@@ -147,5 +148,8 @@ void init_uartlite() {
 #ifdef CONFIG_UARTLITE_INPUT_FIFO
   init_fifo();
   preset_input();
+  snapshot_add_state("uartlite.queue", queue, sizeof(queue), NULL);
+  snapshot_add_state("uartlite.f", &f, sizeof(f), NULL);
+  snapshot_add_state("uartlite.r", &r, sizeof(r), NULL);
 #endif
 }
@@ -16,6 +16,7 @@
 #include <utils.h>
 #include <device/alarm.h>
 #include <device/map.h>
+#include <memory/paddr.h>
 #include "local-include/csr.h"
 
 #define CLINT_MTIMECMP (0x4000 / sizeof(clint_base[0]))
@@ -25,6 +26,8 @@
 
 static uint64_t *clint_base = NULL;
 static uint64_t boot_time = 0;
+// mtime continues from the value of a loaded snapshot instead of the host time
+static int64_t mtime_offset = 0;
 uint64_t clint_snapshot, spec_clint_snapshot;
 
 extern uint64_t g_nr_guest_instr;
@@ -50,7 +53,7 @@ void update_clint() {
   clint_base[CLINT_MTIME] += TIMEBASE / 10000;
 #else
   uint64_t uptime = get_time();
-  clint_base[CLINT_MTIME] = uptime / US_PERCYCLE;
+  clint_base[CLINT_MTIME] = uptime / US_PERCYCLE + mtime_offset;
 #endif
   mip->mtip = (clint_base[CLINT_MTIME] >= clint_base[CLINT_MTIMECMP]);
 }
@@ -60,6 +63,18 @@ uint64_t clint_uptime() {
   return clint_base[CLINT_MTIME];
 }
 
+// mtime and mtimecmp recorded in a checkpoint, which are read without going
+// through the MMIO handler, so that taking a checkpoint does not advance mtime
+// in DETERMINISTIC builds
+uint64_t clint_cpt_mtime() {
+  IFNDEF(CONFIG_DETERMINISTIC, update_clint());
+  return clint_base[CLINT_MTIME];
+}
+
+uint64_t clint_cpt_mtimecmp() {
+  return clint_base[CLINT_MTIMECMP];
+}
+
 static void clint_io_handler(uint32_t offset, int len, bool is_write) {
 #ifdef CONFIG_LIGHTQS_DEBUG
   printf("clint op write %d addr %x\n", is_write, offset);
@@ -67,10 +82,19 @@ static void clint_io_handler(uint32_t offset, int len, bool is_write) {
   update_clint();
 }
 
+#ifdef CONFIG_MODE_SYSTEM
+static void clint_snapshot_loaded() {
+  IFNDEF(CONFIG_DETERMINISTIC, mtime_offset = clint_base[CLINT_MTIME] - get_time() / US_PERCYCLE);
+  update_clint();
+}
+#endif
+
 void init_clint() {
   clint_base = (uint64_t *)new_space(0x10000);
   add_mmio_map("clint", CONFIG_CLINT_MMIO, (uint8_t *)clint_base, 0x10000, clint_io_handler);
   IFNDEF(CONFIG_DETERMINISTIC, add_alarm_handle(update_clint));
   boot_time = get_time();
+  IFDEF(CONFIG_MODE_SYSTEM, snapshot_add_state("clint.mtime", &clint_base[CLINT_MTIME],
+      sizeof(clint_base[0]), clint_snapshot_loaded));
 }
 
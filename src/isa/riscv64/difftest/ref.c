@@ -22,6 +22,9 @@
 #include "../local-include/csr.h"
 #include <generated/autoconf.h>
 #include <stdlib.h>
+#include <cpu/decode.h>
+#include <memory/store_queue_wrapper.h>
+#include <memory/host-tlb.h>
 
 void ramcmp() {
   printf("ram cmp called\n");
@@ -200,6 +203,8 @@ void isa_difftest_regcpy(void *dut, bool direction) {
     // need to clear the cached mmu states as well
     extern void update_mmu_state();
     update_mmu_state();
+    IFDEF(CONFIG_RVH, hosttlb_set_vmid(hgatp->vmid));
+    set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
   } else {
     csr_prepare();
     memcpy(dut, &cpu, DIFFTEST_REG_SIZE);
@@ -224,6 +229,9 @@ void isa_difftest_regcpy(void *dut, bool direction) {
 void isa_difftest_csrcpy(void *dut, bool direction) {
   if (direction == DIFFTEST_TO_REF) {
     memcpy(csr_array, dut, 4096 * sizeof(rtlreg_t));
+    IFDEF(CONFIG_RVH, hosttlb_set_vmid(hgatp->vmid));
+    set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
+    IFDEF(CONFIG_RV_PMP_CACHE, pmp_cache_flush());
   } else {
     memcpy(dut, csr_array, 4096 * sizeof(rtlreg_t));
   }
@@ -374,6 +382,122 @@ void isa_difftest_query_ref(void *result_buffer, uint64_t type) {
 }
 #endif
 
+#ifdef CONFIG_DIFFTEST_BATCH
+static struct CommitRecord *batch_ring;
+static uint64_t batch_ring_size, *batch_tail, batch_nr_record;
+IFDEF(CONFIG_DIFFTEST_STORE_COMMIT, static size_t batch_nr_store);
+
+// find the register written by an instruction from its encoding,
+// return -1 if it writes no integer or floating-point register
+static int commit_rd(uint32_t instr, bool *fp) {
+  int rd = BITS(instr, 11, 7);
+  *fp = false;
+  if (BITS(instr, 1, 0) != 0x3) {
+    int funct3 = BITS(instr, 15, 13);
+    switch (BITS(instr, 1, 0)) {
+      case 0x0: // c.addi4spn, c.fld, c.lw and c.ld write rd'
+        if (funct3 > 0x3) return -1;
+        *fp = (funct3 == 0x1);
+        return 8 + BITS(instr, 4, 2);
+      case 0x1:
+        if (funct3 == 0x4) return 8 + BITS(instr, 9, 7); // c.srli to c.addw
+        return funct3 <= 0x3 ? rd : -1; // c.j and compressed branches write nothing
+      default:
+        if (funct3 <= 0x3) { *fp = (funct3 == 0x1); return rd; } // c.slli and loads from sp
+        if (funct3 > 0x4) return -1;
+        if (BITS(instr, 6, 2) != 0) return rd; // c.mv and c.add
+        return (BITS(instr, 12, 12) && rd != 0) ? 1 : -1; // c.jalr links x1, c.jr and c.ebreak
+    }
+  }
+
+  switch (BITS(instr, 6, 2)) {
+    case 0x00: case 0x04: case 0x05: case 0x06: case 0x0b: case 0x0c:
+    case 0x0d: case 0x0e: case 0x19: case 0x1b: case 0x1c:
+      return rd;
+    case 0x01: // vector loads share the opcode of floating-point loads
+      *fp = true;
+      return BITS(instr, 14, 12) >= 0x1 && BITS(instr, 14, 12) <= 0x4 ? rd : -1;
+    case 0x10: case 0x11: case 0x12: case 0x13:
+      *fp = true;
+      return rd;
+    case 0x14: // comparisons, classifications, moves and conversions to integers
+      switch (BITS(instr, 31, 27)) {
+        case 0x14: case 0x18: case 0x1c: return rd;
+      }
+      *fp = true;
+      return rd;
+#ifdef CONFIG_RVV
+    case 0x15:
+      switch (BITS(instr, 14, 12)) {
+        case 0x7: return rd; // vsetvl and vsetvli
+        case 0x2: return BITS(instr, 31, 26) == 0x10 ? rd : -1; // vmv.x.s, vcpop.m and vfirst.m
+        case 0x1: *fp = true; return BITS(instr, 31, 26) == 0x10 ? rd : -1; // vfmv.f.s
+      }
+      return -1;
+#endif // CONFIG_RVV
+  }
+  return -1;
+}
+
+static void batch_commit(Decode *s, bool trap) {
+  struct CommitRecord r = { .pc = s->pc };
+  if (trap) {
+    // the cause is in the CSR of the mode trapped to
+    r.flags = COMMIT_TRAP;
+    r.cause = cpu.mode == MODE_M ? mcause->val : scause->val;
+#ifdef CONFIG_RVH
+    if (cpu.mode != MODE_M && cpu.v) r.cause = vscause->val;
+#endif
+  } else {
+    bool fp;
+    r.instr = s->isa.instr.val;
+    int rd = commit_rd(r.instr, &fp);
+    if (fp) {
+#ifndef CONFIG_FPU_NONE
+      if (rd >= 0) { r.flags = COMMIT_FRD; r.rd = rd; r.rd_val = cpu.fpr[rd]._64; }
+#endif
+    } else if (rd > 0) {
+      r.flags = COMMIT_RD; r.rd = rd; r.rd_val = cpu.gpr[rd]._64;
+    }
+  }
+#ifdef CONFIG_DIFFTEST_STORE_COMMIT
+  // a single store is moved to the record if nothing is waiting in the queue
+  size_t nr_new_store = store_queue_size() - batch_nr_store;
+  if (batch_nr_store == 0 && nr_new_store == 1) {
+    store_commit_t st = store_queue_fornt();
+    store_queue_pop();
+    r.flags |= COMMIT_STORE;
+    r.saddr = st.addr;
+    r.sdata = st.data;
+    r.smask = st.mask;
+  } else if (nr_new_store > 0) {
+    r.flags |= COMMIT_STORE_QUEUED;
+  }
+  batch_nr_store = store_queue_size();
+#endif
+  if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) r.flags |= COMMIT_END;
+
+  batch_ring[*batch_tail % batch_ring_size] = r;
+  (*batch_tail) ++;
+  batch_nr_record ++;
+}
+
+uint64_t isa_difftest_exec_batch(void *ring, uint64_t ring_size, uint64_t *tail, uint64_t n) {
+  if (n == 0 || nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT) return 0;
+  batch_ring = ring;
+  batch_ring_size = ring_size;
+  batch_tail = tail;
+  batch_nr_record = 0;
+  IFDEF(CONFIG_DIFFTEST_STORE_COMMIT, batch_nr_store = store_queue_size());
+
+  // cpu_exec() returns after an exception is taken, so a trap ends the batch
+  set_commit_hook(batch_commit);
+  cpu_exec(n);
+  set_commit_hook(NULL);
+  return batch_nr_record;
+}
+#endif // CONFIG_DIFFTEST_BATCH
+
 char *reg_dump_file = NULL;
 
 void dump_regs() {
@@ -45,6 +45,33 @@ struct DebugInfo {
   uint64_t current_pc;
 };
 
+#ifdef CONFIG_DIFFTEST_BATCH
+enum {
+  COMMIT_RD = 0x1,           // rd and rd_val hold the integer register written
+  COMMIT_FRD = 0x2,          // rd and rd_val hold the floating-point register written
+  COMMIT_STORE = 0x4,        // saddr, sdata and smask hold the store
+  COMMIT_STORE_QUEUED = 0x8, // the stores are left in the store commit queue
+  COMMIT_TRAP = 0x10,        // an exception with cause was raised instead
+  COMMIT_END = 0x20,         // NEMU has ended after the instruction
+};
+
+// Record of an instruction executed by difftest_exec_batch(). The integer or
+// floating-point register written by the instruction is reported, so applying
+// the records to a copy of the registers keeps it the same as the ones of the REF.
+struct CommitRecord {
+  uint64_t pc;
+  uint64_t rd_val;
+  uint64_t saddr;
+  uint64_t sdata;
+  uint64_t cause;
+  uint32_t instr; // 0 for a trap
+  uint8_t rd;
+  uint8_t smask;
+  uint8_t flags;
+  uint8_t pad;
+};
+#endif // CONFIG_DIFFTEST_BATCH
+
 #ifdef CONFIG_QUERY_REF
 typedef enum RefQueryType {
   REF_QUERY_MEM_EVENT
@@ -16,8 +16,10 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/host-tlb.h>
 #include <memory/sparseram.h>
 #include "local-include/csr.h"
+#include "local-include/trigger.h"
 
 #ifndef CONFIG_SHARE
 static const uint32_t img [] = {
@@ -40,6 +42,26 @@ void init_device();
 
 #define CSR_ZERO_INIT(name, addr) name->val = 0;
 
+#ifdef CONFIG_MODE_SYSTEM
+#ifdef CONFIG_RV_SDTRIG
+// cpu.TM of a snapshot points to the trigger module of the process saving it
+static TriggerModule *trigger_module = NULL;
+#endif // CONFIG_RV_SDTRIG
+
+IFDEF(CONFIG_RV_GUEST_TLB, void gtlb_flush(vaddr_t vaddr, int asid));
+
+static void snapshot_loaded() {
+  extern int update_mmu_state();
+  IFDEF(CONFIG_RV_SDTRIG, cpu.TM = trigger_module);
+  update_mmu_state();
+  // the guest translations are cached by the VMID of hgatp
+  IFDEF(CONFIG_RVH, hosttlb_set_vmid(hgatp->vmid));
+  IFDEF(CONFIG_RV_PMP_CACHE, pmp_cache_flush());
+  // the page tables in memory are loaded as well
+  IFDEF(CONFIG_RV_GUEST_TLB, gtlb_flush(0, -1));
+}
+#endif // CONFIG_MODE_SYSTEM
+
 void init_isa() {
   // NEMU has some cached states and some static variables in the source code.
   // They are assumed to have initialized states every time when the dynamic lib is loaded.
@@ -158,6 +180,14 @@ void init_isa() {
   init_trigger();
 #endif // CONFIG_RV_SDTRIG
 
+#ifdef CONFIG_MODE_SYSTEM
+  snapshot_add_state("csr", csr_array, sizeof(csr_array), snapshot_loaded);
+#ifdef CONFIG_RV_SDTRIG
+  trigger_module = cpu.TM;
+  snapshot_add_state("trigger", cpu.TM, sizeof(TriggerModule), NULL);
+#endif // CONFIG_RV_SDTRIG
+#endif // CONFIG_MODE_SYSTEM
+
 #define MSTATEEN0_RESET  0xdc00000000000001ULL
 #define HSTATEEN0_RESET  0xdc00000000000001ULL
 #define SSTATEEN0_RESET  0x0000000000000001ULL
@@ -175,6 +205,7 @@ void init_isa() {
     sparse_mem_write(get_sparsemm(), RESET_VECTOR, sizeof(img), img);
     #else
     memcpy(guest_to_host(RESET_VECTOR), img, sizeof(img));
+    IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(RESET_VECTOR, sizeof(img)));
     #endif
   }
 #endif
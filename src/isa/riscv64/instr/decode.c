@@ -52,6 +52,8 @@ static inline uint32_t get_instr(Decode *s) {
 #include "rvv/decode.h"
 #endif // CONFIG_RVV
 
+// Patterns testing only the opcode come first, so that they compile to one
+// jump table. M-extension instructions are dispatched by op and op32.
 def_THelper(main) {
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00000 ??", I     , load);
 #ifndef CONFIG_FPU_NONE
@@ -66,10 +68,8 @@ def_THelper(main) {
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01001 ??", fstore, fstore);
 #endif // CONFIG_FPU_NONE
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01011 ??", R     , atomic);
-  def_INSTR_IDTAB("0000001 ????? ????? ??? ????? 01100 ??", R     , rvm);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01100 ??", R     , op);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01101 ??", U     , lui);
-  def_INSTR_IDTAB("0000001 ????? ????? ??? ????? 01110 ??", R     , rvm32);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01110 ??", R     , op32);
 #ifndef CONFIG_FPU_NONE
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10000 ??", R4    , fmadd_dispatch);
@@ -82,14 +82,14 @@ def_THelper(main) {
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10101 ??", OP_V  , OP_V);
 #endif // CONFIG_RVV
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11000 ??", B     , branch);
-  def_INSTR_IDTAB("??????? ????? ????? 000 ????? 11001 ??", I     , jalr_dispatch);
-  def_INSTR_TAB  ("??????? ????? ????? 000 ????? 11010 ??",         nemu_trap);
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11011 ??", J     , jal_dispatch);
 #ifdef CONFIG_RVH
   def_INSTR_TAB  ("??????? ????? ????? ??? ????? 11100 ??",         system);
 #else
   def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11100 ??", csr   , system);
 #endif
+  def_INSTR_IDTAB("??????? ????? ????? 000 ????? 11001 ??", I     , jalr_dispatch);
+  def_INSTR_TAB  ("??????? ????? ????? 000 ????? 11010 ??",         nemu_trap);
   return table_inv(s);
 };
 
@@ -164,3 +164,23 @@ int isa_fetch_decode(Decode *s) {
 
   return idx;
 }
+
+#ifdef CONFIG_TCACHE_PHYS_INDEX
+// move the pc-relative operands of an instruction copied to another virtual address
+void isa_decode_relocate(Decode *s, sword_t delta) {
+  uint32_t instr = s->isa.instr.val;
+  if (s->isa.instr.r.opcode1_0 != 0x3) {
+    if (BITS(instr, 1, 0) != 0x1) return;
+    switch (BITS(instr, 15, 13)) {
+      case 0x5: id_src1->imm += delta; break;           // c.j
+      case 0x6: case 0x7: id_dest->imm += delta; break; // c.beqz, c.bnez
+    }
+    return;
+  }
+  switch (s->isa.instr.r.opcode6_2) {
+    case 0x05: id_src1->imm += delta; break;                         // auipc
+    case 0x18: id_dest->imm += delta; break;                         // branch
+    case 0x1b: id_src1->imm += delta; id_src2->imm += delta; break;  // jal
+  }
+}
+#endif
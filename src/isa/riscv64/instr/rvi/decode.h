@@ -16,6 +16,8 @@
 
 static int table_c_addi_dispatch(Decode *s);
 static int table_c_addiw_dispatch(Decode *s);
+static int table_rvm(Decode *s);
+static int table_rvm32(Decode *s);
 
 static inline def_DopHelper(i) {
   op->imm = val;
@@ -195,6 +197,7 @@ def_THelper(op_imm32) {
 }
 
 def_THelper(op) {
+  def_INSTR_TAB("0000001 ????? ????? ??? ????? ????? ??", rvm);
   if (s->isa.instr.r.rd == s->isa.instr.r.rs1) {
     def_INSTR_TAB("0000000 ????? ????? 000 ????? ????? ??", c_add);
     def_INSTR_TAB("0100000 ????? ????? 000 ????? ????? ??", c_sub);
@@ -254,6 +257,7 @@ def_THelper(op) {
 }
 
 def_THelper(op32) {
+  def_INSTR_TAB("0000001 ????? ????? ??? ????? ????? ??", rvm32);
   if (s->isa.instr.r.rd == s->isa.instr.r.rs1) {
     def_INSTR_TAB("0000000 ????? ????? 000 ????? ????? ??", c_addw);
     def_INSTR_TAB("0100000 ????? ????? 000 ????? ????? ??", c_subw);
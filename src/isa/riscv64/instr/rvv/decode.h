@@ -537,7 +537,6 @@ def_THelper(OP_V) { // 10_101
     case 6 : s->src_vmode = SRC_VX; break;
   }
 
-  s->v_width = 1 << vtype->vsew;
   s->vm = s->isa.instr.v_opv.v_vm; //1 for without mask; 0 for with mask
 
   /*
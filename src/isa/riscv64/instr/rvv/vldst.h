@@ -26,9 +26,9 @@ void predecode_vls(Decode *s) {
 #ifdef CONFIG_RVV
   const int table [8] = {1, 0, 0, 0, 0, 2, 4, 8};
   s->vm = s->isa.instr.v_opv.v_vm; //1 for without mask; 0 for with mask
-  s->v_width = table[s->isa.instr.vldfp.v_width];
-  s->v_nf = s->isa.instr.vldfp.v_nf;
-  s->v_lsumop = s->isa.instr.vldfp.v_lsumop;
+  vldst.v_width = table[s->isa.instr.vldfp.v_width];
+  vldst.v_nf = s->isa.instr.vldfp.v_nf;
+  vldst.v_lsumop = s->isa.instr.vldfp.v_lsumop;
 #endif
 }
 
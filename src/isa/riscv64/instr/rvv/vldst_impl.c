@@ -25,10 +25,13 @@
 #ifdef CONFIG_RVV
 
 #include <cpu/cpu.h>
+#include <profiling/bintrace.h>
 #include "vldst_impl.h"
 #include "vcompute_impl.h"
 #include "../local-include/intr.h"
 
+vldst_state_t vldst = {};
+
 // reference: v_ext_macros.h in riscv-isa-sim
 
 static void isa_emul_check(int emul, int nfields) {
@@ -53,12 +56,12 @@ static void isa_emul_check(int emul, int nfields) {
 
 static void vstore_check(int mode, Decode *s) {
   int eew = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: eew = 0; break;
     case 2: eew = 1; break;
     case 4: eew = 2; break;
     case 8: eew = 3; break;
-    default: Loge("illegal v_width: %d\n", s->v_width);
+    default: Loge("illegal v_width: %d\n", vldst.v_width);
     longjmp_exception(EX_II); break;
   }
   uint64_t veew = mode == MODE_MASK ? 1 : 8 << eew;
@@ -71,7 +74,7 @@ static void vstore_check(int mode, Decode *s) {
     longjmp_exception(EX_II);
   }
   require_aligned(id_dest->reg, vemul);
-  uint64_t nf = s->v_nf + 1;
+  uint64_t nf = vldst.v_nf + 1;
   if (!((nf * emul <= 8) && (id_dest->reg + nf * emul <= 32))) {
     Loge("illegal NFIELDS: %lu EMUL: %lu\n", nf, emul);
     longjmp_exception(EX_II);
@@ -86,7 +89,7 @@ static void vload_check(int mode, Decode *s) {
 static void index_vstore_check(int mode, Decode *s) {
   int eew = vtype->vsew;
   int elt_width = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: elt_width = 0; break;
     case 2: elt_width = 1; break;
     case 4: elt_width = 2; break;
@@ -105,7 +108,7 @@ static void index_vstore_check(int mode, Decode *s) {
   require_aligned(id_dest->reg, vflmul);
   require_aligned(id_src2->reg, vemul);
 
-  uint64_t nf = s->v_nf + 1;
+  uint64_t nf = vldst.v_nf + 1;
   if (!((nf * flmul <= 8) && (id_dest->reg + nf * flmul <= 32))) {
     Loge("illegal NFIELDS: %lu LMUL: %lu\n", nf, flmul);
     longjmp_exception(EX_II);
@@ -116,14 +119,14 @@ static void index_vload_check(int mode, Decode *s) {
   index_vstore_check(mode, s);
   int eew = vtype->vsew;
   int elt_width = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: elt_width = 0; break;
     case 2: elt_width = 1; break;
     case 4: elt_width = 2; break;
     case 8: elt_width = 3; break;
     default: break;
   }
-  uint64_t nf = s->v_nf + 1;
+  uint64_t nf = vldst.v_nf + 1;
   double vflmul = compute_vflmul();
   float vemul = (float)(8 << elt_width) / (8 << eew) * vflmul;
   uint64_t flmul = vflmul < 1 ? 1 : vflmul;
@@ -210,10 +213,10 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
   int64_t stride;
   int eew, emul, vemul;
 
-  // s->v_width is the bytes of a unit
+  // vldst.v_width is the bytes of a unit
   // eew is the coding like vsew
   eew = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: eew = 0; break;
     case 2: eew = 1; break;
     case 4: eew = 2; break;
@@ -237,7 +240,7 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
   rtl_lr(s, &(s->src1.val), s->src1.reg, 4);
   rtl_mv(s, &(tmp_reg[0]), &(s->src1.val));
 
-  nf = s->v_nf + 1;
+  nf = vldst.v_nf + 1;
   vl_val = mode == MODE_MASK ? (vl->val + 7) / 8 : vl->val;
   base_addr = tmp_reg[0];
   vd = id_dest->reg;
@@ -245,21 +248,23 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
   bool fast_vle = false;
 
 #ifndef CONFIG_SHARE
-  uint64_t start_addr = base_addr + (vstart->val * nf) * s->v_width;
-  uint64_t last_addr = base_addr + (vl_val * nf - 1) * s->v_width;
-  uint64_t vle_size = last_addr - start_addr + s->v_width;
+  uint64_t start_addr = base_addr + (vstart->val * nf) * vldst.v_width;
+  uint64_t last_addr = base_addr + (vl_val * nf - 1) * vldst.v_width;
+  uint64_t vle_size = last_addr - start_addr + vldst.v_width;
   __attribute_maybe_unused__ bool cross_page = last_addr / PAGE_SIZE != start_addr / PAGE_SIZE;
   uint8_t masks[VLMAX_8] = {0};
 
   Logm("vld start_addr: %#lx, v_width: %u, vl_val: %lu, vle size=%lu, vstart->val: %lu, nf=%lu",
-      base_addr, s->v_width, vl_val, vle_size, vstart->val, nf);
+      base_addr, vldst.v_width, vl_val, vle_size, vstart->val, nf);
 
   if (is_unit_stride && nf == 1 && vl_val > vstart->val && vtype->vlmul < 4 && !cross_page) {
-    s->last_access_host_addr = NULL;
+    vldst.last_access_host_addr = NULL;
     extern void dummy_vaddr_data_read(struct Decode *s, vaddr_t addr, int len, int mmu_mode);
-    dummy_vaddr_data_read(s, start_addr, s->v_width, mmu_mode);
-    // Now we have the host address of first element in Decode *s->last_access_host_addr
-    if (s->last_access_host_addr != NULL) {
+    dummy_vaddr_data_read(s, start_addr, vldst.v_width, mmu_mode);
+    // Now we have the host address of first element in vldst.last_access_host_addr
+    if (vldst.last_access_host_addr != NULL) {
+      // the elements are accessed through the host, so only the first one is traced
+      IFDEF(CONFIG_BIN_TRACE, bintrace_mem(start_addr, false));
 
       // get address of first element in register file
       void *reg_file_addr = NULL;
@@ -270,10 +275,10 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
       __attribute_maybe_unused__ unsigned count = gen_mask_for_unit_stride(s, eew, vstart, vl_val, masks);
 
       uint8_t invert_masks[VLMAX_8] = {0};
-      uint8_t * restrict last_access_host_addr_u8 = s->last_access_host_addr;
+      uint8_t * restrict last_access_host_addr_u8 = vldst.last_access_host_addr;
       
 #ifdef DEBUG_FAST_VLE
-      switch (s->v_width) {
+      switch (vldst.v_width) {
         case 1: for (int i = 0; i < vle_size; i++) {
             Logm("Element %i, mask = %x, inv mask = %x, reg = %x, mem = %x", i,
                  masks[i], invert_masks[i], reg_file_addr_8[i],
@@ -305,7 +310,7 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
           }
           break;
         default:
-                panic("Unexpected vwidth = %d", s->v_width);
+                panic("Unexpected vwidth = %d", vldst.v_width);
       }
 # endif // DEBUG_FAST_VLE
 
@@ -338,8 +343,8 @@ void vld(int mode, int is_signed, Decode *s, int mmu_mode) {
         continue;
       }
       for (fn = 0; fn < nf; fn++) {
-        addr = base_addr + idx * stride + (idx * nf * is_unit_stride + fn) * s->v_width;
-        rtl_lm(s, &tmp_reg[1], &addr, 0, s->v_width, mmu_mode);
+        addr = base_addr + idx * stride + (idx * nf * is_unit_stride + fn) * vldst.v_width;
+        rtl_lm(s, &tmp_reg[1], &addr, 0, vldst.v_width, mmu_mode);
         set_vreg(vd + fn * emul, idx, tmp_reg[1], eew, 0, 0);
       }
     }
@@ -368,12 +373,12 @@ void vldx(int mode, int is_signed, Decode *s, int mmu_mode) {
   index_vload_check(mode, s);
   if(check_vstart_ignore(s)) return;
   uint64_t idx;
-  uint64_t nf = s->v_nf + 1, fn, vl_val, base_addr, vd, index, addr;
+  uint64_t nf = vldst.v_nf + 1, fn, vl_val, base_addr, vd, index, addr;
   int eew, lmul, index_width, data_width;
 
   index_width = 0;
   eew = vtype->vsew;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: index_width = 0; break;
     case 2: index_width = 1; break;
     case 4: index_width = 2; break;
@@ -411,9 +416,9 @@ void vldx(int mode, int is_signed, Decode *s, int mmu_mode) {
 
       // read data in memory
       addr = base_addr + index + fn * data_width;
-      s->v_is_vx = 1;
+      vldst.v_is_vx = 1;
       rtl_lm(s, &tmp_reg[1], &addr, 0, data_width, mmu_mode);
-      s->v_is_vx = 0;
+      vldst.v_is_vx = 0;
       set_vreg(vd + fn * lmul, idx, tmp_reg[1], eew, 0, 0);
     }
   }
@@ -445,7 +450,7 @@ void vst(int mode, Decode *s, int mmu_mode) {
   int eew, emul;
 
   eew = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: eew = 0; break;
     case 2: eew = 1; break;
     case 4: eew = 2; break;
@@ -469,7 +474,7 @@ void vst(int mode, Decode *s, int mmu_mode) {
   rtl_lr(s, &(s->src1.val), s->src1.reg, 4);
   rtl_mv(s, &(tmp_reg[0]), &(s->src1.val));
 
-  nf = s->v_nf + 1;
+  nf = vldst.v_nf + 1;
   vl_val = mode == MODE_MASK ? (vl->val + 7) / 8 : vl->val;
   base_addr = tmp_reg[0];
   vd = id_dest->reg;
@@ -477,9 +482,9 @@ void vst(int mode, Decode *s, int mmu_mode) {
   bool fast_vse = false;
 
 #ifndef CONFIG_SHARE
-  uint64_t start_addr = base_addr + (vstart->val * nf) * s->v_width;
-  uint64_t last_addr = base_addr + (vl_val * nf - 1) * s->v_width;
-  uint64_t vse_size = last_addr - start_addr + s->v_width;
+  uint64_t start_addr = base_addr + (vstart->val * nf) * vldst.v_width;
+  uint64_t last_addr = base_addr + (vl_val * nf - 1) * vldst.v_width;
+  uint64_t vse_size = last_addr - start_addr + vldst.v_width;
   __attribute_maybe_unused__ bool cross_page = last_addr / PAGE_SIZE != start_addr / PAGE_SIZE;
   uint8_t masks[VLMAX_8] = {0};
 
@@ -489,11 +494,13 @@ void vst(int mode, Decode *s, int mmu_mode) {
 
     // get address of first element in memory; manually trigger isa_mmu_check.
     // if exception happens, it will goto the exception handler.
-    s->last_access_host_addr = NULL;
+    vldst.last_access_host_addr = NULL;
     extern void dummy_vaddr_write(struct Decode *s, vaddr_t addr, int len, int mmu_mode);
-    dummy_vaddr_write(s, start_addr, s->v_width, mmu_mode);
-    // Now we have the host address of first element in Decode *s->last_access_host_addr
-    if (s->last_access_host_addr != NULL) {
+    dummy_vaddr_write(s, start_addr, vldst.v_width, mmu_mode);
+    // Now we have the host address of first element in vldst.last_access_host_addr
+    if (vldst.last_access_host_addr != NULL) {
+      // the elements are accessed through the host, so only the first one is traced
+      IFDEF(CONFIG_BIN_TRACE, bintrace_mem(start_addr, true));
 
       // get address of first element in register file
       void *reg_file_addr = NULL;
@@ -505,12 +512,12 @@ void vst(int mode, Decode *s, int mmu_mode) {
 
       Logm("vst start_addr: %#lx, last_addr: %#lx, v_width: %u, vl_val: %lu, "
           "vstart->val: %lu, v0: %016lx_%016lx, nf=%lu",
-          start_addr, last_addr, s->v_width, vl_val, vstart->val, cpu.vr[0]._64[1], cpu.vr[0]._64[0],
+          start_addr, last_addr, vldst.v_width, vl_val, vstart->val, cpu.vr[0]._64[1], cpu.vr[0]._64[0],
           nf);
       Logm("vse size = %lu, valid mask count = %u", vse_size, count);
-      Logm("mem base host addr = %p, reg file base host addr = %p", s->last_access_host_addr, reg_file_addr);
+      Logm("mem base host addr = %p, reg file base host addr = %p", vldst.last_access_host_addr, reg_file_addr);
 
-      uint8_t * restrict last_access_addr_8 = s->last_access_host_addr;
+      uint8_t * restrict last_access_addr_8 = vldst.last_access_host_addr;
       for (int i = 0; i < VLMAX_8; i++) {
         invert_masks[i] = ~masks[i];
         masks[i] &= reg_file_addr_8[i];
@@ -520,26 +527,26 @@ void vst(int mode, Decode *s, int mmu_mode) {
 #ifdef CONFIG_DIFFTEST_STORE_COMMIT
       extern void store_commit_queue_push(uint64_t addr, uint64_t data,
                                           int len);
-      for (int i = 0; i < vse_size; i += s->v_width) {
-        // store_commit_queue_push((uint8_t *)s->last_access_host_addr), data, len);
-        switch (s->v_width) {
+      for (int i = 0; i < vse_size; i += vldst.v_width) {
+        // store_commit_queue_push((uint8_t *)vldst.last_access_host_addr), data, len);
+        switch (vldst.v_width) {
           case 1: store_commit_queue_push(
-              host_to_guest((uint8_t *)s->last_access_host_addr + i),
-              masks[i], s->v_width, 0); break;
+              host_to_guest((uint8_t *)vldst.last_access_host_addr + i),
+              masks[i], vldst.v_width, 0); break;
           case 2: store_commit_queue_push(
-              host_to_guest((uint8_t *)s->last_access_host_addr + i),
-              *(uint16_t *)&masks[i], s->v_width, 0); break;
+              host_to_guest((uint8_t *)vldst.last_access_host_addr + i),
+              *(uint16_t *)&masks[i], vldst.v_width, 0); break;
           case 4: store_commit_queue_push(
-              host_to_guest((uint8_t *)s->last_access_host_addr + i),
-              *(uint32_t *)&masks[i], s->v_width, 0); break;
+              host_to_guest((uint8_t *)vldst.last_access_host_addr + i),
+              *(uint32_t *)&masks[i], vldst.v_width, 0); break;
           case 8: store_commit_queue_push(
-              host_to_guest((uint8_t *)s->last_access_host_addr + i),
-              *(uint64_t *)&masks[i], s->v_width, 0); break;
-          default: panic("Unexpected vwidth = %d", s->v_width);
+              host_to_guest((uint8_t *)vldst.last_access_host_addr + i),
+              *(uint64_t *)&masks[i], vldst.v_width, 0); break;
+          default: panic("Unexpected vwidth = %d", vldst.v_width);
         }
       }
 #endif
-      memcpy(s->last_access_host_addr, masks, vse_size);
+      memcpy(vldst.last_access_host_addr, masks, vse_size);
       fast_vse = true; // skip all operations
     }
   }
@@ -554,13 +561,13 @@ void vst(int mode, Decode *s, int mmu_mode) {
       if (s->vm == 0 && mask == 0) {
 #ifdef DEBUG_FAST_VSE
         if (ISNDEF(CONFIG_SHARE) && ISDEF(CONFIG_DIFFTEST_STORE_COMMIT) && simple_vse) {
-          uint64_t offset = idx * stride + (idx * nf * is_unit_stride + 0) * s->v_width;
-          switch (s->v_width) {
+          uint64_t offset = idx * stride + (idx * nf * is_unit_stride + 0) * vldst.v_width;
+          switch (vldst.v_width) {
             case 1: assert(masks[offset] == 0); break;
             case 2: assert(*(uint16_t *)&masks[offset] == 0); break;
             case 4: assert(*(uint32_t *)&masks[offset] == 0); break;
             case 8: assert(*(uint64_t *)&masks[offset] == 0); break;
-            default: panic("Unexpected vwidth = %d", s->v_width);
+            default: panic("Unexpected vwidth = %d", vldst.v_width);
           }
         }
 #endif
@@ -568,14 +575,14 @@ void vst(int mode, Decode *s, int mmu_mode) {
       }
       for (unsigned fn = 0; fn < nf; fn++) {
         get_vreg(vd + fn * emul, idx, &tmp_reg[1], eew, 0, 0, 0);
-        uint64_t offset = idx * stride + (idx * nf * is_unit_stride + fn) * s->v_width;
+        uint64_t offset = idx * stride + (idx * nf * is_unit_stride + fn) * vldst.v_width;
         addr = base_addr + offset;
         if (!fast_vse) {
-          rtl_sm(s, &tmp_reg[1], &addr, 0, s->v_width, mmu_mode);
+          rtl_sm(s, &tmp_reg[1], &addr, 0, vldst.v_width, mmu_mode);
         }
 #ifdef DEBUG_FAST_VSE
         if (simple_vse) {
-          bool match = memcmp(&tmp_reg[1], &masks[offset], s->v_width) == 0;
+          bool match = memcmp(&tmp_reg[1], &masks[offset], vldst.v_width) == 0;
           if (!match) {
             Logm("Mismatch at idx = %lu, fn = %u, offset = %lu, addr = %lx, "
                 "slow version = %lx, fast version = %lx", idx, fn, offset, addr,
@@ -596,12 +603,12 @@ void vstx(int mode, Decode *s, int mmu_mode) {
   index_vstore_check(mode, s);
   if(check_vstart_ignore(s)) return;
   uint64_t idx;
-  uint64_t nf = s->v_nf + 1, fn, vl_val, base_addr, vd, index, addr;
+  uint64_t nf = vldst.v_nf + 1, fn, vl_val, base_addr, vd, index, addr;
   int eew, lmul, index_width, data_width;
 
   index_width = 0;
   eew = vtype->vsew;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: index_width = 0; break;
     case 2: index_width = 1; break;
     case 4: index_width = 2; break;
@@ -634,9 +641,9 @@ void vstx(int mode, Decode *s, int mmu_mode) {
       // read data in vector register
       get_vreg(vd + fn * lmul, idx, &tmp_reg[1], eew, 0, 0, 0);
       addr = base_addr + index + fn * data_width;
-      s->v_is_vx = 1;
+      vldst.v_is_vx = 1;
       rtl_sm(s, &tmp_reg[1], &addr, 0, data_width, mmu_mode);
-      s->v_is_vx = 0;
+      vldst.v_is_vx = 0;
     }
   }
 
@@ -663,7 +670,7 @@ void vlr(int mode, int is_signed, Decode *s, int mmu_mode) {
   int eew;
 
   eew = 0;
-  switch(s->v_width) {
+  switch(vldst.v_width) {
     case 1: eew = 0; break;
     case 2: eew = 1; break;
     case 4: eew = 2; break;
@@ -675,8 +682,8 @@ void vlr(int mode, int is_signed, Decode *s, int mmu_mode) {
   rtl_lr(s, &(s->src1.val), s->src1.reg, 4);
   rtl_mv(s, &(tmp_reg[0]), &(s->src1.val));
 
-  len = s->v_nf + 1;
-  elt_per_reg = VLEN / (8*s->v_width);
+  len = vldst.v_nf + 1;
+  elt_per_reg = VLEN / (8*vldst.v_width);
   size = len * elt_per_reg;
   base_addr = tmp_reg[0];
   vd = id_dest->reg;
@@ -690,8 +697,8 @@ void vlr(int mode, int is_signed, Decode *s, int mmu_mode) {
     if (offset) {
       // first vreg
       for (pos = offset; pos < elt_per_reg; pos++, vstart->val++) {
-        addr = base_addr + idx * s->v_width;
-        rtl_lm(s, &tmp_reg[1], &addr, 0, s->v_width, mmu_mode);
+        addr = base_addr + idx * vldst.v_width;
+        rtl_lm(s, &tmp_reg[1], &addr, 0, vldst.v_width, mmu_mode);
         set_vreg(vd + vreg_idx, pos, tmp_reg[1], eew, 0, 1);
         idx++;
       }
@@ -699,8 +706,8 @@ void vlr(int mode, int is_signed, Decode *s, int mmu_mode) {
     }
     for (; vreg_idx < len; vreg_idx++) {
       for (pos = 0; pos < elt_per_reg; pos++, vstart->val++) {
-        addr = base_addr + idx * s->v_width;
-        rtl_lm(s, &tmp_reg[1], &addr, 0, s->v_width, mmu_mode);
+        addr = base_addr + idx * vldst.v_width;
+        rtl_lm(s, &tmp_reg[1], &addr, 0, vldst.v_width, mmu_mode);
         set_vreg(vd + vreg_idx, pos, tmp_reg[1], eew, 0, 1);
         idx++;
       }
@@ -719,7 +726,7 @@ void vsr(int mode, Decode *s, int mmu_mode) {
   rtl_lr(s, &(s->src1.val), s->src1.reg, 4);
   rtl_mv(s, &(tmp_reg[0]), &(s->src1.val));
 
-  len = s->v_nf + 1;
+  len = vldst.v_nf + 1;
   elt_per_reg = vlenb->val;
   size = len * elt_per_reg;
   base_addr = tmp_reg[0];
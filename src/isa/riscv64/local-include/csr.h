@@ -1388,6 +1388,9 @@ MAP(CSRS, CSRS_DECL)
 /** General **/
 void csr_prepare();
 
+// return from M mode to the mode in mstatus.MPP, except setting pc to mepc
+void do_mret_state_update();
+
 word_t gen_status_sd(word_t status);
 
 word_t csrid_read(uint32_t csrid);
@@ -1396,5 +1399,8 @@ word_t csrid_read(uint32_t csrid);
 uint8_t pmpcfg_from_index(int idx);
 word_t pmpaddr_from_index(int idx);
 word_t pmp_tor_mask();
+#ifdef CONFIG_RV_PMP_CACHE
+void pmp_cache_flush();
+#endif
 
 #endif // __CSR_H__
@@ -19,6 +19,8 @@
 #include "local-include/reg.h"
 #include "local-include/csr.h"
 #include "local-include/trigger.h"
+#include <cpu/cpu.h>
+#include <memory/host-tlb.h>
 //#include "local-include/intr.h"
 
 const char *regsl[] = {
@@ -143,4 +145,15 @@ rtlreg_t isa_reg_str2val(const char *s, bool *success) {
 
 bool able_to_take_cpt() {
   return cpu.mode != MODE_M;
-}
\ No newline at end of file
+}
+// The restorer of a checkpoint loads the registers in M mode and returns to
+// the workload with mret, for which serializeRegs() has prepared mstatus and
+// mepc. Do the same after the registers are loaded natively.
+void restore_cpt_mret() {
+  do_mret_state_update();
+  cpu.pc = mepc->val;
+  IFDEF(CONFIG_RVH, hosttlb_set_vmid(hgatp->vmid));
+  IFDEF(CONFIG_RV_PMP_CACHE, pmp_cache_flush());
+  set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
+  csr_prepare();
+}
@@ -199,6 +199,12 @@ bool has_two_stage_translation(){
   return hld_st || (mstatus->mprv && mstatus->mpv) || cpu.v;
 }
 
+// two-stage translation which does not follow cpu.v, i.e. hypervisor
+// virtual-machine loads/stores, or loads/stores with MPRV
+bool has_indirect_two_stage_translation(){
+  return hld_st || (mstatus->mprv && (mstatus->mpv || cpu.v));
+}
+
 void raise_guest_excep(paddr_t gpaddr, vaddr_t vaddr, int type){
   // printf("gpaddr: " FMT_PADDR ", vaddr: " FMT_WORD "\n", gpaddr, vaddr);
 #ifdef FORCE_RAISE_PF
@@ -325,6 +331,108 @@ static word_t pte_read(paddr_t addr, int type, int mode, vaddr_t vaddr) {
 }
 #endif // CONFIG_MULTICORE_DIFF
 
+#ifdef CONFIG_RV_GUEST_TLB
+// Guest TLB in front of the page walker. Only leaf PTEs of successful walks
+// are cached, tagged with satp.ASID. A hit checks the permission of the cached
+// PTE again and falls back to a full walk on any failure, so exceptions are
+// always raised by the walker with the PTE in memory.
+#define GTLB_WAYS 4
+#define GTLB_SETS (CONFIG_RV_GUEST_TLB_SIZE / GTLB_WAYS)
+#define GTLB_SUPER_SIZE 16
+
+typedef struct {
+  word_t vpn;   // vaddr >> VPNiSHFT(level)
+  PTE pte;
+  uint16_t asid;
+  uint8_t level;
+  bool valid;
+} GTLBEntry;
+
+static GTLBEntry gtlb[GTLB_SETS][GTLB_WAYS] = {};
+static GTLBEntry gtlb_super[GTLB_SUPER_SIZE] = {};
+static uint8_t gtlb_victim[GTLB_SETS] = {};
+static int gtlb_super_victim = 0;
+uint64_t g_nr_gtlb_hit = 0, g_nr_gtlb_miss = 0, g_nr_gtlb_flush = 0;
+
+static inline GTLBEntry* gtlb_set(vaddr_t vaddr) {
+  return gtlb[(vaddr >> PGSHFT) % GTLB_SETS];
+}
+
+static inline bool gtlb_match(GTLBEntry *e, vaddr_t vaddr, uint16_t asid) {
+  return e->valid && (vaddr >> VPNiSHFT(e->level)) == e->vpn && (e->pte.g || e->asid == asid);
+}
+
+static GTLBEntry* gtlb_lookup(vaddr_t vaddr) {
+  uint16_t asid = satp->asid;
+  GTLBEntry *set = gtlb_set(vaddr);
+  for (int i = 0; i < GTLB_WAYS; i ++) {
+    if (gtlb_match(&set[i], vaddr, asid)) return &set[i];
+  }
+  for (int i = 0; i < GTLB_SUPER_SIZE; i ++) {
+    if (gtlb_match(&gtlb_super[i], vaddr, asid)) return &gtlb_super[i];
+  }
+  return NULL;
+}
+
+static void gtlb_fill(vaddr_t vaddr, PTE pte, int level) {
+  GTLBEntry *e;
+  if (level == 0) {
+    int idx = (vaddr >> PGSHFT) % GTLB_SETS;
+    e = &gtlb[idx][gtlb_victim[idx]];
+    gtlb_victim[idx] = (gtlb_victim[idx] + 1) % GTLB_WAYS;
+  } else {
+    e = &gtlb_super[gtlb_super_victim];
+    gtlb_super_victim = (gtlb_super_victim + 1) % GTLB_SUPER_SIZE;
+  }
+  e->vpn = vaddr >> VPNiSHFT(level);
+  e->pte = pte;
+  e->asid = satp->asid;
+  e->level = level;
+  e->valid = true;
+}
+
+// A conservative copy of check_permission() and the A/D check in ptw()
+// which never raises an exception
+static inline bool gtlb_permit(PTE *pte, int type) {
+  bool ifetch = (type == MEM_TYPE_IFETCH);
+  uint32_t mode = (mstatus->mprv && !ifetch ? mstatus->mpp : cpu.mode);
+  if (mode == MODE_U ? !pte->u : (pte->u && (!mstatus->sum || ifetch))) return false;
+  switch (type) {
+    case MEM_TYPE_IFETCH: return pte->x && pte->a;
+    case MEM_TYPE_READ:   return (pte->r || (mstatus->mxr && pte->x)) && pte->a;
+    case MEM_TYPE_WRITE:  return pte->w && pte->a && pte->d;
+    default: return false;
+  }
+}
+
+static inline void gtlb_drop(GTLBEntry *e, vaddr_t vaddr, int asid) {
+  if (!e->valid) return;
+  if (asid >= 0 && (e->pte.g || e->asid != asid)) return;
+  if (vaddr == 0 || (vaddr >> VPNiSHFT(e->level)) == e->vpn) e->valid = false;
+}
+
+// Drop the entries of `vaddr` (all addresses if 0) in the address space of
+// `asid` (all address spaces, including global entries, if negative),
+// which follows the operands of sfence.vma
+void gtlb_flush(vaddr_t vaddr, int asid) {
+  g_nr_gtlb_flush ++;
+  if (vaddr == 0 && asid < 0) {
+    memset(gtlb, 0, sizeof(gtlb));
+    memset(gtlb_super, 0, sizeof(gtlb_super));
+    return;
+  }
+  if (vaddr == 0) {
+    for (int i = 0; i < GTLB_SETS; i ++) {
+      for (int j = 0; j < GTLB_WAYS; j ++) gtlb_drop(&gtlb[i][j], vaddr, asid);
+    }
+  } else {
+    GTLBEntry *set = gtlb_set(vaddr);
+    for (int j = 0; j < GTLB_WAYS; j ++) gtlb_drop(&set[j], vaddr, asid);
+  }
+  for (int i = 0; i < GTLB_SUPER_SIZE; i ++) gtlb_drop(&gtlb_super[i], vaddr, asid);
+}
+#endif // CONFIG_RV_GUEST_TLB
+
 static paddr_t ptw(vaddr_t vaddr, int type) {
   Logtr("Page walking for 0x%lx\n", vaddr);
   word_t pg_base = PGBASE(satp->ppn);  //satp->ppn:一级页表基址，pg_base表示根页表的基地址
@@ -365,6 +473,22 @@ static paddr_t ptw(vaddr_t vaddr, int type) {
     vaddr39 >>= (64 - 39);
     if ((uint64_t)vaddr39 != vaddr) goto bad;
   }
+#ifdef CONFIG_RV_GUEST_TLB
+  if (!MUXDEF(CONFIG_RVH, virt, false)) {
+    GTLBEntry *e = gtlb_lookup(vaddr);
+    if (e != NULL) {
+      if (gtlb_permit(&e->pte, type)) {
+        g_nr_gtlb_hit ++;
+        pt_level = e->level;
+        word_t pg_mask = ((1ull << VPNiSHFT(e->level)) - 1);
+        pg_base = (PGBASE((uint64_t)e->pte.ppn) & ~pg_mask) | (vaddr & pg_mask & ~PGMASK);
+        return pg_base | MEM_RET_OK;
+      }
+      e->valid = false;
+    }
+    g_nr_gtlb_miss ++;
+  }
+#endif
   for (level = max_level - 1; level >= 0;) {
     p_pte = pg_base + VPNi(vaddr, level) * PTE_SIZE;
 #ifdef CONFIG_MULTICORE_DIFF
@@ -501,6 +625,9 @@ static paddr_t ptw(vaddr_t vaddr, int type) {
   }
 #endif // CONFIG_SHARE
   // printf("返回的物理地址 = 0x%lx, pg_pase = 0x%lx, MEM_RET_OK = %d\n", pg_base | MEM_RET_OK, pg_base, MEM_RET_OK);
+#ifdef CONFIG_RV_GUEST_TLB
+  if (!MUXDEF(CONFIG_RVH, virt, false)) gtlb_fill(vaddr, pte, level);
+#endif
   return pg_base | MEM_RET_OK;
 
 bad:
@@ -1069,27 +1196,8 @@ bool isa_bmc_check_permission(paddr_t addr, int len, int type, int out_mode){
 #endif
 }
 
-bool isa_pmp_check_permission(paddr_t addr, int len, int type, int out_mode) {
-  // printf("进入isa_pmp_check_permission()\n");
-  // printf("addr = %#lx, len = %d, type = %d, out_mode = %d\n", addr, len, type, out_mode);
-  bool ifetch = (type == MEM_TYPE_IFETCH);
-  __attribute__((unused)) uint32_t mode;
-  mode = (out_mode == MODE_M) ? (mstatus->mprv && !ifetch ? mstatus->mpp : cpu.mode) : out_mode;
-  // paddr_read/write method may not be able pass down the 'effective' mode for isa difference. do it here
-#ifdef CONFIG_SHARE
-  // if(dynamic_config.debug_difftest) {
-  //   if (mode != out_mode) {
-  //     fprintf(stderr, "[NEMU]   PMP out_mode:%d cpu.mode:%ld ifetch:%d mprv:%d mpp:%d actual mode:%d\n", out_mode, cpu.mode, ifetch, mstatus->mprv, mstatus->mpp, mode);
-  //       // Log("addr:%lx len:%d type:%d out_mode:%d mode:%d", addr, len, type, out_mode, mode);
-  //   }
-  // }
-#endif
-
 #ifdef CONFIG_RV_PMP_CHECK
-  if (CONFIG_RV_PMP_ACTIVE_NUM == 0) {
-    return true;
-  }
-
+static bool pmp_check_permission(paddr_t addr, int len, int type, int mode) {
   word_t base = 0;
   for (int i = 0; i < CONFIG_RV_PMP_ACTIVE_NUM; i++) {
     word_t pmpaddr = pmpaddr_from_index(i);
@@ -1169,7 +1277,101 @@ bool isa_pmp_check_permission(paddr_t addr, int len, int type, int out_mode) {
 #endif
 
   return mode == MODE_M;
+}
+
+#ifdef CONFIG_RV_PMP_CACHE
+#define PMP_CACHE_SIZE 1024
+
+// PMP decisions of a physical page, for each pair of effective mode and access type
+typedef struct {
+  paddr_t page;
+  uint64_t gen;
+  bool uniform;   // all accesses inside the page are matched by the same PMP entry
+  uint32_t valid; // bit (mode * 8 + type) is set if the decision is known
+  uint32_t allow;
+} PMPCacheEntry;
+
+static PMPCacheEntry pmp_cache[PMP_CACHE_SIZE];
+static uint64_t pmp_cache_gen = 1; // entries of older generations are invalid
+
+void pmp_cache_flush() { pmp_cache_gen ++; }
+
+// Each PMP entry before the first one covering the whole page must not
+// overlap with the page, otherwise the decision depends on the address.
+static bool pmp_page_uniform(paddr_t page) {
+  paddr_t last = page + PAGE_SIZE - 1;
+  word_t base = 0;
+  for (int i = 0; i < CONFIG_RV_PMP_ACTIVE_NUM; i++) {
+    word_t pmpaddr = pmpaddr_from_index(i);
+    word_t tor = (pmpaddr & pmp_tor_mask()) << PMP_SHIFT;
+    uint8_t cfg = pmpcfg_from_index(i);
+
+    if (cfg & PMP_A) {
+      bool in, out;
+      if ((cfg & PMP_A) == PMP_TOR) {
+        in = base <= page && last < tor;
+        out = tor <= base || last < base || tor <= page;
+      } else {
+        bool is_na4 = (cfg & PMP_A) == PMP_NA4;
+        word_t mask = (pmpaddr << 1) | (!is_na4) | ~pmp_tor_mask();
+        mask = ~(mask & ~(mask + 1)) << PMP_SHIFT;
+        in = (mask & PAGE_MASK) == 0 && ((page ^ tor) & mask) == 0;
+        out = ((page ^ tor) & mask & ~PAGE_MASK) != 0;
+      }
+      if (in) return true;
+      if (!out) return false;
+    }
+
+    base = tor;
+  }
+  return true;
+}
+
+static bool pmp_check_permission_cached(paddr_t addr, int len, int type, int mode) {
+  if ((addr & PAGE_MASK) + len > PAGE_SIZE) return pmp_check_permission(addr, len, type, mode);
+
+  paddr_t page = addr & ~PAGE_MASK;
+  PMPCacheEntry *e = &pmp_cache[(page >> PAGE_SHIFT) % PMP_CACHE_SIZE];
+  if (e->gen != pmp_cache_gen || e->page != page) {
+    e->page = page;
+    e->gen = pmp_cache_gen;
+    e->uniform = pmp_page_uniform(page);
+    e->valid = e->allow = 0;
+  }
+  if (!e->uniform) return pmp_check_permission(addr, len, type, mode);
+
+  uint32_t bit = 1u << (mode * 8 + type);
+  if (!(e->valid & bit)) {
+    e->valid |= bit;
+    if (pmp_check_permission(addr, len, type, mode)) e->allow |= bit;
+  }
+  return (e->allow & bit) != 0;
+}
+#endif // CONFIG_RV_PMP_CACHE
+#endif // CONFIG_RV_PMP_CHECK
+
+bool isa_pmp_check_permission(paddr_t addr, int len, int type, int out_mode) {
+  // printf("进入isa_pmp_check_permission()\n");
+  // printf("addr = %#lx, len = %d, type = %d, out_mode = %d\n", addr, len, type, out_mode);
+  bool ifetch = (type == MEM_TYPE_IFETCH);
+  __attribute__((unused)) uint32_t mode;
+  mode = (out_mode == MODE_M) ? (mstatus->mprv && !ifetch ? mstatus->mpp : cpu.mode) : out_mode;
+  // paddr_read/write method may not be able pass down the 'effective' mode for isa difference. do it here
+#ifdef CONFIG_SHARE
+  // if(dynamic_config.debug_difftest) {
+  //   if (mode != out_mode) {
+  //     fprintf(stderr, "[NEMU]   PMP out_mode:%d cpu.mode:%ld ifetch:%d mprv:%d mpp:%d actual mode:%d\n", out_mode, cpu.mode, ifetch, mstatus->mprv, mstatus->mpp, mode);
+  //       // Log("addr:%lx len:%d type:%d out_mode:%d mode:%d", addr, len, type, out_mode, mode);
+  //   }
+  // }
+#endif
+
+#ifdef CONFIG_RV_PMP_CHECK
+  if (CONFIG_RV_PMP_ACTIVE_NUM == 0) {
+    return true;
+  }
 
+  return MUXDEF(CONFIG_RV_PMP_CACHE, pmp_check_permission_cached, pmp_check_permission)(addr, len, type, mode);
 #endif
 
 #ifdef CONFIG_PMPTABLE_EXTENSION
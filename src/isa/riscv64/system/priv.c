@@ -21,9 +21,11 @@
 #include <cpu/cpu.h>
 #include <cpu/difftest.h>
 #include <memory/paddr.h>
+#include <memory/host-tlb.h>
 #include <stdlib.h>
 
 int update_mmu_state();
+IFDEF(CONFIG_RV_GUEST_TLB, void gtlb_flush(vaddr_t vaddr, int asid));
 uint64_t clint_uptime();
 void fp_set_dirty();
 void fp_update_rm_cache(uint32_t rm);
@@ -772,6 +774,7 @@ void update_vsatp(const vsatp_t new_val) {
       panic("HGATP.mode is illegal value(%lx), when write vsatp\n", (uint64_t)hgatp->mode);
       break;
   }
+  hosttlb_flush_vmid(hgatp->vmid);
 }
 #endif
 
@@ -967,6 +970,8 @@ static inline void csr_write(word_t *dest, word_t src) {
 #endif // CONFIG_SHARE
 
     mmu_tlb_flush(0);
+    IFDEF(CONFIG_RV_GUEST_TLB, gtlb_flush(0, -1));
+    IFDEF(CONFIG_RV_PMP_CACHE, pmp_cache_flush());
   }
   else if (is_pmpcfg(dest)) {
     // Logtr("Writing pmp config");
@@ -1010,12 +1015,15 @@ static inline void csr_write(word_t *dest, word_t src) {
     *dest = cfg_data;
 
     mmu_tlb_flush(0);
+    IFDEF(CONFIG_RV_GUEST_TLB, gtlb_flush(0, -1));
+    IFDEF(CONFIG_RV_PMP_CACHE, pmp_cache_flush());
   }
 #endif // CONFIG_RV_PMP_CSR
   else if (is_write(satp)) {
     if (cpu.mode == MODE_S && mstatus->tvm == 1) {
       longjmp_exception(EX_II);
     }
+    IFDEF(CONFIG_RV_GUEST_TLB, satp_t old_satp = *satp);
     // Only support Sv39 && Sv48(can configure), ignore write that sets other mode
 #ifdef CONFIG_RV_SV48
     if ((src & SATP_SV39_MASK) >> 60 == 9 || (src & SATP_SV39_MASK) >> 60 == 8 || (src & SATP_SV39_MASK) >> 60 == 0)
@@ -1023,6 +1031,11 @@ static inline void csr_write(word_t *dest, word_t src) {
     if ((src & SATP_SV39_MASK) >> 60 == 8 || (src & SATP_SV39_MASK) >> 60 == 0)
 #endif // CONFIG_RV_SV48
       *dest = MASKED_SATP(src);
+#ifdef CONFIG_RV_GUEST_TLB
+    // guest TLB entries are tagged with the ASID, so they only become stale
+    // when the root page table or the mode changes under the same ASID
+    if (satp->asid == old_satp.asid && satp->val != old_satp.val) gtlb_flush(0, satp->asid);
+#endif
   }
 #ifdef CONFIG_RV_SDTRIG
   else if (is_write(tselect)) {
@@ -1069,6 +1082,7 @@ static inline void csr_write(word_t *dest, word_t src) {
 
 #ifdef CONFIG_RVH
   else if (is_write(hgatp)) {
+    hgatp_t old_val = *hgatp;
     hgatp_t new_val = (hgatp_t)src;
     // vmid and ppn WARL in the normal way, regardless of new_val.mode
     hgatp->vmid = new_val.vmid;
@@ -1083,6 +1097,8 @@ static inline void csr_write(word_t *dest, word_t src) {
 #endif // CONFIG_RV_SV48
       hgatp->mode = new_val.mode;
     // When MODE=Bare, software should set the remaining fields in hgatp to zeros, not hardware.
+    if (hgatp->vmid != old_val.vmid) hosttlb_set_vmid(hgatp->vmid);
+    else if (hgatp->val != old_val.val) hosttlb_flush_vmid(hgatp->vmid);
   }
 #endif// CONFIG_RVH
   else if (is_mhpmcounter(dest) || is_mhpmevent(dest)) {
@@ -1285,6 +1301,24 @@ static void csrrw(rtlreg_t *dest, const rtlreg_t *src, uint32_t csrid) {
   }
 }
 
+void do_mret_state_update() {
+  mstatus->mie = mstatus->mpie;
+  mstatus->mpie = (ISDEF(CONFIG_DIFFTEST_REF_QEMU) ? 0 // this is bug of QEMU
+      : 1);
+  cpu.mode = mstatus->mpp;
+#ifdef CONFIG_RV_SDTRIG
+  tcontrol->mte = tcontrol->mpte;
+#endif
+#ifdef CONFIG_RVH
+  cpu.v = (mstatus->mpp == MODE_M ? 0 : mstatus->mpv);
+  mstatus->mpv = 0;
+  set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
+#endif // CONFIG_RVH
+  if (mstatus->mpp != MODE_M) { mstatus->mprv = 0; }
+  mstatus->mpp = MODE_U;
+  update_mmu_state();
+}
+
 static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
   switch (op) {
 #ifndef CONFIG_MODE_USER
@@ -1322,21 +1356,7 @@ static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
       if (cpu.mode < MODE_M) {
         longjmp_exception(EX_II);
       }
-      mstatus->mie = mstatus->mpie;
-      mstatus->mpie = (ISDEF(CONFIG_DIFFTEST_REF_QEMU) ? 0 // this is bug of QEMU
-          : 1);
-      cpu.mode = mstatus->mpp;
-#ifdef CONFIG_RV_SDTRIG
-      tcontrol->mte = tcontrol->mpte;
-#endif
-#ifdef CONFIG_RVH
-      cpu.v = (mstatus->mpp == MODE_M ? 0 : mstatus->mpv);
-      mstatus->mpv = 0;
-      set_sys_state_flag(SYS_STATE_FLUSH_TCACHE);
-#endif // CONFIG_RVH
-      if (mstatus->mpp != MODE_M) { mstatus->mprv = 0; }
-      mstatus->mpp = MODE_U;
-      update_mmu_state();
+      do_mret_state_update();
       Loge("Executing mret to 0x%lx", mepc->val);
       return mepc->val;
       break;
@@ -1387,6 +1407,7 @@ static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
             longjmp_exception(EX_II);
 #endif // CONFIG_RVH
           mmu_tlb_flush(*src);
+          IFDEF(CONFIG_RV_GUEST_TLB, gtlb_flush(*src, (op & 0x1f) ? reg_l(op & 0x1f) & 0xffff : -1));
           break;
 #ifdef CONFIG_RV_SVINVAL
         case 0x0b: // sinval.vma
@@ -1401,6 +1422,7 @@ static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
             longjmp_exception(EX_II);
 #endif // CONFIG_RVH
           mmu_tlb_flush(*src);
+          IFDEF(CONFIG_RV_GUEST_TLB, gtlb_flush(*src, (op & 0x1f) ? reg_l(op & 0x1f) & 0xffff : -1));
           break;
 #endif // CONFIG_RV_SVINVAL
 #ifdef CONFIG_RVH
@@ -1413,6 +1435,7 @@ static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
           if(cpu.v) longjmp_exception(EX_VI);
           if(!cpu.v && (cpu.mode == MODE_U || (cpu.mode == MODE_S && mstatus->tvm))) longjmp_exception(EX_II);
           mmu_tlb_flush(*src);
+          hosttlb_flush_vmid((op & 0x1f) ? reg_l(op & 0x1f) & 0x3fff : -1); // guest translations can not be found by gpaddr
           break;
 #ifdef CONFIG_RV_SVINVAL
         case 0x13: // hinval.vvma
@@ -1424,6 +1447,7 @@ static word_t priv_instr(uint32_t op, const rtlreg_t *src) {
           if(cpu.v) longjmp_exception(EX_VI);
           if(!cpu.v && (cpu.mode == MODE_U || (cpu.mode == MODE_S && mstatus->tvm))) longjmp_exception(EX_II);
           mmu_tlb_flush(*src);
+          hosttlb_flush_vmid((op & 0x1f) ? reg_l(op & 0x1f) & 0x3fff : -1); // guest translations can not be found by gpaddr
           break;
 #endif // CONFIG_SVINVAL
 #endif // CONFIG_RVH
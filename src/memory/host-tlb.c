@@ -31,10 +31,7 @@ typedef struct {
 } HostTLBEntry;
 
 static HostTLBEntry hosttlb[HOSTTLB_SIZE * 3];
-// dummy_hosttlb_translate assumes that write tlb is right after read tlb by 1*HOSTTLB_SIZE
-static HostTLBEntry* const hostrtlb = &hosttlb[0];
-static HostTLBEntry* const hostwtlb = &hosttlb[HOSTTLB_SIZE];
-static HostTLBEntry* const hostxtlb = &hosttlb[HOSTTLB_SIZE * 2];
+// read, write and ifetch tlbs are placed in turn by HOSTTLB_SIZE
 
 static inline vaddr_t hosttlb_vpn(vaddr_t vaddr) {
   return (vaddr >> PAGE_SHIFT);
@@ -44,21 +41,135 @@ static inline int hosttlb_idx(vaddr_t vaddr) {
   return (hosttlb_vpn(vaddr) % HOSTTLB_SIZE);
 }
 
+#ifdef CONFIG_RVH
+bool has_indirect_two_stage_translation();
+
+// Translations of the guest in V-mode are cached in separate tables with the
+// same layout as hosttlb, one for each of the recently used VMIDs, so that
+// switching between guests keeps their entries.
+#define HOSTVTLB_NR_VMID 4
+
+static HostTLBEntry hostvtlb[HOSTVTLB_NR_VMID][HOSTTLB_SIZE * 3];
+static int hostvtlb_vmid[HOSTVTLB_NR_VMID] = { -1, -1, -1, -1 }; // -1 if the table is free
+static int hostvtlb_victim = 0;
+static int cur_vmid = 0;
+static HostTLBEntry *cur_vtlb = NULL; // the table of cur_vmid, NULL if not selected yet
+
+__attribute__((noinline))
+static HostTLBEntry* hostvtlb_select() {
+  int i;
+  for (i = 0; i < HOSTVTLB_NR_VMID; i ++) {
+    if (hostvtlb_vmid[i] == cur_vmid) return (cur_vtlb = hostvtlb[i]);
+  }
+  for (i = 0; i < HOSTVTLB_NR_VMID && hostvtlb_vmid[i] != -1; i ++);
+  if (i == HOSTVTLB_NR_VMID) {
+    i = hostvtlb_victim;
+    hostvtlb_victim = (hostvtlb_victim + 1) % HOSTVTLB_NR_VMID;
+  }
+  memset(hostvtlb[i], -1, sizeof(hostvtlb[i]));
+  hostvtlb_vmid[i] = cur_vmid;
+  return (cur_vtlb = hostvtlb[i]);
+}
+
+void hosttlb_set_vmid(int vmid) {
+  cur_vmid = vmid;
+  cur_vtlb = NULL;
+}
+
+// drop the guest translations of vmid, or of all the guests if vmid < 0
+void hosttlb_flush_vmid(int vmid) {
+  Logm("hosttlb_flush_vmid %d", vmid);
+  for (int i = 0; i < HOSTVTLB_NR_VMID; i ++) {
+    if (vmid < 0 || hostvtlb_vmid[i] == vmid) hostvtlb_vmid[i] = -1;
+  }
+  cur_vtlb = NULL;
+}
+#endif
+
+// the tables of read, write and ifetch entries for the current virtualization mode
+static inline HostTLBEntry* hosttlb_tables() {
+#ifdef CONFIG_RVH
+  if (cpu.v) return likely(cur_vtlb != NULL) ? cur_vtlb : hostvtlb_select();
+#endif
+  return hosttlb;
+}
+
+static void hosttlb_flush_entry(HostTLBEntry *tlb, vaddr_t vaddr) {
+  vaddr_t gvpn = hosttlb_vpn(vaddr);
+  int idx = hosttlb_idx(vaddr);
+  for (int i = 0; i < 3; i ++) {
+    HostTLBEntry *e = &tlb[i * HOSTTLB_SIZE + idx];
+    if (e->gvpn == gvpn) e->gvpn = (sword_t)-1;
+  }
+}
+
 void hosttlb_flush(vaddr_t vaddr) {
   Logm("hosttlb_flush " FMT_WORD, vaddr);
   if (vaddr == 0) {
     memset(hosttlb, -1, sizeof(hosttlb));
+    IFDEF(CONFIG_RVH, hosttlb_flush_vmid(-1));
   } else {
-    vaddr_t gvpn = hosttlb_vpn(vaddr);
-    int idx = hosttlb_idx(vaddr);
-    if (hostrtlb[idx].gvpn == gvpn) hostrtlb[idx].gvpn = (sword_t)-1;
-    if (hostwtlb[idx].gvpn == gvpn) hostwtlb[idx].gvpn = (sword_t)-1;
-    if (hostxtlb[idx].gvpn == gvpn) hostxtlb[idx].gvpn = (sword_t)-1;
+    hosttlb_flush_entry(hosttlb, vaddr);
+#ifdef CONFIG_RVH
+    for (int i = 0; i < HOSTVTLB_NR_VMID; i ++) {
+      if (hostvtlb_vmid[i] != -1) hosttlb_flush_entry(hostvtlb[i], vaddr);
+    }
+#endif
+  }
+}
+
+// the host address of the guest physical address to cache in an entry, or NULL if it can not be cached
+static inline uint8_t* hosttlb_guest_to_host(paddr_t paddr, bool is_write) {
+#ifdef CONFIG_USE_SPARSEMM
+  // the guest address of a sparse page can not be recovered for the store commit queue
+  if (MUXDEF(CONFIG_DIFFTEST_STORE_COMMIT, is_write, false)) return NULL;
+  return sparse_mem_host_addr(get_sparsemm(), paddr, is_write);
+#else
+  return guest_to_host(paddr);
+#endif
+}
+
+#if defined(CONFIG_TCACHE_INCR_FLUSH) || defined(CONFIG_USE_SPARSEMM)
+static void hosttlb_flush_hpage_in(HostTLBEntry *tlb, int nr_entry, const uint8_t *hpage) {
+  int i;
+  for (i = 0; i < nr_entry; i ++) {
+    HostTLBEntry *e = &tlb[i];
+    if (e->gvpn == (vaddr_t)-1) continue;
+    uint8_t *haddr = e->offset + (e->gvpn << PAGE_SHIFT);
+    if (haddr == hpage) e->gvpn = (sword_t)-1;
   }
 }
 
+// drop the entries to the host page among the nr_entry ones from base of each table
+static void hosttlb_flush_hpage(int base, int nr_entry, const uint8_t *hpage) {
+  hosttlb_flush_hpage_in(&hosttlb[base], nr_entry, hpage);
+#ifdef CONFIG_RVH
+  for (int i = 0; i < HOSTVTLB_NR_VMID; i ++) {
+    if (hostvtlb_vmid[i] != -1) hosttlb_flush_hpage_in(&hostvtlb[i][base], nr_entry, hpage);
+  }
+#endif
+}
+#endif
+
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+// drop the write entries to the guest physical page, so that stores to it take the slowpath
+void hosttlb_flush_wpage(paddr_t paddr) {
+  uint8_t *hpage = hosttlb_guest_to_host(paddr, false);
+  if (hpage != NULL) hosttlb_flush_hpage(HOSTTLB_SIZE, HOSTTLB_SIZE, hpage);
+}
+#endif
+
+#ifdef CONFIG_USE_SPARSEMM
+// a page was allocated, so the read and ifetch entries to the zero page may be stale
+static void hosttlb_flush_zero_page(const uint8_t *zero_page) {
+  Logm("hosttlb_flush_zero_page");
+  hosttlb_flush_hpage(0, HOSTTLB_SIZE * 3, zero_page);
+}
+#endif
+
 void hosttlb_init() {
   hosttlb_flush(0);
+  IFDEF(CONFIG_USE_SPARSEMM, sparse_mem_set_zero_page_hook(get_sparsemm(), hosttlb_flush_zero_page));
 }
 
 static paddr_t va2pa(struct Decode *s, vaddr_t vaddr, int len, int type) {
@@ -76,14 +187,11 @@ static word_t hosttlb_read_slowpath(struct Decode *s, vaddr_t vaddr, int len, in
   paddr_t paddr = va2pa(s, vaddr, len, type);
   word_t data = paddr_read(paddr, len, type, cpu.mode, vaddr);
   if(isa_bmc_check_permission(paddr, len, 0, 0)) {
-    if (likely(in_pmem(paddr))) {
-      HostTLBEntry *e = type == MEM_TYPE_IFETCH ?
-        &hostxtlb[hosttlb_idx(vaddr)] : &hostrtlb[hosttlb_idx(vaddr)];
-      #ifdef CONFIG_USE_SPARSEMM
-      e->offset = (uint8_t *)(paddr - vaddr);
-      #else
-      e->offset = guest_to_host(paddr) - vaddr;
-      #endif
+    uint8_t *haddr = likely(in_pmem(paddr)) ? hosttlb_guest_to_host(paddr, false) : NULL;
+    if (likely(haddr != NULL)) {
+      HostTLBEntry *tlb = hosttlb_tables();
+      HostTLBEntry *e = &tlb[(type == MEM_TYPE_IFETCH ? 2 : 0) * HOSTTLB_SIZE + hosttlb_idx(vaddr)];
+      e->offset = haddr - vaddr;
       e->gvpn = hosttlb_vpn(vaddr);
     }
   }
@@ -96,13 +204,12 @@ static void hosttlb_write_slowpath(struct Decode *s, vaddr_t vaddr, int len, wor
   paddr_t paddr = va2pa(s, vaddr, len, MEM_TYPE_WRITE);
   paddr_write(paddr, len, data, cpu.mode, vaddr);
   if(isa_bmc_check_permission(paddr, len, 0, 0)) {
-    if (likely(in_pmem(paddr))) {
-      HostTLBEntry *e = &hostwtlb[hosttlb_idx(vaddr)];
-      #ifdef CONFIG_USE_SPARSEMM
-      e->offset = (uint8_t *)(paddr - vaddr);
-      #else
-      e->offset = guest_to_host(paddr) - vaddr;
-      #endif
+    // stores to watched pages are checked by paddr_write()
+    uint8_t *haddr = likely(in_pmem(paddr)) IFDEF(CONFIG_TCACHE_INCR_FLUSH, && !tcache_is_code_page(paddr))
+      IFDEF(CONFIG_DEBUG, && !wp_is_watched_page(paddr)) ? hosttlb_guest_to_host(paddr, true) : NULL;
+    if (likely(haddr != NULL)) {
+      HostTLBEntry *e = &hosttlb_tables()[HOSTTLB_SIZE + hosttlb_idx(vaddr)];
+      e->offset = haddr - vaddr;
       e->gvpn = hosttlb_vpn(vaddr);
     }
   }
@@ -111,48 +218,42 @@ static void hosttlb_write_slowpath(struct Decode *s, vaddr_t vaddr, int len, wor
 word_t hosttlb_read(struct Decode *s, vaddr_t vaddr, int len, int type) {
   Logm("hosttlb_reading " FMT_WORD, vaddr);
 #ifdef CONFIG_RVH
-  extern bool has_two_stage_translation();
-  if(has_two_stage_translation()){
+  if(has_indirect_two_stage_translation()){
     paddr_t paddr = va2pa(s, vaddr, len, type);
     return paddr_read(paddr, len, type, cpu.mode, vaddr);
   }
 #endif
   vaddr_t gvpn = hosttlb_vpn(vaddr);
-  HostTLBEntry *e = type == MEM_TYPE_IFETCH ?
-    &hostxtlb[hosttlb_idx(vaddr)] : &hostrtlb[hosttlb_idx(vaddr)];
+  HostTLBEntry *tlb = hosttlb_tables();
+  HostTLBEntry *e = &tlb[(type == MEM_TYPE_IFETCH ? 2 : 0) * HOSTTLB_SIZE + hosttlb_idx(vaddr)];
   if (unlikely(e->gvpn != gvpn)) {
     Logm("Host TLB slow path");
     return hosttlb_read_slowpath(s, vaddr, len, type);
   } else {
     Logm("Host TLB fast path");
-    #ifdef CONFIG_USE_SPARSEMM
-    return sparse_mem_wread(get_sparsemm(), (vaddr_t)e->offset + vaddr, len);
-    #else
     return host_read(e->offset + vaddr, len);
-    #endif
   }
 }
-extern bool has_two_stage_translation();
 
 #ifdef CONFIG_RVV
 void dummy_hosttlb_translate(struct Decode *s, vaddr_t vaddr, int len, bool is_write) {
 #ifdef CONFIG_RVH
-  if(has_two_stage_translation()){
-    // Fast path for guest is not implemented yet
+  if(has_indirect_two_stage_translation()){
+    // Fast path for hypervisor loads/stores is not implemented yet
     return;
   }
 #endif
   vaddr_t gvpn = hosttlb_vpn(vaddr);
 
   // Following loc assumes write tlb is right after read tlb by HOSTTLB_SIZE
-  HostTLBEntry *used_tlb = &hosttlb[is_write * HOSTTLB_SIZE];
+  HostTLBEntry *used_tlb = &hosttlb_tables()[is_write * HOSTTLB_SIZE];
   HostTLBEntry *e = &used_tlb[hosttlb_idx(vaddr)];
   if (unlikely(e->gvpn != gvpn)) {
     // TLB miss, fall back to slow path
     return;
   } else {
     // last_access_host_addr is used to indicate TLB hit and fast path is possible
-    s->last_access_host_addr = e->offset + vaddr;
+    vldst.last_access_host_addr = e->offset + vaddr;
     return;
   }
 }
@@ -160,25 +261,21 @@ void dummy_hosttlb_translate(struct Decode *s, vaddr_t vaddr, int len, bool is_w
 
 void hosttlb_write(struct Decode *s, vaddr_t vaddr, int len, word_t data) {
 #ifdef CONFIG_RVH
-  if(has_two_stage_translation()){
+  if(has_indirect_two_stage_translation()){
     paddr_t paddr = va2pa(s, vaddr, len, MEM_TYPE_WRITE);
     return paddr_write(paddr, len, data, cpu.mode, vaddr);
   }
 #endif
   vaddr_t gvpn = hosttlb_vpn(vaddr);
-  HostTLBEntry *e = &hostwtlb[hosttlb_idx(vaddr)];
+  HostTLBEntry *e = &hosttlb_tables()[HOSTTLB_SIZE + hosttlb_idx(vaddr)];
   if (unlikely(e->gvpn != gvpn)) {
     hosttlb_write_slowpath(s, vaddr, len, data);
     return;
   }
-#ifdef CONFIG_USE_SPARSEMM
-  sparse_mem_wwrite(get_sparsemm(), (vaddr_t)e->offset + vaddr, len, data);
-#else // NOT CONFIG_USE_SPARSEMM
   uint8_t *host_addr = e->offset + vaddr;
 #ifdef CONFIG_DIFFTEST_STORE_COMMIT
   // Also do store commit check with performance optimization enlabled
   store_commit_queue_push(host_to_guest(host_addr), data, len, 0);
 #endif // CONFIG_DIFFTEST_STORE_COMMIT
   host_write(host_addr, len, data);
-#endif // NOT CONFIG_USE_SPARSEMM
 }
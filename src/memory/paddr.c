@@ -42,6 +42,13 @@ unsigned int PMEM_HARTID = 0;
 #include <fcntl.h>
 #include <unistd.h>
 static uint8_t *pmem = NULL;
+#ifdef CONFIG_MEM_COW
+#include <sys/wait.h>
+#include <errno.h>
+#include <memory/host-tlb.h>
+uint64_t *pmem_dirty_map = NULL;
+uint64_t *pmem_snapshot_map = NULL;
+#endif
 #elif CONFIG_ENABLE_MEM_DEDUP
 // When memory deduplication is enabled, the pmem is allocated by DUT
 static uint8_t *pmem = NULL;
@@ -101,6 +108,10 @@ static inline word_t pmem_read(paddr_t addr, int len) {
 }
 
 static inline void pmem_write(paddr_t addr, int len, word_t data, int cross_page_store) {
+  IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(addr, len));
+#ifdef CONFIG_TCACHE_INCR_FLUSH
+  if (unlikely(tcache_is_code_page(addr))) tcache_page_write(addr, len);
+#endif
 #ifdef CONFIG_DIFFTEST_STORE_COMMIT
   store_commit_queue_push(addr, data, len, cross_page_store);
 #endif
@@ -149,7 +160,7 @@ void allocate_memory_with_mmap()
 {
 #ifdef CONFIG_USE_MMAP
   #ifdef CONFIG_USE_SPARSEMM
-  sparse_mm = sparse_mem_new(4, 1024); //4kB
+  sparse_mm = sparse_mem_new(SP_PAGE_SIZE / 1024, 1024);
   #else
   // Note: we are using MAP_FIXED here, in the SHARED mode, even if
   // init_mem may be called multiple times, the memory space will be
@@ -157,12 +168,19 @@ void allocate_memory_with_mmap()
   // See https://man7.org/linux/man-pages/man2/mmap.2.html for details.
   void *pmem_base = (void *)(PMEMBASE + PMEM_HARTID * MEMORY_SIZE);
   void *ret = mmap(pmem_base, MEMORY_SIZE, PROT_READ | PROT_WRITE,
-      MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, -1, 0);
+      MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED IFDEF(CONFIG_MEM_COW, | MAP_NORESERVE), -1, 0);
   if (ret != pmem_base) {
     perror("mmap");
     assert(0);
   }
   pmem = ret;
+  #ifdef CONFIG_MEM_COW
+  free(pmem_dirty_map);
+  free(pmem_snapshot_map);
+  pmem_dirty_map = calloc(((MEMORY_SIZE >> PAGE_SHIFT) + 63) / 64, sizeof(uint64_t));
+  pmem_snapshot_map = calloc(((MEMORY_SIZE >> PAGE_SHIFT) + 63) / 64, sizeof(uint64_t));
+  assert(pmem_dirty_map != NULL && pmem_snapshot_map != NULL);
+  #endif
   #endif
 #endif // CONFIG_USE_MMAP
 }
@@ -191,6 +209,61 @@ void set_pmem(bool pass_pmem_from_dut, uint8_t *_pmem)
 }
 #endif
 
+#ifdef CONFIG_MEM_COW
+void pmem_dirty_clear() {
+  memset(pmem_dirty_map, 0, ((MEMORY_SIZE >> PAGE_SHIFT) + 63) / 64 * sizeof(uint64_t));
+  // stores hitting the host TLB should take the slowpath to mark their pages again
+  hosttlb_flush(0);
+}
+
+void pmem_snapshot_clear() {
+  memset(pmem_snapshot_map, 0, ((MEMORY_SIZE >> PAGE_SHIFT) + 63) / 64 * sizeof(uint64_t));
+  hosttlb_flush(0);
+}
+
+#define SNAPSHOT_ROLLBACK_STATUS 0x5a
+
+static int nr_snapshot_rollback = 0;
+
+int snapshot_take() {
+#ifdef CONFIG_BIN_TRACE
+  // the trace so far is written by this process, and the rest by the forked one
+  extern void bintrace_flush();
+  extern void bintrace_fork_child();
+#endif
+  while (true) {
+    IFDEF(CONFIG_BIN_TRACE, bintrace_flush());
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      IFDEF(CONFIG_BIN_TRACE, bintrace_fork_child());
+      return nr_snapshot_rollback;
+    }
+    Assert(pid > 0, "fork() fails to take a snapshot: %s", strerror(errno));
+    // this process keeps the snapshot until the forked one finishes or rolls back
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+      Assert(errno == EINTR, "waitpid() fails: %s", strerror(errno));
+    }
+    if (WIFEXITED(status) && WEXITSTATUS(status) == SNAPSHOT_ROLLBACK_STATUS) {
+      nr_snapshot_rollback ++;
+      continue;
+    }
+    exit(WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE);
+  }
+}
+
+void snapshot_rollback() {
+#ifdef CONFIG_BIN_TRACE
+  // the trace keeps the instructions rolled back
+  extern void bintrace_flush();
+  bintrace_flush();
+#endif
+  fflush(NULL);
+  _exit(SNAPSHOT_ROLLBACK_STATUS);
+}
+#endif
+
 /* Memory accessing interfaces */
 
 bool check_paddr(paddr_t addr, int len, int type, int mode, vaddr_t vaddr) {
@@ -331,6 +404,7 @@ void paddr_write(paddr_t addr, int len, word_t data, int mode, vaddr_t vaddr) {
   if (!check_paddr(addr, len, MEM_TYPE_WRITE, mode, vaddr)) {
     return;
   }
+  IFDEF(CONFIG_DEBUG, wp_store(addr, len));
 #ifndef CONFIG_SHARE
   if (likely(in_pmem(addr))) pmem_write(addr, len, data, cross_page_store);
   else {
@@ -360,6 +434,21 @@ void paddr_write(paddr_t addr, int len, word_t data, int mode, vaddr_t vaddr) {
 #endif
 }
 
+void paddr_dma_write(paddr_t addr, size_t len, const void *buf) {
+  if (len == 0) return;
+  Assert(in_pmem(addr) && in_pmem(addr + len - 1),
+      "DMA write to [" FMT_PADDR ", " FMT_PADDR ") out of pmem", addr, (paddr_t)(addr + len));
+  IFDEF(CONFIG_DEBUG, wp_store(addr, len));
+#ifdef CONFIG_USE_SPARSEMM
+  sparse_mem_write(sparse_mm, addr, len, buf);
+#else
+  memcpy(guest_to_host(addr), buf, len);
+  IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(addr, len));
+#endif
+  // the stores of a device do not go through pmem_write()
+  IFDEF(CONFIG_TCACHE_INCR_FLUSH, tcache_page_write(addr, len));
+}
+
 #ifdef CONFIG_MEMORY_REGION_ANALYSIS
 bool mem_addr_use[PROGRAM_ANALYSIS_PAGES];
 char *memory_region_record_file = NULL;
@@ -540,6 +629,13 @@ int check_store_commit(uint64_t *addr, uint64_t *data, uint8_t *mask) {
   return result;
 }
 
+int check_store_commit_batch(uint64_t *addr, uint64_t *data, uint8_t *mask, int n) {
+  for (int i = 0; i < n; i ++) {
+    if (check_store_commit(&addr[i], &data[i], &mask[i])) return i;
+  }
+  return n;
+}
+
 #endif
 
 char *mem_dump_file = NULL;
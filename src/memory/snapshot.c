@@ -0,0 +1,338 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+/*
+ * Snapshot files saved and loaded by the monitor. A snapshot is a gzip stream of
+ *   - a header, with the path of the parent snapshot for an incremental one
+ *   - CPU_state and the state registered by snapshot_add_state(), each with its
+ *     name and size, ended by an empty name
+ *   - pages of pmem, each an index followed by its contents, ended by
+ *     SNAPSHOT_PAGE_END. An index with SNAPSHOT_PAGE_ZERO has no contents.
+ * A full snapshot holds the nonzero pages. An incremental one holds the pages
+ * written since its parent, which pmem_snapshot_map of CONFIG_MEM_COW tells.
+ */
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
+#include <stdlib.h>
+
+#define NR_SNAPSHOT_STATE 32
+
+typedef struct {
+  char name[32];
+  void *addr;
+  size_t size;
+  void (*loaded)();
+} SnapshotState;
+
+static SnapshotState states[NR_SNAPSHOT_STATE];
+static int nr_state = 0;
+
+void snapshot_add_state(const char *name, void *addr, size_t size, void (*loaded)()) {
+  int i;
+  for (i = 0; i < nr_state; i ++) {
+    if (strcmp(states[i].name, name) == 0) break;
+  }
+  if (i == nr_state) {
+    Assert(nr_state < NR_SNAPSHOT_STATE, "Too many states for snapshots");
+    Assert(strlen(name) < sizeof(states[i].name), "Name of snapshot state '%s' is too long", name);
+    strcpy(states[i].name, name);
+    nr_state ++;
+  }
+  // a state registered again, e.g. after new_space(), replaces the old one
+  states[i].addr = addr;
+  states[i].size = size;
+  states[i].loaded = loaded;
+}
+
+#ifndef CONFIG_SHARE
+#include <limits.h>
+#include <signal.h>
+#include <zlib.h>
+
+#define SNAPSHOT_MAGIC "NEMUSNP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_CHAIN 1024
+#define SNAPSHOT_PAGE_ZERO (1ul << 63)
+#define SNAPSHOT_PAGE_END  (~0ul)
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint64_t mem_base;
+  uint64_t mem_size;
+  char parent[PATH_MAX]; // absolute path, empty for a full snapshot
+} SnapshotHeader;
+
+// the snapshot pmem was saved to or loaded from, the parent of the next one
+static char last_snapshot[PATH_MAX] = "";
+
+static inline bool page_is_zero(const uint8_t *p) {
+  return p[0] == 0 && memcmp(p, p + 1, PAGE_SIZE - 1) == 0;
+}
+
+static void snap_write(gzFile fp, const void *buf, size_t size, const char *path) {
+  Assert(gzwrite(fp, buf, size) == size, "Write failed on snapshot '%s'", path);
+}
+
+static void snap_read(gzFile fp, void *buf, size_t size, const char *path) {
+  Assert(gzread(fp, buf, size) == size, "Snapshot '%s' is truncated", path);
+}
+
+static void snap_write_state(gzFile fp, const char *name, const void *addr, uint64_t size, const char *path) {
+  char buf[sizeof(states[0].name)] = {};
+  strcpy(buf, name);
+  snap_write(fp, buf, sizeof(buf), path);
+  snap_write(fp, &size, sizeof(size), path);
+  snap_write(fp, addr, size, path);
+}
+
+static void snap_write_page(gzFile fp, uint64_t idx, const char *path) {
+  const uint8_t *page = guest_to_host(CONFIG_MBASE) + idx * PAGE_SIZE;
+  if (page_is_zero(page)) {
+    idx |= SNAPSHOT_PAGE_ZERO;
+    snap_write(fp, &idx, sizeof(idx), path);
+  } else {
+    snap_write(fp, &idx, sizeof(idx), path);
+    snap_write(fp, page, PAGE_SIZE, path);
+  }
+}
+
+// Return whether the chain of the last snapshot can be read up to a full
+// snapshot without passing target, which is about to be overwritten.
+static bool snap_chain_ok(const char *target) {
+  static char cur[PATH_MAX];
+  SnapshotHeader *h = malloc(sizeof(SnapshotHeader));
+  strcpy(cur, last_snapshot);
+  bool ok = false;
+  int depth;
+  for (depth = 0; depth < SNAPSHOT_MAX_CHAIN; depth ++) {
+    if (target != NULL && strcmp(cur, target) == 0) break;
+    gzFile fp = gzopen(cur, "rb");
+    if (fp == NULL) break;
+    bool valid = gzread(fp, h, sizeof(*h)) == sizeof(*h) &&
+      memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) == 0 && h->version == SNAPSHOT_VERSION;
+    gzclose(fp);
+    if (!valid) break;
+    if (h->parent[sizeof(h->parent) - 1] != '\0') break;
+    if (h->parent[0] == '\0') {
+      ok = true;
+      break;
+    }
+    strcpy(cur, h->parent);
+  }
+  free(h);
+  return ok;
+}
+
+void snapshot_save(const char *path, bool full) {
+  IFDEF(CONFIG_USE_SPARSEMM, panic("Snapshots of sparse memory are not supported"));
+  SnapshotHeader *h = calloc(1, sizeof(SnapshotHeader));
+  memcpy(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic));
+  h->version = SNAPSHOT_VERSION;
+  h->page_size = PAGE_SIZE;
+  h->mem_base = CONFIG_MBASE;
+  h->mem_size = MEMORY_SIZE;
+  // An incremental snapshot needs the pages written since its parent, so it
+  // is full if path is the parent or one of its ancestors.
+  bool incr = ISDEF(CONFIG_MEM_COW) && !full && last_snapshot[0] != '\0';
+  if (incr) {
+    char *target = realpath(path, NULL);
+    incr = snap_chain_ok(target);
+    if (!incr) Log("Save a full snapshot to %s, which is the last snapshot or one it depends on, "
+        "or one of them is unreadable", path);
+    free(target);
+  }
+  if (incr) strcpy(h->parent, last_snapshot);
+
+  // written to a temporary file first, so a failed save leaves the old file
+  char *tmp_path = malloc(strlen(path) + sizeof(".tmp"));
+  sprintf(tmp_path, "%s.tmp", path);
+  gzFile fp = gzopen(tmp_path, "wb1");
+  Assert(fp, "Can not open '%s'", tmp_path);
+  snap_write(fp, h, sizeof(*h), path);
+
+  snap_write_state(fp, "cpu", &cpu, sizeof(cpu), path);
+  int i;
+  for (i = 0; i < nr_state; i ++) {
+    snap_write_state(fp, states[i].name, states[i].addr, states[i].size, path);
+  }
+  snap_write_state(fp, "", NULL, 0, path);
+
+  uint64_t nr_page = MEMORY_SIZE / PAGE_SIZE, nr_saved = 0, idx;
+  for (idx = 0; idx < nr_page; idx ++) {
+#ifdef CONFIG_MEM_COW
+    if (incr) {
+      if (pmem_snapshot_map[idx / 64] == 0) {
+        idx |= 63;
+        continue;
+      }
+      if (!((pmem_snapshot_map[idx / 64] >> (idx % 64)) & 1)) continue;
+      snap_write_page(fp, idx, path);
+      nr_saved ++;
+      continue;
+    }
+#endif
+    if (!page_is_zero(guest_to_host(CONFIG_MBASE) + idx * PAGE_SIZE)) {
+      snap_write_page(fp, idx, path);
+      nr_saved ++;
+    }
+  }
+  idx = SNAPSHOT_PAGE_END;
+  snap_write(fp, &idx, sizeof(idx), path);
+  Assert(gzclose(fp) == Z_OK, "Write failed on snapshot '%s'", path);
+  Assert(rename(tmp_path, path) == 0, "Can not rename '%s' to '%s'", tmp_path, path);
+  free(tmp_path);
+
+  Assert(realpath(path, last_snapshot) != NULL, "Can not resolve '%s'", path);
+  IFDEF(CONFIG_MEM_COW, pmem_snapshot_clear());
+  Log("Saved %s snapshot %s with %lu pages", incr ? "incremental" : "full", path, nr_saved);
+  free(h);
+}
+
+static gzFile snap_open(const char *path, SnapshotHeader *h) {
+  gzFile fp = gzopen(path, "rb");
+  Assert(fp, "Can not open '%s'", path);
+  gzbuffer(fp, 1 << 20);
+  snap_read(fp, h, sizeof(*h), path);
+  Assert(memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) == 0, "'%s' is not a snapshot", path);
+  Assert(h->version == SNAPSHOT_VERSION, "Snapshot '%s' has version %u, but %u is supported",
+      path, h->version, SNAPSHOT_VERSION);
+  Assert(h->page_size == PAGE_SIZE && h->mem_base == CONFIG_MBASE && h->mem_size == MEMORY_SIZE,
+      "Snapshot '%s' has a different memory layout", path);
+  return fp;
+}
+
+// read the state into the registered places, or skip it
+static void snap_load_state(gzFile fp, bool load, const char *path) {
+  while (true) {
+    char name[sizeof(states[0].name)];
+    uint64_t size;
+    snap_read(fp, name, sizeof(name), path);
+    snap_read(fp, &size, sizeof(size), path);
+    if (name[0] == '\0') return;
+
+    void *addr = NULL;
+    if (load && strcmp(name, "cpu") == 0) {
+      Assert(size == sizeof(cpu), "Snapshot '%s' has a CPU_state of %lu bytes", path, size);
+      addr = &cpu;
+    } else if (load) {
+      int i;
+      for (i = 0; i < nr_state && strcmp(states[i].name, name) != 0; i ++);
+      if (i == nr_state) {
+        Log("Ignore the state '%s' not found in this build", name);
+      } else {
+        Assert(size == states[i].size, "State '%s' of snapshot '%s' has %lu bytes instead of %lu",
+            name, path, size, states[i].size);
+        addr = states[i].addr;
+      }
+    }
+    if (addr != NULL) {
+      snap_read(fp, addr, size, path);
+    } else {
+      Assert(gzseek(fp, size, SEEK_CUR) >= 0, "Snapshot '%s' is truncated", path);
+    }
+  }
+}
+
+void snapshot_load(const char *path) {
+  IFDEF(CONFIG_USE_SPARSEMM, panic("Snapshots of sparse memory are not supported"));
+  SnapshotHeader *h = malloc(sizeof(SnapshotHeader));
+  uint64_t nr_page = MEMORY_SIZE / PAGE_SIZE;
+  uint64_t *loaded = calloc((nr_page + 63) / 64, sizeof(uint64_t));
+  uint8_t *pmem_base = guest_to_host(CONFIG_MBASE);
+  uint64_t nr_loaded = 0, nr_zeroed = 0;
+
+  // the alarm updates device registers, e.g. mtime, which must stay as loaded
+  // until the loaded() hooks are called
+  sigset_t alarm_set, old_set;
+  sigemptyset(&alarm_set);
+  sigaddset(&alarm_set, SIGVTALRM);
+  sigprocmask(SIG_BLOCK, &alarm_set, &old_set);
+
+  // From the snapshot to its root, a page is loaded from the first one holding it.
+  char cur[PATH_MAX];
+  strcpy(cur, path);
+  int depth;
+  for (depth = 0; cur[0] != '\0'; depth ++) {
+    Assert(depth < SNAPSHOT_MAX_CHAIN, "Too many parents of snapshot '%s'", path);
+    gzFile fp = snap_open(cur, h);
+    snap_load_state(fp, depth == 0, cur);
+    while (true) {
+      uint64_t idx;
+      snap_read(fp, &idx, sizeof(idx), cur);
+      if (idx == SNAPSHOT_PAGE_END) break;
+      bool is_zero = (idx & SNAPSHOT_PAGE_ZERO) != 0;
+      idx &= ~SNAPSHOT_PAGE_ZERO;
+      Assert(idx < nr_page, "Snapshot '%s' has a page out of pmem", cur);
+      uint8_t *page = pmem_base + idx * PAGE_SIZE;
+      bool is_loaded = (loaded[idx / 64] >> (idx % 64)) & 1;
+      loaded[idx / 64] |= 1ul << (idx % 64);
+      if (is_zero) {
+        if (!is_loaded && !page_is_zero(page)) memset(page, 0, PAGE_SIZE);
+      } else if (is_loaded) {
+        Assert(gzseek(fp, PAGE_SIZE, SEEK_CUR) >= 0, "Snapshot '%s' is truncated", cur);
+      } else {
+        snap_read(fp, page, PAGE_SIZE, cur);
+        nr_loaded ++;
+      }
+    }
+    gzclose(fp);
+    strcpy(cur, h->parent);
+  }
+
+  // pages in none of the snapshots are zero, so those untouched are not written
+  uint64_t idx;
+  for (idx = 0; idx < nr_page; idx ++) {
+    if ((loaded[idx / 64] >> (idx % 64)) & 1) continue;
+    uint8_t *page = pmem_base + idx * PAGE_SIZE;
+    if (!page_is_zero(page)) {
+      memset(page, 0, PAGE_SIZE);
+      loaded[idx / 64] |= 1ul << (idx % 64);
+      nr_zeroed ++;
+    }
+  }
+
+#ifdef CONFIG_MEM_COW
+  // the pages may be written, so the next checkpoint has to check them
+  for (idx = 0; idx < nr_page; idx ++) {
+    if ((loaded[idx / 64] >> (idx % 64)) & 1) pmem_dirty_mark(CONFIG_MBASE + idx * PAGE_SIZE, PAGE_SIZE);
+  }
+  pmem_snapshot_clear();
+#endif
+  Assert(realpath(path, last_snapshot) != NULL, "Can not resolve '%s'", path);
+
+  int i;
+  for (i = 0; i < nr_state; i ++) {
+    if (states[i].loaded != NULL) states[i].loaded();
+  }
+  sigprocmask(SIG_SETMASK, &old_set, NULL);
+  // the cached translations and decoded instructions are stale
+  mmu_tlb_flush(0);
+#ifdef CONFIG_PERF_OPT
+  // go on running from the loaded pc rather than the next instruction in the tcache
+  extern struct Decode *tcache_handle_flush(vaddr_t snpc);
+  if (get_last_decode() != NULL) tcache_handle_flush(cpu.pc);
+#endif
+
+  Log("Loaded snapshot %s from %d file(s): %lu pages loaded, %lu pages zeroed",
+      path, depth, nr_loaded, nr_zeroed);
+  free(loaded);
+  free(h);
+}
+#endif
@@ -1,4 +1,5 @@
 #include <memory/sparseram.h>
+#include <memory/vaddr.h>
 
 #ifndef __cplusplus
 #endif
@@ -17,6 +18,7 @@
 #include <map>
 #include <memory>
 #include <cerrno>
+#include <algorithm>
 
 /*******************************************Comm Functions****************************************************************/
 
@@ -382,78 +384,127 @@ int file_is_elf(const char *fn){
 
 /*******************************************SparseRam Define****************************************************************/
 
+// the host TLB caches the host address of a block as the one of a guest page
+static_assert(SP_PAGE_SIZE == PAGE_SIZE, "a block of SparseRam must be a guest page");
+
+alignas(SP_PAGE_SIZE) const u_int8_t SparseRam::zero_page[SP_PAGE_SIZE] = {};
+
+SparseRam::SparseRam(u_int block_count, u_int chunk_size)
+{
+  // the block size is SP_PAGE_SIZE, see sparse_mem_new()
+  this->block_size = block_count * chunk_size;
+  this->root = (sp_pg_dir **)calloc(1ul << SP_ROOT_BITS, sizeof(sp_pg_dir *));
+  DEBUG("init SparseRam with block_size= %.2f kB (chunk_size=%d)", float(this->block_size)/1024.0, chunk_size);
+}
+
 SparseRam::~SparseRam()
 {
-  for (auto iter = this->mem.begin(); iter != this->mem.end(); iter++)
+  for (size_t i = 0; i < (1ul << SP_ROOT_BITS); i++)
   {
-    free(iter->second);
+    auto dir = this->root[i];
+    if (dir == NULL) continue;
+    for (size_t j = 0; j < (1ul << SP_DIR_BITS); j++)
+    {
+      auto tbl = (*dir)[j];
+      if (tbl == NULL) continue;
+      for (size_t k = 0; k < (1ul << SP_TBL_BITS); k++)
+      {
+        free((*tbl)[k]);
+      }
+      free(tbl);
+    }
+    free(dir);
   }
+  free(this->root);
   for (auto iter = this->big_block.begin(); iter != this->big_block.end(); iter++){
     free(iter->second->blk);
     free(iter->second);
   }
-  this->mem.clear();
-  this->cache.clear();
   this->big_block.clear();
 }
 
-void SparseRam::__update_cache(paddr_t index, u_int8_t *m)
+u_int8_t *SparseRam::_page_find(paddr_t pn)
 {
-
-  paddr_t big_index = 0;
-  u_long big_time = 0;
-
-  for (auto c = this->cache.begin(); c != this->cache.end(); c++)
+  if (likely(pn == this->last_pn))
   {
-    auto tdata = c->second;
-    auto c_mem = std::get<0>(tdata);
-    auto c_tim = std::get<1>(tdata);
-    if (c_tim > big_time)
-    {
-      big_time = c_tim;
-      big_index = c->first;
-    }
-    std::tuple<u_int8_t *, u_long> ndata = std::make_tuple(c_mem, c_tim + 1);
-    c->second = ndata;
+    return this->last_page;
   }
-
-  std::tuple<u_int8_t *, u_long> a = std::make_tuple(m, 1);
-  this->cache[index] = a;
-
-  if (this->cache.size() < this->max_cache_size)
+  auto ri = pn >> (SP_DIR_BITS + SP_TBL_BITS);
+  if (unlikely(ri >= (1ul << SP_ROOT_BITS)))
   {
-    return;
+    return NULL;
+  }
+  auto dir = this->root[ri];
+  if (dir == NULL)
+  {
+    return NULL;
+  }
+  auto tbl = (*dir)[(pn >> SP_TBL_BITS) & ((1ul << SP_DIR_BITS) - 1)];
+  if (tbl == NULL)
+  {
+    return NULL;
   }
-  // need replace: remove biggest tim
-  vassert(big_index != 0, "find oldest item fail!");
-  cache.erase(big_index);
+  auto page = (*tbl)[pn & ((1ul << SP_TBL_BITS) - 1)];
+  if (page != NULL)
+  {
+    this->last_pn = pn;
+    this->last_page = page;
+  }
+  return page;
 }
 
-bool SparseRam::_fast_count(paddr_t index)
+u_int8_t *SparseRam::_page_alloc(paddr_t pn)
 {
-  if (this->cache.count(index))
+  auto page = this->_page_find(pn);
+  if (likely(page != NULL))
   {
-    return true;
+    return page;
+  }
+  auto ri = pn >> (SP_DIR_BITS + SP_TBL_BITS);
+  vassert(ri < (1ul << SP_ROOT_BITS), sfmt("address 0x%lx out of range", pn << SP_PAGE_SHIFT));
+  auto &dir = this->root[ri];
+  if (dir == NULL)
+  {
+    dir = (sp_pg_dir *)calloc(1, sizeof(sp_pg_dir));
+  }
+  auto &tbl = (*dir)[(pn >> SP_TBL_BITS) & ((1ul << SP_DIR_BITS) - 1)];
+  if (tbl == NULL)
+  {
+    tbl = (sp_pg_tbl *)calloc(1, sizeof(sp_pg_tbl));
   }
-  // miss
-  auto ret = this->mem.count(index);
-  if (ret)
+  page = (u_int8_t *)calloc(SP_PAGE_SIZE, sizeof(u_int8_t));
+  (*tbl)[pn & ((1ul << SP_TBL_BITS) - 1)] = page;
+  this->nr_pages++;
+  if (this->zero_page_lent)
   {
-    this->__update_cache(index, this->mem[index]);
+    this->zero_page_lent = false;
+    this->zero_page_hook(zero_page);
   }
-  return ret;
+  this->last_pn = pn;
+  this->last_page = page;
+  return page;
 }
 
-u_int8_t *SparseRam::_fast_mem(paddr_t index)
+void SparseRam::_page_foreach(std::function<void (paddr_t addr, u_int8_t *page)> handler)
 {
-  if (this->cache.count(index))
+  // visit the pages in the order of their addresses
+  for (size_t i = 0; i < (1ul << SP_ROOT_BITS); i++)
   {
-    return std::get<0>(this->cache[index]);
+    auto dir = this->root[i];
+    if (dir == NULL) continue;
+    for (size_t j = 0; j < (1ul << SP_DIR_BITS); j++)
+    {
+      auto tbl = (*dir)[j];
+      if (tbl == NULL) continue;
+      for (size_t k = 0; k < (1ul << SP_TBL_BITS); k++)
+      {
+        auto page = (*tbl)[k];
+        if (page == NULL) continue;
+        paddr_t pn = (((i << SP_DIR_BITS) | j) << SP_TBL_BITS) | k;
+        handler(pn << SP_PAGE_SHIFT, page);
+      }
+    }
   }
-  // miss
-  auto ret = this->mem[index];
-  __update_cache(index, ret);
-  return ret;
 }
 
 bool SparseRam::load_bin(const char *file, paddr_t addr)
@@ -493,48 +544,28 @@ void SparseRam::read(paddr_t addr, size_t len, void *bytes)
     return;
   }
 
-  auto index_start = addr / this->block_size;
-  auto offst_start = addr % this->block_size;
-  auto offst_end = offst_start + len;
-  auto index_count = 1;
-  auto lenrm = len - (this->block_size - offst_start);
-
-  if (unlikely(lenrm > 0))
+  auto buff = (u_int8_t *)bytes;
+  while (len > 0)
   {
-    offst_end = lenrm % this->block_size;
-    index_count += lenrm / this->block_size;
-    if (likely(offst_end != 0))
+    auto offset = addr & SP_PAGE_MASK;
+    auto size = std::min(len, SP_PAGE_SIZE - offset);
+    auto page = this->_page_find(addr >> SP_PAGE_SHIFT);
+    if (page == NULL)
     {
-      index_count += 1;
+      memset(buff, 0, size);
     }
-  }
-
-  auto i = 0;
-  auto buff = (u_int8_t *)bytes;
-  for (auto idx = 0; idx < index_count; idx++)
-  {
-    auto base = index_start + idx;
-    auto empt = !this->_fast_count(base);
-    auto of_start = idx == 0 ? offst_start : 0;
-    auto of_end = idx == index_count - 1 ? offst_end : this->block_size;
-    for (auto p = of_start; p < of_end; p++)
+    else
     {
-      buff[i] = empt ? 0 : this->_fast_mem(base)[p];
-      i += 1;
+      memcpy(buff, page + offset, size);
     }
+    addr += size;
+    buff += size;
+    len -= size;
   }
 }
 
 void SparseRam::write(paddr_t addr, size_t len, const void *bytes)
 {
-  /*
-           start(0)                            end
-             |      end-start=block_size        |
-   Block 1:  ----------------...-----------------
-   Block 2:  ----------------...-----------------
-   Block N-1:
-   Block N:  ----------------...-----------------
-   */
   if (len <= 0)
   {
     return;
@@ -543,43 +574,20 @@ void SparseRam::write(paddr_t addr, size_t len, const void *bytes)
     return;
   }
 
-  auto index_start = addr / this->block_size;
-  auto offst_start = addr % this->block_size;
-  auto offst_end = offst_start + len;
-  auto lenrm = len - (this->block_size - offst_start);
-  auto index_count = 1;
-
-  if (unlikely(lenrm > 0))
-  {
-    offst_end = lenrm % this->block_size;
-    index_count += lenrm / this->block_size;
-    if (likely(offst_end != 0))
-    {
-      index_count += 1;
-    }
-  }
-
-  auto i = 0;
-  auto buff = (u_int8_t *)bytes;
-  for (auto idx = 0; idx < index_count; idx++)
+  auto buff = (const u_int8_t *)bytes;
+  while (len > 0)
   {
-    auto base = index_start + idx;
-    if (unlikely(!this->_fast_count(base)))
-    {
-      this->mem[base] = (u_int8_t *)calloc(this->block_size, sizeof(u_int8_t));
-    }
-    auto of_start = idx == 0 ? offst_start : 0;
-    auto of_end = idx == index_count - 1 ? offst_end : this->block_size;
-    for (auto p = of_start; p < of_end; p++)
-    {
-      this->_fast_mem(base)[p] = buff[i];
-      i += 1;
-    }
+    auto offset = addr & SP_PAGE_MASK;
+    auto size = std::min(len, SP_PAGE_SIZE - offset);
+    memcpy(this->_page_alloc(addr >> SP_PAGE_SHIFT) + offset, buff, size);
+    addr += size;
+    buff += size;
+    len -= size;
   }
 }
 
 bool SparseRam::add_blk(char *name, paddr_t start, paddr_t end){
-  vassert(this->mem.empty(), "should first init big_blocks. not write mem");
+  vassert(this->nr_pages == 0, "should first init big_blocks. not write mem");
   vassert(end > start, "big_block size need > 0");
   auto blk_name = std::string(name);
   vassert(!this->big_block.count(blk_name), "big_block is existed");
@@ -607,7 +615,7 @@ SparseRam::sp_mm_blk *SparseRam::_blk_find(paddr_t addr){
   for(auto b = this->big_block.begin(); b != this->big_block.end(); b++){
     auto start = b->second->start;
     auto end = b->second->end;
-    if (start < addr && addr < end){
+    if (start <= addr && addr < end){
       return b->second;
     }
   }
@@ -634,35 +642,90 @@ bool SparseRam::_blk_write(paddr_t addr, size_t len, const void* bytes){
   return true;
 }
 
-word_t SparseRam::read(paddr_t addr, int len)
+static inline word_t word_load(const u_int8_t *p, int len)
 {
-  vassert(len <= 8, "len error");
-  u_int8_t buff[8];
-  this->read(addr, 8, (void *)buff);
-
   switch (len) {
-    case 1: return *(uint8_t  *)buff;
-    case 2: return *(uint16_t *)buff;
-    case 4: return *(uint32_t *)buff;
-    IFDEF(CONFIG_ISA64, case 8: return *(uint64_t *)buff);
+    case 1: return *(uint8_t  *)p;
+    case 2: return *(uint16_t *)p;
+    case 4: return *(uint32_t *)p;
+    IFDEF(CONFIG_ISA64, case 8: return *(uint64_t *)p);
     default: MUXDEF(CONFIG_RT_CHECK, assert(0), return 0);
   }
   vassert(0, "size error");
   return 0;
 }
 
-void SparseRam::write(paddr_t addr, int len, word_t data)
+static inline void word_store(u_int8_t *p, int len, word_t data)
 {
-  vassert(len <= 8, "len error");
-  u_int8_t buff[8] = {0};
   switch (len) {
-    case 1: *(uint8_t  *)buff = data; break;
-    case 2: *(uint16_t *)buff = data; break;
-    case 4: *(uint32_t *)buff = data; break;
-    IFDEF(CONFIG_ISA64, case 8: *(uint64_t *)buff = data; break);
+    case 1: *(uint8_t  *)p = data; return;
+    case 2: *(uint16_t *)p = data; return;
+    case 4: *(uint32_t *)p = data; return;
+    IFDEF(CONFIG_ISA64, case 8: *(uint64_t *)p = data; return);
     IFDEF(CONFIG_RT_CHECK, default: assert(0));
   }
-  return this->write(addr, len, (const void *)buff);
+}
+
+word_t SparseRam::read(paddr_t addr, int len)
+{
+  vassert(len <= 8, "len error");
+  auto offset = addr & SP_PAGE_MASK;
+  if (unlikely(offset + len > SP_PAGE_SIZE || (!this->big_block.empty() && this->_blk_find(addr))))
+  {
+    u_int8_t buff[8];
+    this->read(addr, (size_t)len, (void *)buff);
+    return word_load(buff, len);
+  }
+  auto page = this->_page_find(addr >> SP_PAGE_SHIFT);
+  return page == NULL ? 0 : word_load(page + offset, len);
+}
+
+void SparseRam::write(paddr_t addr, int len, word_t data)
+{
+  vassert(len <= 8, "len error");
+  auto offset = addr & SP_PAGE_MASK;
+  if (unlikely(offset + len > SP_PAGE_SIZE || (!this->big_block.empty() && this->_blk_find(addr))))
+  {
+    u_int8_t buff[8];
+    word_store(buff, len, data);
+    return this->write(addr, (size_t)len, (const void *)buff);
+  }
+  word_store(this->_page_alloc(addr >> SP_PAGE_SHIFT) + offset, len, data);
+}
+
+u_int8_t *SparseRam::host_addr(paddr_t addr, bool write)
+{
+  // a page is never moved once allocated, so the returned address stays valid
+  if (unlikely(!this->big_block.empty()))
+  {
+    auto blk = this->_blk_find(addr);
+    if (blk != NULL)
+    {
+      auto pg = addr & ~SP_PAGE_MASK;
+      auto inside = blk->start <= pg && pg + SP_PAGE_SIZE <= blk->end;
+      return inside ? blk->blk + (addr - blk->start) : NULL;
+    }
+  }
+  if (write)
+  {
+    return this->_page_alloc(addr >> SP_PAGE_SHIFT) + (addr & SP_PAGE_MASK);
+  }
+  auto page = this->_page_find(addr >> SP_PAGE_SHIFT);
+  if (page == NULL)
+  {
+    if (this->zero_page_hook == NULL)
+    {
+      return NULL;
+    }
+    this->zero_page_lent = true;
+    page = (u_int8_t *)zero_page;
+  }
+  return page + (addr & SP_PAGE_MASK);
+}
+
+void SparseRam::set_zero_page_hook(zero_page_hook_func hook)
+{
+  this->zero_page_hook = hook;
 }
 
 endianness_t SparseRam::get_target_endianness()
@@ -672,12 +735,9 @@ endianness_t SparseRam::get_target_endianness()
 
 void SparseRam::copy_nzero_bytes(copy_mem_func copy_handler)
 {
-  for (auto iter = this->mem.begin(); iter != this->mem.end(); iter++)
-  {
-    auto addr = iter->first * this->block_size;
-    auto buff = iter->second;
+  this->_page_foreach([&](paddr_t addr, u_int8_t *buff){
     u_int astart = 0;
-    for (u_int i = 0; i < this->block_size; i++)
+    for (u_int i = 0; i < SP_PAGE_SIZE; i++)
     {
       if (buff[i] == 0)
       {
@@ -689,11 +749,11 @@ void SparseRam::copy_nzero_bytes(copy_mem_func copy_handler)
         astart = i + 1;
       }
     }
-    if (astart < this->block_size)
+    if (astart < SP_PAGE_SIZE)
     {
-      copy_handler(addr + astart, this->block_size - astart, &buff[astart]);
+      copy_handler(addr + astart, SP_PAGE_SIZE - astart, &buff[astart]);
     }
-  }
+  });
 }
 
 void SparseRam::copy(SparseRam *dst) {
@@ -726,18 +786,15 @@ void SparseRam::copy_bytes(copy_mem_func copy_handler)
     copy_handler(sbk->start, sbk->end - sbk->start, sbk->blk);
   }
   // copy norm mem
-  for (auto iter = this->mem.begin(); iter != this->mem.end(); iter++)
-  {
-    auto addr = iter->first * this->block_size;
-    auto buff = iter->second;
-    copy_handler(addr, this->block_size, buff);
-  }
+  this->_page_foreach([&](paddr_t addr, u_int8_t *buff){
+    copy_handler(addr, SP_PAGE_SIZE, buff);
+  });
 }
 
 void SparseRam::print_info()
 {
   OUTPUT(stderr, "SpRam blocks: %ld, size: %.2f MB\n", 
-         this->mem.size(), float(this->mem.size() * this->block_size) / (1024.0 * 1024.0));
+         this->nr_pages, float(this->nr_pages * SP_PAGE_SIZE) / (1024.0 * 1024.0));
 }
 
 /*******************************************Export CAPIs****************************************************************/
@@ -799,6 +856,16 @@ void* sparse_mem_blk_get(void *self, char *name){
   return m->blk_host_addr(name);
 }
 
+u_int8_t* sparse_mem_host_addr(void *self, paddr_t addr, int write){
+  auto m = (SparseRam *)self;
+  return m->host_addr(addr, write);
+}
+
+void sparse_mem_set_zero_page_hook(void *self, zero_page_hook_func hook){
+  auto m = (SparseRam *)self;
+  m->set_zero_page_hook(hook);
+}
+
 int sparse_mem_blk_add(void *self, char *name, paddr_t start, paddr_t end){
   auto m = (SparseRam *)self;
   if(m->add_blk(name, start, end)){
@@ -1,35 +1,46 @@
 #include <memory/store_queue_wrapper.h>
+#include <cstdlib>
 
 #ifdef CONFIG_DIFFTEST_STORE_COMMIT
 
-#include <queue>
-
-std::queue<store_commit_t> cpp_store_event_queue;
-
-void store_queue_push(store_commit_t store_commit) {
-  cpp_store_event_queue.push(store_commit);
-}
-
-void store_queue_pop() {
-  cpp_store_event_queue.pop();
-}
-
-store_commit_t store_queue_fornt() {
-  auto store_commit = cpp_store_event_queue.front();
-  return store_commit;
+extern "C" {
+#include <debug.h>
+extern bool log_enable();
+extern void log_flush();
 }
 
-store_commit_t store_queue_back() {
-  auto store_commit = cpp_store_event_queue.back();
-  return store_commit;
+static_assert((STORE_QUEUE_SIZE & STORE_QUEUE_MASK) == 0,
+    "CONFIG_DIFFTEST_STORE_QUEUE_SIZE must be a power of 2");
+
+static store_commit_t store_queue_entry[STORE_QUEUE_SIZE];
+store_queue_t store_queue = { store_queue_entry, STORE_QUEUE_MASK, 0, 0, 0 };
+
+void store_queue_overflow() {
+  uint64_t size = (store_queue.mask + 1) * 2;
+  store_commit_t *entry = (store_commit_t *)malloc(sizeof(store_commit_t) * size);
+  assert(entry);
+  for (uint64_t i = store_queue.head; i != store_queue.tail; i ++) {
+    entry[i & (size - 1)] = store_queue.entry[i & store_queue.mask];
+  }
+  if (store_queue.entry != store_queue_entry) free(store_queue.entry);
+  store_queue.entry = entry;
+  store_queue.mask = size - 1;
+  store_queue.nr_overflow ++;
+  Log("Store commit queue is full, grow it to %ld entries", size);
 }
 
-size_t store_queue_size() {
-  return cpp_store_event_queue.size();
+uint64_t store_queue_nr_overflow() {
+  return store_queue.nr_overflow;
 }
 
-bool store_queue_empty() {
-  return cpp_store_event_queue.empty();
+size_t store_queue_drain(store_commit_t *buf, size_t n) {
+  size_t nr = store_queue_size();
+  if (nr > n) nr = n;
+  for (size_t i = 0; i < nr; i ++) {
+    buf[i] = store_queue.entry[(store_queue.head + i) & store_queue.mask];
+  }
+  store_queue.head += nr;
+  return nr;
 }
 
 #endif
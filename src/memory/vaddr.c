@@ -18,6 +18,7 @@
 #include <isa.h>
 //#include <profiling/betapoint-ext.h>
 #include <profiling/profiling_control.h>
+#include <profiling/bintrace.h>
 
 #ifdef CONFIG_PERF_OPT
 #define ENABLE_HOSTTLB 1
@@ -152,7 +153,7 @@ static inline word_t vaddr_read_internal(void *s, vaddr_t addr, int len, int typ
     isa_misalign_data_addr_check(addr, len, type);
   }
 #ifdef CONFIG_RVV
-  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && ((struct Decode*)s)->v_is_vx == 0) )) {
+  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && vldst.v_is_vx == 0) )) {
 #else
   if (unlikely(mmu_mode == MMU_DYNAMIC || mmu_mode == MMU_TRANSLATE)) {
 #endif
@@ -181,7 +182,7 @@ extern void dummy_hosttlb_translate(struct Decode *s, vaddr_t vaddr, int len, bo
 void dummy_vaddr_data_read(struct Decode *s, vaddr_t addr, int len, int mmu_mode) {
   assert(!ISDEF(CONFIG_SHARE));
 #ifdef CONFIG_RVV
-  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && ((struct Decode*)s)->v_is_vx == 0) )) {
+  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && vldst.v_is_vx == 0) )) {
 #else
   if (unlikely(mmu_mode == MMU_DYNAMIC || mmu_mode == MMU_TRANSLATE)) {
 #endif
@@ -204,7 +205,9 @@ word_t vaddr_ifetch(vaddr_t addr, int len) {
 
 word_t vaddr_read(struct Decode *s, vaddr_t addr, int len, int mmu_mode) {
   Logm("Reading vaddr %lx", addr);
-  return vaddr_read_internal(s, addr, len, MEM_TYPE_READ, mmu_mode);
+  word_t data = vaddr_read_internal(s, addr, len, MEM_TYPE_READ, mmu_mode);
+  IFDEF(CONFIG_BIN_TRACE, bintrace_mem(addr, false));
+  return data;
 }
 
 #ifdef CONFIG_RVV
@@ -226,12 +229,14 @@ void vaddr_write(struct Decode *s, vaddr_t addr, int len, word_t data, int mmu_m
   void isa_misalign_data_addr_check(vaddr_t vaddr, int len, int type);
   isa_misalign_data_addr_check(addr, len, MEM_TYPE_WRITE);
 #ifdef CONFIG_RVV
-  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && (s->v_is_vx == 0)))) {
+  if (unlikely(mmu_mode == MMU_DYNAMIC || (mmu_mode == MMU_TRANSLATE && (vldst.v_is_vx == 0)))) {
 #else
   if (unlikely(mmu_mode == MMU_DYNAMIC || mmu_mode == MMU_TRANSLATE)) {
 #endif
     mmu_mode = isa_mmu_check(addr, len, MEM_TYPE_WRITE);
   }
+  // an access raising an exception is dropped with its instruction
+  IFDEF(CONFIG_BIN_TRACE, bintrace_mem(addr, true));
   if (mmu_mode == MMU_DIRECT) {
     paddr_write(addr, len, data, cpu.mode, addr);
     return;
@@ -241,6 +246,16 @@ void vaddr_write(struct Decode *s, vaddr_t addr, int len, word_t data, int mmu_m
 #endif
 }
 
+// the guest physical address of an instruction fetch from addr,
+// raising the same exceptions as fetching the instruction
+paddr_t vaddr_ifetch_paddr(vaddr_t addr) {
+  vaddr_ifetch(addr, 2);
+  if (isa_mmu_check(addr, 2, MEM_TYPE_IFETCH) == MMU_DIRECT) return addr;
+  paddr_t pg_base = isa_mmu_translate(addr, 2, MEM_TYPE_IFETCH);
+  assert((pg_base & PAGE_MASK) == MEM_RET_OK);
+  return pg_base | (addr & PAGE_MASK);
+}
+
 word_t vaddr_read_safe(vaddr_t addr, int len) {
   // FIXME: when reading fails, return an error instead of raising exceptions
   return vaddr_read_internal(NULL, addr, len, MEM_TYPE_READ, MMU_DYNAMIC);
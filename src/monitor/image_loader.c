@@ -18,11 +18,15 @@
 #include <isa.h>
 #include <macro.h>
 #include <memory/paddr.h>
+#include <checkpoint/cpt_env.h>
 #include <memory/sparseram.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #ifdef CONFIG_MEM_COMPRESS
+#include <memory/vaddr.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <zlib.h>
 #include <zstd.h>
@@ -31,165 +35,229 @@
 #ifndef CONFIG_MODE_USER
 
 #ifdef CONFIG_MEM_COMPRESS
+static inline bool mem_is_zero(const uint8_t *p, size_t n) {
+  return n == 0 || (p[0] == 0 && memcmp(p, p + 1, n - 1) == 0);
+}
+
+// Copy decompressed data to pmem page by page. A zero page is only written
+// when pmem holds other data there, so the zero pages of a checkpoint stay
+// untouched anonymous memory.
+static void write_pmem_sparse(uint64_t offset, const uint8_t *src, size_t len) {
+  uint8_t *dst = guest_to_host(RESET_VECTOR) + offset;
+  for (size_t i = 0; i < len; i += PAGE_SIZE) {
+    size_t n = len - i < PAGE_SIZE ? len - i : PAGE_SIZE;
+    if (!mem_is_zero(src + i, n)) {
+      memcpy(dst + i, src + i, n);
+    } else if (!mem_is_zero(dst + i, n)) {
+      memset(dst + i, 0, n);
+    }
+  }
+}
+
+#define LOAD_BUF_SIZE (1ul << 20)
+
+// The members of a gz file can not be located without inflating it,
+// so it is decompressed by one thread.
 long load_gz_img(const char *filename) {
   gzFile compressed_mem = gzopen(filename, "rb");
   Assert(compressed_mem, "Can not open '%s'", filename);
+  gzbuffer(compressed_mem, LOAD_BUF_SIZE);
 
-  const uint32_t chunk_size = 16384;
-  uint8_t *temp_page = (uint8_t *)calloc(chunk_size, sizeof(long));
-  uint8_t *pmem_start = (uint8_t *)guest_to_host(RESET_VECTOR);
-  uint8_t *pmem_current;
-
-  // load file byte by byte to pmem
+  uint8_t *buf = (uint8_t *)malloc(LOAD_BUF_SIZE);
+  assert(buf);
   uint64_t curr_size = 0;
-  while (curr_size < MEMORY_SIZE) {
-    uint32_t bytes_read = gzread(compressed_mem, temp_page, chunk_size);
+  while (true) {
+    int bytes_read = gzread(compressed_mem, buf, LOAD_BUF_SIZE);
+    Assert(bytes_read >= 0, "Decompress failed on '%s'", filename);
     if (bytes_read == 0) {
       break;
     }
-    for (uint32_t x = 0; x < bytes_read; x++) {
-      pmem_current = pmem_start + curr_size + x;
-      uint8_t read_data = *(temp_page + x);
-      if (read_data != 0 || *pmem_current != 0) {
-        *pmem_current = read_data;
-      }
-    }
+    Assert(curr_size + bytes_read <= MEMORY_SIZE, "File size is larger than buf_size!\n");
+    write_pmem_sparse(curr_size, buf, bytes_read);
     curr_size += bytes_read;
   }
 
-  // check again to ensure the bin has been fully loaded
-  uint32_t left_bytes = gzread(compressed_mem, temp_page, chunk_size);
-  Assert(left_bytes == 0, "File size is larger than buf_size!\n");
-
-  free(temp_page);
+  free(buf);
   Assert(gzclose(compressed_mem) == Z_OK, "Error closing '%s'\n", filename);
+  IFDEF(CONFIG_MEM_COW, if (curr_size > 0) pmem_dirty_mark(RESET_VECTOR, curr_size));
   return curr_size;
 }
 
-long load_zstd_img(const char *filename){
-  assert(filename);
-
-  int fd = -1;
-  int file_size = 0;
-  int compressed_file_buffer_size = 0;
-  uint8_t *compress_file_buffer = NULL;
-
-  fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    printf("Cannot open compressed file %s\n", filename);
-    return -1;
-  }
-
-  file_size = lseek(fd, 0, SEEK_END);
-  if (file_size == 0) {
-    printf("File size is zero\n");
-    return -1;
+// frames of a zstd file decompressed to pmem at offset (from RESET_VECTOR),
+// whose size is ZSTD_CONTENTSIZE_UNKNOWN until they are decompressed
+typedef struct {
+  const uint8_t *src;
+  size_t src_size;
+  uint64_t offset;
+  uint64_t size;
+} zstd_task_t;
+
+static zstd_task_t *zstd_tasks;
+static int zstd_nr_task;
+static int zstd_next_task;
+
+static void zstd_load_task(ZSTD_DStream *dstream, uint8_t *buf, zstd_task_t *t) {
+  size_t ret = ZSTD_initDStream(dstream);
+  Assert(!ZSTD_isError(ret), "Cannot init dstream object: %s", ZSTD_getErrorName(ret));
+  ZSTD_inBuffer input = {t->src, t->src_size, 0};
+  uint64_t offset = t->offset;
+  while (true) {
+    ZSTD_outBuffer output = {buf, LOAD_BUF_SIZE, 0};
+    ret = ZSTD_decompressStream(dstream, &output, &input);
+    Assert(!ZSTD_isError(ret), "Decompress failed: %s", ZSTD_getErrorName(ret));
+    Assert(offset + output.pos <= MEMORY_SIZE, "Binary size larger than memory");
+    write_pmem_sparse(offset, buf, output.pos);
+    offset += output.pos;
+    // ret is 0 when a frame is fully flushed
+    if (input.pos == input.size && (ret == 0 || output.pos < output.size)) {
+      break;
+    }
   }
+  Assert(ret == 0, "Truncated zstd frame at offset 0x%lx", t->offset);
+  Assert(t->size == ZSTD_CONTENTSIZE_UNKNOWN || t->size == offset - t->offset,
+      "Size mismatch of zstd frame at offset 0x%lx", t->offset);
+  t->size = offset - t->offset;
+}
 
-  lseek(fd, 0, SEEK_SET);
-
-  compress_file_buffer = malloc(file_size);
-  if (!compress_file_buffer) {
-    printf("Compress file buffer create failed\n");
-    close(fd);
-    return -1;
+static void *zstd_load_worker(void *arg) {
+  ZSTD_DStream *dstream = ZSTD_createDStream();
+  uint8_t *buf = (uint8_t *)malloc(LOAD_BUF_SIZE);
+  assert(dstream && buf);
+  int i;
+  while ((i = __atomic_fetch_add(&zstd_next_task, 1, __ATOMIC_RELAXED)) < zstd_nr_task) {
+    zstd_load_task(dstream, buf, &zstd_tasks[i]);
   }
+  free(buf);
+  ZSTD_freeDStream(dstream);
+  return NULL;
+}
 
-  // read compressed file
-  compressed_file_buffer_size = read(fd, compress_file_buffer, file_size);
-  printf("read file size %d\n", compressed_file_buffer_size);
-  if (compressed_file_buffer_size != file_size) {
-    printf("Compress file read failed\n");
-    free(compress_file_buffer);
-    close(fd);
-    return -1;
-  }
+// A checkpoint written by serializePMemZstd() consists of independent frames
+// recording their sizes, which are decompressed in parallel straight from
+// the mapped file. Other files are decompressed as one stream.
+long load_zstd_img(const char *filename) {
+  assert(filename);
 
+  int fd = open(filename, O_RDONLY);
+  Assert(fd >= 0, "Can not open '%s'", filename);
+  struct stat st;
+  Assert(fstat(fd, &st) == 0 && st.st_size > 0, "File size of '%s' is zero", filename);
+  size_t file_size = st.st_size;
+  const uint8_t *file = (const uint8_t *)mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  Assert(file != MAP_FAILED, "Can not map '%s'", filename);
   close(fd);
 
-  // create decompress input buffer
-  ZSTD_inBuffer input = {compress_file_buffer, compressed_file_buffer_size, 0};
-
-  // alloc decompress buffer
-  const uint64_t decompress_file_buffer_size = 16384;
-  uint64_t *decompress_file_buffer = (uint64_t *)calloc(decompress_file_buffer_size, sizeof(uint64_t));
-  if (!decompress_file_buffer) {
-    printf("Decompress file read failed\n");
-    free(compress_file_buffer);
-    return -1;
+  int nr_frame = 0, cap = 64;
+  zstd_tasks = (zstd_task_t *)malloc(cap * sizeof(zstd_task_t));
+  bool sized = true;
+  uint64_t offset = 0;
+  for (size_t pos = 0; pos < file_size; nr_frame ++) {
+    size_t csize = ZSTD_findFrameCompressedSize(file + pos, file_size - pos);
+    Assert(!ZSTD_isError(csize), "Bad zstd frame at 0x%lx of '%s': %s", pos, filename, ZSTD_getErrorName(csize));
+    unsigned long long size = ZSTD_getFrameContentSize(file + pos, csize);
+    if (nr_frame == cap) {
+      cap *= 2;
+      zstd_tasks = (zstd_task_t *)realloc(zstd_tasks, cap * sizeof(zstd_task_t));
+    }
+    zstd_tasks[nr_frame] = (zstd_task_t){file + pos, csize, offset, size};
+    if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+      sized = false;
+    } else {
+      offset += size;
+    }
+    pos += csize;
   }
-
-  // create and init decompress stream object
-  ZSTD_DStream *dstream = ZSTD_createDStream();
-  if (!dstream) {
-    printf("Cannot create zstd dstream object\n");
-    free(compress_file_buffer);
-    free(decompress_file_buffer);
-    return -1;
+  zstd_nr_task = nr_frame;
+  if (!sized) {
+    zstd_nr_task = 1;
+    zstd_tasks[0] = (zstd_task_t){file, file_size, 0, ZSTD_CONTENTSIZE_UNKNOWN};
   }
+  Assert(!sized || offset <= MEMORY_SIZE, "Binary size larger than memory");
 
-  size_t init_result = ZSTD_initDStream(dstream);
-  if (ZSTD_isError(init_result)) {
-    printf("Cannot init dstream object: %s\n", ZSTD_getErrorName(init_result));
-    ZSTD_freeDStream(dstream);
-    free(compress_file_buffer);
-    free(decompress_file_buffer);
-    return -1;
+  int nr_thread = CONFIG_CPT_COMPRESS_THREADS < zstd_nr_task ? CONFIG_CPT_COMPRESS_THREADS : zstd_nr_task;
+  pthread_t threads[nr_thread];
+  zstd_next_task = 0;
+  for (int i = 1; i < nr_thread; i ++) {
+    Assert(pthread_create(&threads[i], NULL, zstd_load_worker, NULL) == 0, "Can not create thread");
+  }
+  zstd_load_worker(NULL);
+  for (int i = 1; i < nr_thread; i ++) {
+    pthread_join(threads[i], NULL);
   }
 
-  // def phymem
-  uint8_t *pmem_start = (uint8_t *)guest_to_host(RESET_VECTOR);
-  uint64_t *pmem_current;
-
-  // decompress and write in memory
   uint64_t total_write_size = 0;
-  while (total_write_size < MEMORY_SIZE) {
-
-    ZSTD_outBuffer output = {decompress_file_buffer, decompress_file_buffer_size * sizeof(uint64_t), 0};
-
-    size_t result = ZSTD_decompressStream(dstream, &output, &input);
-
-    if (ZSTD_isError(result)) {
-      printf("Decompress failed: %s\n", ZSTD_getErrorName(result));
-      ZSTD_freeDStream(dstream);
-      free(compress_file_buffer);
-      free(decompress_file_buffer);
-
-      return -1;
-    }
+  for (int i = 0; i < zstd_nr_task; i ++) {
+    total_write_size += zstd_tasks[i].size;
+  }
+  Log("Decompressed %lu bytes in %d zstd frames with %d threads", total_write_size, nr_frame, nr_thread);
 
-    if (output.pos == 0) {
-      break;
-    }
+  free(zstd_tasks);
+  munmap((void *)file, file_size);
+  IFDEF(CONFIG_MEM_COW, if (total_write_size > 0) pmem_dirty_mark(RESET_VECTOR, total_write_size));
 
-    assert(decompress_file_buffer_size * sizeof(uint64_t) == output.pos);
+  return total_write_size;
+}
 
-    for (uint64_t x = 0; x < decompress_file_buffer_size; x++) {
-      pmem_current = (uint64_t *)(pmem_start + total_write_size) + x;
-      uint64_t read_data = *(decompress_file_buffer + x);
-      if (read_data != 0 || *pmem_current != 0) {
-        *pmem_current = read_data;
-      }
+// load a checkpoint in PAGE_FORMAT, reading its pages from the page store
+long load_page_cpt(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  Assert(fp, "Can not open '%s'", filename);
+
+  page_cpt_header_t header;
+  Assert(fread(&header, sizeof(header), 1, fp) == 1, "Can not read the header of '%s'", filename);
+  Assert(header.version == PAGE_CPT_VERSION && header.page_size == PAGE_CPT_PAGE_SIZE,
+      "Unsupported page checkpoint version %u, page size %u", header.version, header.page_size);
+  Assert(header.mem_size <= MEMORY_SIZE, "Checkpoint memory size 0x%lx is larger than pmem", header.mem_size);
+  header.store[sizeof(header.store) - 1] = '\0';
+
+  // the page store is named relative to the directory of the checkpoint
+  const char *slash = strrchr(filename, '/');
+  int dir_len = slash == NULL ? 0 : slash - filename + 1;
+  char store_path[dir_len + sizeof(header.store)];
+  sprintf(store_path, "%.*s%s", dir_len, filename, header.store);
+  int store_fd = open(store_path, O_RDONLY);
+  Assert(store_fd >= 0, "Can not open page store '%s'", store_path);
+
+  uint64_t nr_mem_pages = header.mem_size / PAGE_CPT_PAGE_SIZE;
+  uint64_t *listed = calloc((nr_mem_pages + 63) / 64, sizeof(uint64_t));
+  assert(listed != NULL);
+  uint8_t buf[PAGE_CPT_PAGE_SIZE];
+  for (uint64_t i = 0; i < header.nr_pages; i ++) {
+    page_cpt_entry_t e;
+    Assert(fread(&e, sizeof(e), 1, fp) == 1, "Can not read page %lu of '%s'", i, filename);
+    Assert((e.page + 1) * PAGE_CPT_PAGE_SIZE <= header.mem_size && e.size <= PAGE_CPT_PAGE_SIZE,
+        "Bad page %lu in '%s'", e.page, filename);
+    paddr_t addr = CONFIG_MBASE + e.page * PAGE_CPT_PAGE_SIZE;
+    uint8_t *page = guest_to_host(addr);
+    if (e.size == PAGE_CPT_PAGE_SIZE) {
+      Assert(pread(store_fd, page, e.size, e.offset) == e.size, "Can not read page store '%s'", store_path);
+    } else {
+      Assert(pread(store_fd, buf, e.size, e.offset) == e.size, "Can not read page store '%s'", store_path);
+      size_t ret = ZSTD_decompress(page, PAGE_CPT_PAGE_SIZE, buf, e.size);
+      Assert(ret == PAGE_CPT_PAGE_SIZE, "Decompress failed on page %lu of '%s'", e.page, filename);
     }
-    total_write_size += output.pos;
+    IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(addr, PAGE_CPT_PAGE_SIZE));
+    listed[e.page / 64] |= 1ul << (e.page % 64);
   }
 
-  ZSTD_outBuffer output = {decompress_file_buffer, decompress_file_buffer_size * sizeof(uint64_t), 0};
-  size_t result = ZSTD_decompressStream(dstream, &output, &input);
-  if (ZSTD_isError(result) || output.pos != 0) {
-    printf("Decompress failed: %s\n", ZSTD_getErrorName(result));
-    printf("Binary size larger than memory\n");
-    ZSTD_freeDStream(dstream);
-    free(compress_file_buffer);
-    free(decompress_file_buffer);
-    return -1;
+  // the pages not in the index are zero, but pmem may hold random data there
+  uint64_t nr_zeroed = 0;
+  for (uint64_t i = 0; i < nr_mem_pages; i ++) {
+    if ((listed[i / 64] >> (i % 64)) & 1) continue;
+    paddr_t addr = CONFIG_MBASE + i * PAGE_CPT_PAGE_SIZE;
+    uint8_t *page = guest_to_host(addr);
+    if (!mem_is_zero(page, PAGE_CPT_PAGE_SIZE)) {
+      memset(page, 0, PAGE_CPT_PAGE_SIZE);
+      IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(addr, PAGE_CPT_PAGE_SIZE));
+      nr_zeroed ++;
+    }
   }
+  free(listed);
 
-  ZSTD_freeDStream(dstream);
-  free(compress_file_buffer);
-  free(decompress_file_buffer);
-
-  return total_write_size;
+  close(store_fd);
+  fclose(fp);
+  Log("Read %lu pages from page store %s, zeroed %lu pages", header.nr_pages, store_path, nr_zeroed);
+  return header.mem_size;
 }
 
 #endif  //  CONFIG_MEM_COMPRESS
@@ -206,6 +274,15 @@ long load_img(char* img_name, char *which_img, uint64_t load_start, size_t img_s
     return 4096;  // built-in image size
   }
 
+  if (is_page_cpt_file(loading_img)) {
+#ifdef CONFIG_MEM_COMPRESS
+    Log("Loading page checkpoint %s", loading_img);
+    return load_page_cpt(loading_img);
+#else
+    panic("CONFIG_MEM_COMPRESS is disabled, turn it on in memuconfig!");
+#endif
+  }
+
   if (is_gz_file(loading_img)) {
 #ifdef CONFIG_MEM_COMPRESS
     Log("Loading GZ image %s", loading_img);
@@ -254,6 +331,7 @@ long load_img(char* img_name, char *which_img, uint64_t load_start, size_t img_s
 #else
   int ret = fread(guest_to_host(load_start), size, 1, fp);
   assert(ret == 1);
+  IFDEF(CONFIG_MEM_COW, pmem_dirty_mark(load_start, size));
 #endif
   Log("Read %lu bytes from file %s to 0x%lx", size, img_name, load_start);
 
@@ -17,6 +17,7 @@
 #include <isa.h>
 #include <checkpoint/cpt_env.h>
 #include <profiling/profiling_control.h>
+#include <profiling/bintrace.h>
 #include <memory/image_loader.h>
 #include <memory/paddr.h>
 #include <getopt.h>
@@ -37,6 +38,8 @@ void init_device();
 
 static char *log_file = NULL;
 bool small_log = false;
+static char *bin_trace_file = NULL;
+static int bin_trace_kind = BINTRACE_INST;
 static char *diff_so_file = NULL;
 static char *img_file = NULL;
 static int batch_mode = false;
@@ -98,6 +101,7 @@ static inline int parse_args(int argc, char *argv[]) {
     // restore cpt
     {"restore"            , no_argument      , NULL, 'c'},
     {"cpt-restorer"       , required_argument, NULL, 'r'},
+    {"cpt-native-restore" , no_argument      , NULL, 17},
     {"map-img-as-outcpt"  , no_argument      , NULL, 13},
 
     // take cpt
@@ -113,6 +117,8 @@ static inline int parse_args(int argc, char *argv[]) {
 
     // profiling
     {"simpoint-profile"   , no_argument      , NULL, 3},
+    {"simpoint-bbv-format", required_argument, NULL, 15},
+    {"simpoint-profile-cpt", no_argument     , NULL, 16},
     {"dont-skip-boot"     , no_argument      , NULL, 6},
     {"mem_use_record_file", required_argument, NULL, 'A'},
     // restore cpt
@@ -125,6 +131,10 @@ static inline int parse_args(int argc, char *argv[]) {
     // small log file
     {"small-log"          , required_argument, NULL, 8},
 
+    // binary trace
+    {"bin-trace"          , required_argument, NULL, 18},
+    {"bin-trace-kind"     , required_argument, NULL, 19},
+
     {0          , 0                , NULL,  0 },
   };
   int o;
@@ -156,6 +166,11 @@ static inline int parse_args(int argc, char *argv[]) {
       case 'r':
         restorer = optarg;
         break;
+      case 17:
+        checkpoint_restoring = true;
+        checkpoint_native_restore = true;
+        Log("Restoring from checkpoint without the restorer");
+        break;
       case 13: {
         extern bool map_image_as_output_cpt;
         map_image_as_output_cpt = true;
@@ -234,6 +249,8 @@ static inline int parse_args(int argc, char *argv[]) {
           compress_file_format = GZ_FORMAT;
         } else if (!strcmp(optarg, "zstd")) {
           compress_file_format = ZSTD_FORMAT;
+        } else if (!strcmp(optarg, "pages")) {
+          compress_file_format = PAGE_FORMAT;
         } else {
           xpanic("Not support '%s' format\n", optarg);
         }
@@ -244,12 +261,51 @@ static inline int parse_args(int argc, char *argv[]) {
         break;
       case 14: sscanf(optarg, "%lu", &warmup_interval); break;
 
+      case 18:
+        if (!ISDEF(CONFIG_BIN_TRACE)) {
+          xpanic("--bin-trace requires CONFIG_BIN_TRACE\n");
+        }
+        bin_trace_file = optarg;
+        break;
+      case 19:
+        if (!strcmp(optarg, "inst")) {
+          bin_trace_kind = BINTRACE_INST;
+        } else if (!strcmp(optarg, "bb")) {
+          bin_trace_kind = BINTRACE_BB;
+        } else {
+          xpanic("Not support '%s' trace\n", optarg);
+        }
+        break;
+
+      case 15:
+        if (!strcmp(optarg, "text")) {
+          simpoint_bbv_format = BBV_TEXT_FORMAT;
+        } else if (!strcmp(optarg, "bin")) {
+          simpoint_bbv_format = BBV_BINARY_FORMAT;
+        } else {
+          xpanic("Not support '%s' format\n", optarg);
+        }
+        break;
+
+      case 16:
+        // only the pages dirtied in an interval are stored, which MEM_COW tells
+        if (!ISDEF(CONFIG_MEM_COW)) {
+          xpanic("--simpoint-profile-cpt requires CONFIG_MEM_COW\n");
+        }
+        assert(profiling_state == NoProfiling && checkpoint_state == NoCheckpoint);
+        profiling_state = SimpointProfiling;
+        checkpoint_state = SimpointProfileCheckpointing;
+        Log("Doing Simpoint Profiling and taking checkpoints of the simpoints in one run");
+        break;
+
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
         printf("\t-b,--batch              run with batch mode\n");
         printf("\t-I,--max-instr          max number of instructions executed\n");
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t--small-log=FILE        output log to a limited size FILE, but log is always up to date\n");
+        printf("\t--bin-trace=FILE        write a binary trace to FILE, see tools/bintrace\n");
+        printf("\t--bin-trace-kind=KIND   trace every instruction('inst') or basic block('bb'), default: 'inst'\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
 
@@ -259,6 +315,7 @@ static inline int parse_args(int argc, char *argv[]) {
 
         printf("\t-c,--restore            restoring from CPT FILE\n");
         printf("\t-r,--cpt-restorer=R     binary of gcpt restorer\n");
+        printf("\t--cpt-native-restore    restoring from CPT FILE, loading its registers directly instead of running the restorer\n");
 //        printf("\t--map-img-as-outcpt     map to image as output checkpoint, do not truncate it.\n"); //comming back soon
 
         printf("\t-S,--simpoint-dir=SIMPOINT_DIR   simpoints dir\n");
@@ -268,10 +325,12 @@ static inline int parse_args(int argc, char *argv[]) {
         printf("\t--cpt-mmode             force to take cpt in mmode, which might not work.\n");
         printf("\t--manual-oneshot-cpt    Manually take one-shot cpt by send signal.\n");
         printf("\t--manual-uniform-cpt    Manually take uniform cpt by send signal.\n");
-        printf("\t--checkpoint-format     Specify the checkpoint format('gz' or 'zstd'), default: 'gz'.\n");
+        printf("\t--checkpoint-format     Specify the checkpoint format('gz', 'zstd' or 'pages'), default: 'gz'.\n");
 //        printf("\t--map-cpt               map to this file as pmem, which can be treated as a checkpoint.\n"); //comming back soon
 
         printf("\t--simpoint-profile      simpoint profiling\n");
+        printf("\t--simpoint-bbv-format   Specify the simpoint bbv format('text' or 'bin'), default: 'text'.\n");
+        printf("\t--simpoint-profile-cpt  simpoint profiling, then take checkpoints of the simpoints chosen in the same run, requires CONFIG_MEM_COW\n");
         printf("\t--dont-skip-boot        profiling/checkpoint immediately after boot\n");
         printf("\t--mem_use_record_file   result output file for analyzing the memory use segment\n");
 //        printf("\t--cpt-id                checkpoint id\n");
@@ -317,6 +376,9 @@ void init_monitor(int argc, char *argv[]) {
   }
   /* Open the log file. */
   init_log(log_file, small_log);
+#ifdef CONFIG_BIN_TRACE
+  if (bin_trace_file) bintrace_init(bin_trace_file, bin_trace_kind);
+#endif
 
   /* Initialize memory. */
   init_mem();
@@ -340,6 +402,14 @@ void init_monitor(int argc, char *argv[]) {
   }
   img_size = load_img(img_file, "image (checkpoint/bare metal app/bbl) form cmdline", bbl_start, 0);
 
+  if (checkpoint_native_restore) {
+    extern bool deserialize_reg_from_mem();
+    Assert(restorer == NULL, "--cpt-native-restore does not run the restorer");
+    if (!deserialize_reg_from_mem()) {
+      Log("Booting the checkpoint from the reset vector");
+    }
+  }
+
   if (restorer) {
     FILE *restore_fp = fopen(restorer, "rb");
     Assert(restore_fp, "Can not open '%s'", restorer);
@@ -176,17 +176,15 @@ static int cmd_attach(char *args) {
 static int cmd_save(char *args) {
   /* extract the first argument */
   char *arg = strtok(NULL, " ");
+  bool full = arg != NULL && strcmp(arg, "-f") == 0;
+  if (full) arg = strtok(NULL, " ");
 
   if (arg == NULL) {
     /* no argument given */
-    Log("no path");
+    Log("usage: save [-f] path");
   }
   else {
-    FILE *fp = fopen(arg, "w");
-    assert(fp != NULL);
-    fwrite(&cpu, sizeof(cpu), 1, fp);
-    fwrite(guest_to_host(CONFIG_MBASE), MEMORY_SIZE, 1, fp);
-    fclose(fp);
+    snapshot_save(arg, full);
   }
   return 0;
 }
@@ -200,15 +198,23 @@ static int cmd_load(char *args) {
     Log("no path");
   }
   else {
-    FILE *fp = fopen(arg, "r");
-    assert(fp != NULL);
-    __attribute__((unused)) int ret;
-    ret = fread(&cpu, sizeof(cpu), 1, fp);
-    ret = fread(guest_to_host(CONFIG_MBASE), MEMORY_SIZE, 1, fp);
-    fclose(fp);
+    snapshot_load(arg);
   }
   return 0;
 }
+
+#ifdef CONFIG_MEM_COW
+static int cmd_fork(char *args) {
+  int nr_rollback = snapshot_take();
+  if (nr_rollback > 0) Log("Rolled back to the snapshot %d time(s)", nr_rollback);
+  return 0;
+}
+
+static int cmd_rollback(char *args) {
+  snapshot_rollback();
+  return 0;
+}
+#endif
 #else
 #endif
 
@@ -237,8 +243,12 @@ static struct {
 #ifdef CONFIG_MODE_SYSTEM
   { "detach", "detach diff test", cmd_detach },
   { "attach", "attach diff test", cmd_attach },
-  { "save", "save snapshot", cmd_save },
+  { "save", "save [-f] path - save snapshot, only the pages written since the last one without -f", cmd_save },
   { "load", "load snapshot", cmd_load },
+#ifdef CONFIG_MEM_COW
+  { "fork", "take a snapshot of the machine by fork()", cmd_fork },
+  { "rollback", "roll back to the last snapshot taken by fork", cmd_rollback },
+#endif
 #endif
 #endif
   { "q", "Exit NEMU", cmd_q },
@@ -15,10 +15,22 @@
 
 #include <common.h>
 #ifndef __ICS_EXPORT
+#include <isa.h>
+#include <memory/host-tlb.h>
+#include <memory/paddr.h>
+#include <memory/vaddr.h>
 #include <stdlib.h>
 #endif
 
 #define NR_WP 32
+#ifndef __ICS_EXPORT
+#define NR_WP_REF 8
+
+// physical, so that stores through any mapping of the memory are caught
+typedef struct {
+  paddr_t lo, hi;
+} WPRef;
+#endif
 
 typedef struct watchpoint {
   int NO;
@@ -28,7 +40,13 @@ typedef struct watchpoint {
 
 #ifndef __ICS_EXPORT
   char *expr;
+  ExprProg *prog;
   word_t old_val;
+  // The value of an expression without registers only changes when the memory
+  // read by its last evaluation is written. nr_ref is -1 if the expression has
+  // to be evaluated after each instruction instead.
+  int nr_ref;
+  WPRef ref[NR_WP_REF];
 #endif
 } WP;
 
@@ -57,24 +75,100 @@ static WP* new_WP() {
   return p;
 }
 
+int wp_nr_ref = 0; // memory ranges read by all the watchpoints
+bool wp_need_scan = false;
+static int nr_wp_scan_always = 0;
+
+static void update_ref() {
+  WP *p;
+  wp_nr_ref = 0;
+  nr_wp_scan_always = 0;
+  for (p = head; p != NULL; p = p->next) {
+    if (p->nr_ref < 0) { nr_wp_scan_always ++; }
+    else { wp_nr_ref += p->nr_ref; }
+  }
+  wp_need_scan = nr_wp_scan_always > 0;
+}
+
+static WP *wp_evaluating = NULL;
+
+// translate as the read following it, return false if it is not plain pmem
+static bool ref_translate(vaddr_t addr, paddr_t *paddr) {
+#ifdef CONFIG_MODE_SYSTEM
+  switch (isa_mmu_check(addr, 1, MEM_TYPE_READ)) {
+    case MMU_DIRECT: *paddr = addr; break;
+    case MMU_TRANSLATE: {
+      paddr_t pg_base = isa_mmu_translate(addr & ~PAGE_MASK, 1, MEM_TYPE_READ);
+      if ((pg_base & PAGE_MASK) != MEM_RET_OK) { return false; }
+      *paddr = pg_base | (addr & PAGE_MASK);
+      break;
+    }
+    default: return false;
+  }
+  return in_pmem(*paddr);
+#else
+  return false;
+#endif
+}
+
+static void record_ref(vaddr_t addr, int len) {
+  WP *p = wp_evaluating;
+  while (p->nr_ref >= 0 && len > 0) {
+    // a read crossing pages may be mapped to two physical ranges
+    int n = PAGE_SIZE - (addr & PAGE_MASK);
+    if (n > len) { n = len; }
+    paddr_t paddr;
+    if (p->nr_ref == NR_WP_REF || !ref_translate(addr, &paddr)) {
+      p->nr_ref = -1;
+      return;
+    }
+    p->ref[p->nr_ref].lo = paddr;
+    p->ref[p->nr_ref].hi = paddr + n;
+    p->nr_ref ++;
+    addr += n;
+    len -= n;
+  }
+}
+
+static word_t eval_WP(WP *p) {
+  int old_nr_ref = p->nr_ref;
+  WPRef old_ref[NR_WP_REF];
+  memcpy(old_ref, p->ref, sizeof(old_ref));
+
+  bool use_reg = expr_use_reg(p->prog);
+  p->nr_ref = use_reg ? -1 : 0;
+  wp_evaluating = p;
+  word_t val = expr_eval(p->prog, use_reg ? NULL : record_ref);
+
+  if (p->nr_ref != old_nr_ref ||
+      (p->nr_ref > 0 && memcmp(old_ref, p->ref, sizeof(WPRef) * p->nr_ref) != 0)) {
+    // stores to the pages read now should not be cached by the host TLB
+    IFDEF(CONFIG_MODE_SYSTEM, hosttlb_flush(0));
+  }
+  return val;
+}
+
 static void free_WP(WP *p) {
   assert(p >= wp_pool && p < wp_pool + NR_WP);
   free(p->expr);
+  free(p->prog);
   p->next = free_;
   free_ = p;
 }
 
 int set_watchpoint(char *e) {
-  bool success;
-  word_t val = expr(e, &success);
-  if (!success) return -1;
+  ExprProg *prog = expr_compile(e);
+  if (prog == NULL) return -1;
 
   WP *p = new_WP();
   p->expr = strdup(e);
-  p->old_val = val;
+  p->prog = prog;
+  p->nr_ref = 0;
+  p->old_val = eval_WP(p);
 
   p->next = head;
   head = p;
+  update_ref();
 
   return p->NO;
 }
@@ -90,6 +184,7 @@ bool delete_watchpoint(int NO) {
   else { prev->next = p->next; }
 
   free_WP(p);
+  update_ref();
   return true;
 }
 
@@ -106,18 +201,46 @@ void list_watchpoint() {
   }
 }
 
+void wp_check_store(paddr_t addr, int len) {
+  WP *p;
+  int i;
+  for (p = head; p != NULL; p = p->next) {
+    for (i = 0; i < p->nr_ref; i ++) {
+      if (addr < p->ref[i].hi && addr + len > p->ref[i].lo) {
+        wp_need_scan = true;
+        return;
+      }
+    }
+  }
+}
+
+bool wp_is_watched_page(paddr_t addr) {
+  WP *p;
+  int i;
+  paddr_t pg = addr >> PAGE_SHIFT;
+  for (p = head; p != NULL; p = p->next) {
+    for (i = 0; i < p->nr_ref; i ++) {
+      if (pg >= (p->ref[i].lo >> PAGE_SHIFT) && pg <= ((p->ref[i].hi - 1) >> PAGE_SHIFT)) return true;
+    }
+  }
+  return false;
+}
+
 void scan_watchpoint(vaddr_t pc) {
   WP *p;
   for (p = head; p != NULL; p = p->next) {
-    bool success;
-    word_t new_val = expr(p->expr, &success);
+    word_t new_val = eval_WP(p);
     if (p->old_val != new_val) {
       printf("\n\nHint watchpoint %d at address " FMT_WORD ", expr = %s\n", p->NO, pc, p->expr);
       printf("old value = " FMT_WORD "\nnew value = " FMT_WORD "\n", p->old_val, new_val);
       p->old_val = new_val;
       nemu_state.state = NEMU_STOP;
+      // the watchpoints after p are checked after the next instruction
+      update_ref();
+      wp_need_scan = true;
       return;
     }
   }
+  update_ref();
 }
 #endif
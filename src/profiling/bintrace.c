@@ -0,0 +1,144 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <common.h>
+
+#ifdef CONFIG_BIN_TRACE
+#include <profiling/bintrace.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zstd.h>
+
+// The emulator fills the chunks of a ring in turn. A full chunk is handed to
+// the I/O thread by advancing ring_head, and the I/O thread compresses it as a
+// zstd frame and gives it back by advancing ring_tail. The emulator only waits
+// when all the chunks are waiting to be written.
+#define BINTRACE_CHUNK_SIZE (1 << 20)
+#define NR_CHUNK CONFIG_BIN_TRACE_NR_CHUNK
+
+int bintrace_kind = BINTRACE_NONE;
+uint8_t *bintrace_ptr = NULL, *bintrace_end = NULL;
+bintrace_inst_t bintrace_cur = {};
+
+static uint8_t *chunk[NR_CHUNK];
+static size_t chunk_size[NR_CHUNK];
+static uint64_t ring_head = 0; // chunks filled by the emulator
+static uint64_t ring_tail = 0; // chunks written by the I/O thread
+static bool ring_closed = false;
+
+static FILE *trace_fp = NULL;
+static pthread_t io_thread;
+static uint64_t nr_stall = 0, nr_raw_byte = 0, nr_zstd_byte = 0;
+
+static void *bintrace_io(void *arg) {
+  ZSTD_CCtx *cctx = ZSTD_createCCtx();
+  Assert(cctx != NULL, "Can not create zstd context");
+  ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, CONFIG_BIN_TRACE_ZSTD_LEVEL);
+  size_t out_size = ZSTD_compressBound(BINTRACE_CHUNK_SIZE);
+  void *out = malloc(out_size);
+  Assert(out != NULL, "Can not allocate the compression buffer");
+
+  const struct timespec idle = { .tv_sec = 0, .tv_nsec = 50000 };
+  uint64_t tail = ring_tail;
+  while (true) {
+    if (tail == __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) {
+      // the last chunk is submitted before the ring is closed
+      if (__atomic_load_n(&ring_closed, __ATOMIC_ACQUIRE) &&
+          tail == __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE)) break;
+      nanosleep(&idle, NULL);
+      continue;
+    }
+    int i = tail % NR_CHUNK;
+    size_t size = ZSTD_compress2(cctx, out, out_size, chunk[i], chunk_size[i]);
+    Assert(!ZSTD_isError(size), "Failed to compress the trace: %s", ZSTD_getErrorName(size));
+    Assert(fwrite(out, size, 1, trace_fp) == 1, "Failed to write the trace");
+    nr_raw_byte += chunk_size[i];
+    nr_zstd_byte += size;
+    __atomic_store_n(&ring_tail, ++ tail, __ATOMIC_RELEASE);
+  }
+
+  free(out);
+  ZSTD_freeCCtx(cctx);
+  return NULL;
+}
+
+static void bintrace_chunk_start() {
+  // wait for the I/O thread to write the chunk to reuse
+  while (ring_head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == NR_CHUNK) {
+    nr_stall ++;
+    sched_yield();
+  }
+  bintrace_ptr = chunk[ring_head % NR_CHUNK];
+  bintrace_end = bintrace_ptr + BINTRACE_CHUNK_SIZE;
+}
+
+void bintrace_submit() {
+  int i = ring_head % NR_CHUNK;
+  chunk_size[i] = bintrace_ptr - chunk[i];
+  __atomic_store_n(&ring_head, ring_head + 1, __ATOMIC_RELEASE);
+  bintrace_chunk_start();
+}
+
+void bintrace_init(const char *file, int kind) {
+  assert(kind == BINTRACE_INST || kind == BINTRACE_BB);
+  trace_fp = fopen(file, "wb");
+  Assert(trace_fp, "Can not open '%s'", file);
+  for (int i = 0; i < NR_CHUNK; i ++) {
+    chunk[i] = malloc(BINTRACE_CHUNK_SIZE);
+    Assert(chunk[i] != NULL, "Can not allocate the trace buffer");
+  }
+  bintrace_chunk_start();
+
+  bintrace_header_t *header = bintrace_alloc(sizeof(bintrace_header_t));
+  memcpy(header->magic, BINTRACE_MAGIC, sizeof(header->magic));
+  header->kind = kind;
+  header->record_size = kind == BINTRACE_INST ? sizeof(bintrace_inst_t) : sizeof(bintrace_bb_t);
+
+  Assert(pthread_create(&io_thread, NULL, bintrace_io, NULL) == 0, "Can not create thread");
+  bintrace_kind = kind;
+  Log("Writing %s trace to %s", kind == BINTRACE_INST ? "instruction" : "basic block", file);
+}
+
+// Write all the records so far. The monitor calls this before fork() and
+// the child calls bintrace_fork_child(), since it has no I/O thread.
+void bintrace_flush() {
+  if (bintrace_kind == BINTRACE_NONE) return;
+  if (bintrace_ptr != chunk[ring_head % NR_CHUNK]) bintrace_submit();
+  while (__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) != ring_head) sched_yield();
+  fflush(trace_fp);
+}
+
+void bintrace_fork_child() {
+  if (bintrace_kind == BINTRACE_NONE) return;
+  Assert(pthread_create(&io_thread, NULL, bintrace_io, NULL) == 0, "Can not create thread");
+}
+
+void bintrace_close() {
+  if (bintrace_kind == BINTRACE_NONE) return;
+  bintrace_kind = BINTRACE_NONE;
+  int i = ring_head % NR_CHUNK;
+  chunk_size[i] = bintrace_ptr - chunk[i];
+  if (chunk_size[i] > 0) __atomic_store_n(&ring_head, ring_head + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring_closed, true, __ATOMIC_RELEASE);
+  pthread_join(io_thread, NULL);
+  fclose(trace_fp);
+  for (i = 0; i < NR_CHUNK; i ++) free(chunk[i]);
+  bintrace_ptr = bintrace_end = NULL;
+  Log("Trace written: %lu bytes, %lu bytes compressed, the emulator waited for the I/O thread %lu times",
+      nr_raw_byte, nr_zstd_byte, nr_stall);
+}
+#endif // CONFIG_BIN_TRACE
@@ -1,9 +1,11 @@
 #include <profiling/profiling_control.h>
 
 int profiling_state = NoProfiling;
+int simpoint_bbv_format = BBV_TEXT_FORMAT;
 int checkpoint_state = NoCheckpoint;
 bool checkpoint_taking = false;
 bool checkpoint_restoring = false;
+bool checkpoint_native_restore = false;
 uint64_t checkpoint_interval = 0;
 uint64_t warmup_interval = 0;
 
@@ -26,4 +28,5 @@ void reset_inst_counters() {
 #ifdef CONFIG_SHARE
 // empty definition on share
 void simpoint_profiling(uint64_t pc, bool is_control, uint64_t abs_instr_count) {}
+void simpoint_profiling_finish() {}
 #endif 
\ No newline at end of file
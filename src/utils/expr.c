@@ -203,81 +203,64 @@ static int find_dominated_op(int s, int e, bool *success) {
   return dominated_op;
 }
 
-static rtlreg_t eval(int s, int e, bool *success) {
+/* An expression is compiled to its operators in postfix order, so that a
+ * watchpoint evaluates it without tokenizing it again.
+ */
+typedef struct {
+  int type;
+  word_t val;   // value of TK_NUM
+  char reg[32]; // name of TK_REG without '$'
+} ExprOp;
+
+struct ExprProg {
+  int nr_op;
+  bool use_reg;
+  ExprOp op[ARRLEN(tokens)];
+};
+
+static bool compile(int s, int e, ExprProg *p) {
   if (s > e) {
     // bad expression
-    *success = false;
-    return 0;
+    return false;
   }
   else if (s == e) {
     // single token
-    rtlreg_t val;
+    ExprOp *op = &p->op[p->nr_op ++];
+    op->type = tokens[s].type;
     switch (tokens[s].type) {
-      case TK_REG: val = isa_reg_str2val(tokens[s].str + 1, success); // +1 to skip '$'
-                if (!*success) { return 0; }
-                break;
-
-      case TK_NUM: val = strtoul(tokens[s].str, NULL, 0); break;
-      default: assert(0);
+      case TK_REG: {
+        bool success;
+        strcpy(op->reg, tokens[s].str + 1); // +1 to skip '$'
+        isa_reg_str2val(op->reg, &success);
+        p->use_reg = true;
+        return success;
+      }
+      case TK_NUM: op->val = strtoul(tokens[s].str, NULL, 0); return true;
+      default: return false;
     }
-
-    *success = true;
-    return val;
   }
   else if (tokens[s].type == '(' && tokens[e].type == ')') {
-    return eval(s + 1, e - 1, success);
+    return compile(s + 1, e - 1, p);
   }
   else {
-    int dominated_op = find_dominated_op(s, e, success);
-    if (!*success) { return 0; }
+    bool success;
+    int dominated_op = find_dominated_op(s, e, &success);
+    if (!success) { return false; }
 
     int op_type = tokens[dominated_op].type;
     if (op_type == '!' || op_type == TK_NEG || op_type == TK_REF) {
-      rtlreg_t val = eval(dominated_op + 1, e, success);
-      if (!*success) { return 0; }
-
-      switch (op_type) {
-        case '!': return !val;
-        case TK_NEG: return -val;
-        case TK_REF: return vaddr_read_safe(val, 4);
-        default: assert(0);
-      }
+      if (!compile(dominated_op + 1, e, p)) { return false; }
     }
-
-    rtlreg_t val1 = eval(s, dominated_op - 1, success);
-    if (!*success) { return 0; }
-    rtlreg_t val2 = eval(dominated_op + 1, e, success);
-    if (!*success) { return 0; }
-
-    switch (op_type) {
-      case '+': return val1 + val2;
-      case '-': return val1 - val2;
-      case '*': return val1 * val2;
-      case '/': return val1 / val2;
-      case '%': return val1 % val2;
-      case TK_EQ: return val1 == val2;
-      case TK_NEQ: return val1 != val2;
-      case TK_AND: return val1 && val2;
-      case TK_OR: return val1 || val2;
-      default: assert(0);
+    else {
+      if (!compile(s, dominated_op - 1, p)) { return false; }
+      if (!compile(dominated_op + 1, e, p)) { return false; }
     }
+    p->op[p->nr_op ++].type = op_type;
+    return true;
   }
 }
-#endif
-
-word_t expr(char *e, bool *success) {
-  if (!make_token(e)) {
-    *success = false;
-    return 0;
-  }
-
-  /* TODO: Insert codes to evaluate the expression. */
-#ifdef __ICS_EXPORT
-  TODO();
-
-  return 0;
-#else
 
+static bool compile_tokens(ExprProg *p) {
   /* Detect TK_REF and TK_NEG tokens */
   int i;
   int prev_type;
@@ -309,6 +292,78 @@ word_t expr(char *e, bool *success) {
     }
   }
 
-  return eval(0, nr_token - 1, success);
+  p->nr_op = 0;
+  p->use_reg = false;
+  return compile(0, nr_token - 1, p);
+}
+
+ExprProg *expr_compile(char *e) {
+  if (!make_token(e)) { return NULL; }
+  ExprProg *p = malloc(sizeof(ExprProg));
+  if (!compile_tokens(p)) {
+    free(p);
+    return NULL;
+  }
+  return p;
+}
+
+bool expr_use_reg(ExprProg *p) {
+  return p->use_reg;
+}
+
+word_t expr_eval(ExprProg *p, void (*ref_hook)(vaddr_t addr, int len)) {
+  word_t stack[ARRLEN(p->op)];
+  int top = 0;
+  int i;
+  bool success;
+  for (i = 0; i < p->nr_op; i ++) {
+    ExprOp *op = &p->op[i];
+    switch (op->type) {
+      case TK_NUM: stack[top ++] = op->val; continue;
+      case TK_REG: stack[top ++] = isa_reg_str2val(op->reg, &success); continue;
+      case '!': stack[top - 1] = !stack[top - 1]; continue;
+      case TK_NEG: stack[top - 1] = -stack[top - 1]; continue;
+      case TK_REF:
+        if (ref_hook != NULL) { ref_hook(stack[top - 1], 4); }
+        stack[top - 1] = vaddr_read_safe(stack[top - 1], 4);
+        continue;
+    }
+
+    word_t val2 = stack[-- top];
+    word_t *val1 = &stack[top - 1];
+    switch (op->type) {
+      case '+': *val1 += val2; break;
+      case '-': *val1 -= val2; break;
+      case '*': *val1 *= val2; break;
+      case '/': *val1 /= val2; break;
+      case '%': *val1 %= val2; break;
+      case TK_EQ: *val1 = *val1 == val2; break;
+      case TK_NEQ: *val1 = *val1 != val2; break;
+      case TK_AND: *val1 = *val1 && val2; break;
+      case TK_OR: *val1 = *val1 || val2; break;
+      default: assert(0);
+    }
+  }
+  assert(top == 1);
+  return stack[0];
+}
+#endif
+
+word_t expr(char *e, bool *success) {
+  if (!make_token(e)) {
+    *success = false;
+    return 0;
+  }
+
+  /* TODO: Insert codes to evaluate the expression. */
+#ifdef __ICS_EXPORT
+  TODO();
+
+  return 0;
+#else
+
+  ExprProg p;
+  *success = compile_tokens(&p);
+  return *success ? expr_eval(&p, NULL) : 0;
 #endif
 }
@@ -15,6 +15,7 @@
 
 #include "debug.h"
 #include <common.h>
+#include <checkpoint/cpt_env.h>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
@@ -58,4 +59,16 @@ bool is_zstd_file(const char *filename){
 
   const uint8_t zstd_magic[4] = {0x28, 0xB5, 0x2F, 0xFD};
   return memcmp(buf, zstd_magic, 4) == 0;
-}
\ No newline at end of file
+}
+
+bool is_page_cpt_file(const char *filename){
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+
+  uint8_t buf[8];
+
+  size_t sz = read(fd, buf, 8);
+  close(fd);
+
+  return sz == 8 && memcmp(buf, PAGE_CPT_MAGIC, 8) == 0;
+}
@@ -29,6 +29,10 @@ int is_exit_status_bad() {
   } else {
     Log("NEMU exit with good state: %i, halt ret: %i", nemu_state.state, nemu_state.halt_ret);
   }
+#ifdef CONFIG_BIN_TRACE
+  extern void bintrace_close();
+  bintrace_close();
+#endif
   extern void log_close();
   log_close();
   return !good;
@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// An instruction decoded at a pc must be decoded again when mstatus.FS or
+// mstatus.MPRV is changed by the guest, which does not flush the decode
+// cache. Each loop below runs an instruction, flips the bit, and jumps back.
+
+#include <isa.h>
+#include <difftest.h>
+#include "test.h"
+
+#define BASE     0x80000000ul
+#define DATA     (BASE + 0x20000)
+#define DATA_MAP (BASE + 0x220000) // DATA is mapped here by a megapage
+
+enum { s0 = 8, a0 = 10, a1, a2, a3, a4, a5, a6, a7 };
+
+void difftest_init();
+void difftest_memcpy(paddr_t nemu_addr, void *dut_buf, size_t n, bool direction);
+void difftest_regcpy(void *dut, bool direction);
+void difftest_exec(uint64_t n);
+
+static uint32_t prog[] = {
+  SV39_PROLOGUE,           // 0x00
+  RV_CSRRW(0, 0x305, a6),  // 0x0c: csrw mtvec, a6
+  RV_CSRRS(0, 0x300, a5),  // 0x10: csrs mstatus, a5 (FS on)
+  RV_JAL(0, 0xc),          // 0x14: j 0x20
+  0, 0,
+  RV_FMV_D_X(1, a0),       // 0x20: fmv.d.x f1, a0
+  RV_CSRRC(0, 0x300, a5),  // 0x24: csrc mstatus, a5 (FS off)
+  RV_JAL(0, -8),           // 0x28: j 0x20
+  0, 0, 0, 0, 0,
+  RV_LD(s0, a0, 0),        // 0x40: ld s0, 0(a0), also the trap handler
+  RV_CSRRC(0, 0x300, a7),  // 0x44: csrc mstatus, a7 (MPP = U)
+  RV_CSRRS(0, 0x300, a4),  // 0x48: csrs mstatus, a4 (MPRV on, MPP = S)
+  RV_JAL(0, -12),          // 0x4c: j 0x40
+};
+
+static CPU_state state;
+
+static void ref_store(paddr_t addr, const void *buf, size_t n) {
+  difftest_memcpy(addr, (void *)buf, n, DIFFTEST_TO_REF);
+}
+
+static void step(int n) {
+  for (int i = 0; i < n; i ++) difftest_exec(1);
+  difftest_regcpy(&state, DIFFTEST_TO_DUT);
+}
+
+int main() {
+  difftest_init();
+  difftest_memcpy(BASE, prog, sizeof(prog), DIFFTEST_TO_REF);
+
+  sv39_map(ref_store, 0, DATA_MAP);
+  uint64_t data = 0x1111, data_map = 0x2222;
+  difftest_memcpy(DATA, &data, 8, DIFFTEST_TO_REF);
+  difftest_memcpy(DATA_MAP, &data_map, 8, DIFFTEST_TO_REF);
+
+  difftest_regcpy(&state, DIFFTEST_TO_DUT);
+  setup_sv39(ref_store, &state);
+  state.pc = BASE;
+  state.mode = 3;
+  state.mstatus &= ~(MSTATUS_FS | MSTATUS_MPP | MSTATUS_MPRV);
+  state.gpr[a0]._64 = DATA;
+  state.gpr[a5]._64 = MSTATUS_FS;
+  state.gpr[a6]._64 = BASE + 0x40;
+  difftest_regcpy(&state, DIFFTEST_TO_REF);
+
+  step(6);
+  CHECK(state.pc == BASE + 0x20, "pc = %lx", state.pc);
+  step(1);
+  CHECK(state.fpr[1]._64 == DATA, "f1 = %lx", state.fpr[1]._64);
+  step(2);
+  CHECK(state.pc == BASE + 0x20 && (state.mstatus & MSTATUS_FS) == 0, "pc = %lx", state.pc);
+  // fmv.d.x is illegal with FS off
+  step(1);
+  CHECK(state.pc == BASE + 0x40 && state.mcause == 2,
+      "pc = %lx, mcause = %lx", state.pc, state.mcause);
+
+  step(1);
+  CHECK(state.gpr[s0]._64 == data, "s0 = %lx", state.gpr[s0]._64);
+  step(3);
+  CHECK(state.pc == BASE + 0x40 && (state.mstatus & MSTATUS_MPRV), "pc = %lx", state.pc);
+  // ld is translated with MPRV on
+  step(1);
+  CHECK(state.gpr[s0]._64 == data_map, "s0 = %lx", state.gpr[s0]._64);
+  return 0;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// The main decode table is ordered so that the patterns testing only the
+// opcode compile to a jump table, and the M extension is dispatched by op and
+// op32. Every 4-byte instruction must still decode to the same instruction as
+// with the original order below. RVC instructions do not go through the main
+// table.
+
+#include "../src/isa/riscv64/instr/decode.c"
+#include "test.h"
+
+def_THelper(main_ref) {
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00000 ??", I     , load);
+#ifndef CONFIG_FPU_NONE
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00001 ??", fload , fload);
+#endif // CONFIG_FPU_NONE
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00011 ??", I     , mem_fence);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00100 ??", I     , op_imm);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00101 ??", auipc , auipc);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 00110 ??", I     , op_imm32);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01000 ??", S     , store);
+#ifndef CONFIG_FPU_NONE
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01001 ??", fstore, fstore);
+#endif // CONFIG_FPU_NONE
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01011 ??", R     , atomic);
+  def_INSTR_IDTAB("0000001 ????? ????? ??? ????? 01100 ??", R     , rvm);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01100 ??", R     , op);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01101 ??", U     , lui);
+  def_INSTR_IDTAB("0000001 ????? ????? ??? ????? 01110 ??", R     , rvm32);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 01110 ??", R     , op32);
+#ifndef CONFIG_FPU_NONE
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10000 ??", R4    , fmadd_dispatch);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10001 ??", R4    , fmadd_dispatch);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10010 ??", R4    , fmadd_dispatch);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10011 ??", R4    , fmadd_dispatch);
+  def_INSTR_TAB  ("??????? ????? ????? ??? ????? 10100 ??",         op_fp);
+#endif // CONFIG_FPU_NONE
+#ifdef CONFIG_RVV
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 10101 ??", OP_V  , OP_V);
+#endif // CONFIG_RVV
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11000 ??", B     , branch);
+  def_INSTR_IDTAB("??????? ????? ????? 000 ????? 11001 ??", I     , jalr_dispatch);
+  def_INSTR_TAB  ("??????? ????? ????? 000 ????? 11010 ??",         nemu_trap);
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11011 ??", J     , jal_dispatch);
+#ifdef CONFIG_RVH
+  def_INSTR_TAB  ("??????? ????? ????? ??? ????? 11100 ??",         system);
+#else
+  def_INSTR_IDTAB("??????? ????? ????? ??? ????? 11100 ??", csr   , system);
+#endif
+  return table_inv(s);
+};
+
+int main() {
+  static Decode s;
+  uint64_t nr_instr = 0;
+  for (uint64_t hi = 0; hi < (1ul << 30); hi ++) {
+    s.isa.instr.val = hi << 2 | 0x3;
+    int ref = table_main_ref(&s);
+    int idx = table_main(&s);
+    CHECK(idx == ref, "instr = 0x%08x: EXEC_ID = %d, expected %d", s.isa.instr.val, idx, ref);
+    nr_instr ++;
+  }
+  printf("%ld instructions decoded\n", nr_instr);
+  return 0;
+}
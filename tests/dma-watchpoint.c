@@ -0,0 +1,56 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// A watchpoint on memory must be hit when a device writes the memory by DMA,
+// as when the CPU stores to it. A DMA write to another page must not make the
+// watchpoints be evaluated again.
+
+#include <isa.h>
+#include <utils.h>
+#include <memory/paddr.h>
+#include "test.h"
+
+#define BASE    0x80000000ul
+#define WATCHED (BASE + 0x1000)
+#define OTHER   (BASE + 0x3000)
+
+void init_monitor(int argc, char *argv[]);
+int set_watchpoint(char *e);
+void scan_watchpoint(vaddr_t pc);
+
+static uint32_t prog[] = { RVC_NOP | RVC_NOP << 16 };
+
+int main() {
+  FILE *fp = fopen("dma-watchpoint.bin", "wb");
+  CHECK(fp && fwrite(prog, sizeof(prog), 1, fp) == 1, "can not write the image");
+  fclose(fp);
+  char *argv[] = { "dma-watchpoint", "-b", "dma-watchpoint.bin", NULL };
+  init_monitor(3, argv);
+
+  char e[] = "*0x80001000";
+  CHECK(set_watchpoint(e) >= 0, "can not set the watchpoint");
+  CHECK(wp_nr_ref > 0 && !wp_need_scan, "nr_ref = %d", wp_nr_ref);
+
+  uint32_t data = 0x1234;
+  paddr_dma_write(OTHER, sizeof(data), &data);
+  CHECK(!wp_need_scan, "a DMA write to another page is caught");
+
+  paddr_dma_write(WATCHED, sizeof(data), &data);
+  CHECK(wp_need_scan, "a DMA write to the watched memory is missed");
+  nemu_state.state = NEMU_RUNNING;
+  scan_watchpoint(BASE);
+  CHECK(nemu_state.state == NEMU_STOP, "state = %d", nemu_state.state);
+  return 0;
+}
@@ -0,0 +1,91 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// A batch reports the register written by each instruction, even when its
+// value is unchanged, and ends with the exception raised by an instruction.
+
+#include <isa.h>
+#include <difftest.h>
+#include "test.h"
+
+#define BASE 0x80000000ul
+#define DATA (BASE + 0x20000)
+
+enum { a0 = 10, a1, a2, a3, a4, a5, a6 };
+
+void difftest_init();
+void difftest_memcpy(paddr_t nemu_addr, void *dut_buf, size_t n, bool direction);
+void difftest_regcpy(void *dut, bool direction);
+uint64_t difftest_exec_batch(void *ring, uint64_t ring_size, uint64_t *tail, uint64_t n);
+
+static uint32_t prog[] = {
+  RV_CSRRW(0, 0x305, a6),     // 0x00: csrw mtvec, a6
+  RV_ADDI(a1, a0, 1),         // 0x04: addi a1, a0, 1
+  RVC_NOP << 16 | RVC_LI(a2, 5), // 0x08: c.li a2, 5; c.nop
+  RV_FMV_D_X(1, a0),          // 0x0c: fmv.d.x f1, a0
+  RV_SD(a1, a0, 0),           // 0x10: sd a1, 0(a0)
+  RV_ADDI(a3, a3, 0),         // 0x14: addi a3, a3, 0
+  0,                          // 0x18: illegal instruction
+  0,
+  RV_ADDI(a4, 0, 7),          // 0x20: addi a4, zero, 7, the trap handler
+};
+
+#define RING_SIZE 8
+
+int main() {
+  difftest_init();
+  difftest_memcpy(BASE, prog, sizeof(prog), DIFFTEST_TO_REF);
+
+  static CPU_state state;
+  difftest_regcpy(&state, DIFFTEST_TO_DUT);
+  state.pc = BASE;
+  state.mode = 3;
+  state.mstatus |= MSTATUS_FS;
+  state.gpr[a0]._64 = DATA;
+  state.gpr[a3]._64 = 0x3333;
+  state.gpr[a6]._64 = BASE + 0x20;
+  difftest_regcpy(&state, DIFFTEST_TO_REF);
+
+  struct CommitRecord ring[RING_SIZE];
+  uint64_t tail = 0;
+  uint64_t n = difftest_exec_batch(ring, RING_SIZE, &tail, 3);
+  CHECK(n == 3 && tail == 3, "n = %ld, tail = %ld", n, tail);
+  CHECK(ring[0].pc == BASE && ring[0].flags == 0, "flags = %x", ring[0].flags);
+  CHECK(ring[1].flags == COMMIT_RD && ring[1].rd == a1 && ring[1].rd_val == DATA + 1,
+      "flags = %x, rd = %d", ring[1].flags, ring[1].rd);
+  CHECK(ring[2].pc == BASE + 0x8 && ring[2].instr == RVC_LI(a2, 5) &&
+      ring[2].flags == COMMIT_RD && ring[2].rd == a2 && ring[2].rd_val == 5,
+      "instr = %x, flags = %x, rd = %d", ring[2].instr, ring[2].flags, ring[2].rd);
+
+  n = difftest_exec_batch(ring, RING_SIZE, &tail, 100);
+  CHECK(n == 5 && tail == 8, "n = %ld, tail = %ld", n, tail);
+  // c.nop writes x0, which is not reported
+  CHECK(ring[3].pc == BASE + 0xa && ring[3].flags == 0, "flags = %x", ring[3].flags);
+  CHECK(ring[4].flags == COMMIT_FRD && ring[4].rd == 1 && ring[4].rd_val == DATA,
+      "flags = %x, rd = %d", ring[4].flags, ring[4].rd);
+  CHECK(ring[5].flags == COMMIT_STORE && ring[5].saddr == DATA && ring[5].sdata == DATA + 1 &&
+      ring[5].smask == 0xff, "flags = %x", ring[5].flags);
+  // the value of a3 is unchanged
+  CHECK(ring[6].flags == COMMIT_RD && ring[6].rd == a3 && ring[6].rd_val == 0x3333,
+      "flags = %x, rd = %d", ring[6].flags, ring[6].rd);
+  CHECK(ring[7].pc == BASE + 0x18 && ring[7].flags == COMMIT_TRAP && ring[7].cause == 2,
+      "pc = %lx, flags = %x, cause = %lx", ring[7].pc, ring[7].flags, ring[7].cause);
+
+  // the record wraps around the ring
+  n = difftest_exec_batch(ring, RING_SIZE, &tail, 1);
+  CHECK(n == 1 && tail == 9 && ring[0].pc == BASE + 0x20 && ring[0].flags == COMMIT_RD && ring[0].rd == a4,
+      "n = %ld, pc = %lx, flags = %x", n, ring[0].pc, ring[0].flags);
+  return 0;
+}
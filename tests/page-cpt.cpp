@@ -0,0 +1,80 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// pmem is written as a checkpoint in PAGE_FORMAT and loaded back. Only pages
+// of the same contents may share an entry of the page store, including
+// pages differing in one byte or only in the order of their words.
+
+#include <checkpoint/cpt_env.h>
+#include <checkpoint/path_manager.h>
+#include <checkpoint/serializer.h>
+#include <filesystem>
+#include <vector>
+
+extern "C" {
+#include <memory/paddr.h>
+#include "test.h"
+long load_page_cpt(const char *filename);
+}
+
+#define PAGE PAGE_CPT_PAGE_SIZE
+#define NR_PAGE 8
+
+static uint8_t *page(int i) { return guest_to_host(CONFIG_MBASE + i * PAGE); }
+
+int main() {
+  init_mem();
+  output_base_dir = (char *)"page-cpt.out";
+  config_name = (char *)"config";
+  workload_name = (char *)"workload";
+  pathManager.init();
+  std::string cpt_dir = pathManager.getWorkloadPath() + "0/";
+  std::filesystem::create_directories(cpt_dir);
+  std::string cpt = cpt_dir + "_0_.pages";
+
+  memset(guest_to_host(CONFIG_MBASE), 0, MEMORY_SIZE);
+  for (int i = 0; i < PAGE; i ++) page(0)[i] = i * 7 % 13; // compressible
+  memcpy(page(1), page(0), PAGE);
+  memcpy(page(2), page(0), PAGE);
+  page(2)[PAGE - 1] ^= 1;
+  for (int i = 0; i < PAGE; i ++) page(4)[i] = rand(); // raw in the page store
+  memcpy(page(5), page(4), PAGE);
+  // the words of page 0 in reverse order
+  for (int i = 0; i < PAGE / 8; i ++) memcpy(page(6) + i * 8, page(0) + PAGE - (i + 1) * 8, 8);
+  std::vector<uint8_t> saved(guest_to_host(CONFIG_MBASE), guest_to_host(CONFIG_MBASE) + NR_PAGE * PAGE);
+
+  Serializer serializer;
+  serializer.serializePMemPages(cpt, guest_to_host(CONFIG_MBASE), MEMORY_SIZE);
+
+  FILE *fp = fopen(cpt.c_str(), "rb");
+  page_cpt_header_t header;
+  page_cpt_entry_t e[NR_PAGE];
+  CHECK(fp && fread(&header, sizeof(header), 1, fp) == 1, "can not read %s", cpt.c_str());
+  CHECK(header.nr_pages == 6, "nr_pages = %lu", header.nr_pages);
+  CHECK(fread(e, sizeof(e[0]), header.nr_pages, fp) == header.nr_pages, "can not read %s", cpt.c_str());
+  fclose(fp);
+  // pages 0, 1, 2, 4, 5, 6
+  CHECK(e[1].offset == e[0].offset, "page 1 is not shared with page 0");
+  CHECK(e[4].offset == e[3].offset, "page 5 is not shared with page 4");
+  CHECK(e[2].offset != e[0].offset && e[5].offset != e[0].offset, "different pages are shared");
+
+  memset(guest_to_host(CONFIG_MBASE), 0xff, (NR_PAGE + 1) * PAGE);
+  CHECK(load_page_cpt(cpt.c_str()) == (long)MEMORY_SIZE, "load failed");
+  CHECK(memcmp(saved.data(), guest_to_host(CONFIG_MBASE), NR_PAGE * PAGE) == 0, "pmem differs");
+  for (int i = 0; i < PAGE; i ++) {
+    CHECK(page(NR_PAGE)[i] == 0, "page %d is not zeroed", NR_PAGE);
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// A snapshot is saved, then a page table entry is changed and the guest is
+// told to run sfence.vma, so its next load fills the guest TLB with the new
+// mapping. Loading the snapshot restores the page table without sfence.vma,
+// so the same load must see the old mapping again.
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include "test.h"
+
+#define BASE     0x80000000ul
+#define DATA     (BASE + 0x20000)
+#define DATA_OLD (BASE + 0x220000) // where DATA is mapped by a megapage
+#define DATA_NEW (BASE + 0x420000) // where DATA is mapped after the change
+#define FLAG     (BASE + 0x200000) // set to run sfence.vma
+#define FLAG_MAP (BASE + 0x600000)
+
+enum { t1 = 6, s0 = 8, a0 = 10, a1, a2, a3, a4, a5, a6, a7 };
+
+void init_monitor(int argc, char *argv[]);
+
+static uint32_t prog[] = {
+  SV39_PROLOGUE,           // 0x00
+  RV_CSRRC(0, 0x300, a7),  // 0x0c: csrc mstatus, a7 (MPP = U)
+  RV_CSRRS(0, 0x300, a4),  // 0x10: csrs mstatus, a4 (MPRV on, MPP = S)
+  RV_LD(s0, a0, 0),        // 0x14: ld s0, 0(a0)
+  RV_LD(t1, a5, 0),        // 0x18: ld t1, 0(a5)
+  RV_BEQ(t1, 0, -8),       // 0x1c: beqz t1, 0x14
+  RV_SFENCE_VMA(0, 0),     // 0x20: sfence.vma
+  RV_SD(0, a5, 0),         // 0x24: sd zero, 0(a5)
+  RV_JAL(0, -20),          // 0x28: j 0x14
+};
+
+static void pmem_store(paddr_t addr, const void *buf, size_t n) {
+  memcpy(guest_to_host(addr), buf, n);
+}
+
+int main() {
+  FILE *fp = fopen("snapshot-gtlb.bin", "wb");
+  CHECK(fp && fwrite(prog, sizeof(prog), 1, fp) == 1, "can not write the image");
+  fclose(fp);
+  char *argv[] = { "snapshot-gtlb", "-b", "snapshot-gtlb.bin", NULL };
+  init_monitor(3, argv);
+
+  setup_sv39(pmem_store, &cpu);
+  sv39_map(pmem_store, 0, DATA_OLD);
+  sv39_map(pmem_store, 1, FLAG_MAP);
+  uint64_t data_old = 0x1111, data_new = 0x2222;
+  memcpy(guest_to_host(DATA_OLD), &data_old, 8);
+  memcpy(guest_to_host(DATA_NEW), &data_new, 8);
+
+  cpu.gpr[a0]._64 = DATA;
+  cpu.gpr[a5]._64 = FLAG;
+  cpu_exec(100);
+  CHECK(cpu.gpr[s0]._64 == data_old, "s0 = %lx", cpu.gpr[s0]._64);
+  snapshot_save("snapshot-gtlb.gz", true);
+
+  sv39_map(pmem_store, 0, DATA_NEW);
+  uint64_t flag = 1;
+  memcpy(guest_to_host(FLAG_MAP), &flag, 8);
+  cpu_exec(100);
+  CHECK(cpu.gpr[s0]._64 == data_new, "s0 = %lx", cpu.gpr[s0]._64);
+
+  snapshot_load("snapshot-gtlb.gz");
+  cpu.gpr[s0]._64 = 0;
+  cpu_exec(100);
+  CHECK(cpu.gpr[s0]._64 == data_old, "s0 = %lx", cpu.gpr[s0]._64);
+  return 0;
+}
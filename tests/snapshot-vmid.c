@@ -0,0 +1,116 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// A guest in VS mode loads from DATA, which the G-stage tables of VMID 1 and
+// VMID 2 map to different pages. A snapshot is saved with VMID 2, and loaded
+// after the guest has switched to VMID 1. The loads after that must be cached
+// for VMID 2, so switching to VMID 1 again must see the mapping of VMID 1.
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include "test.h"
+
+#define BASE     0x80000000ul
+#define G_ROOT_1 (BASE + 0x10000) // Sv39x4 root tables are 16 KiB
+#define G_ROOT_2 (BASE + 0x14000)
+#define G_L1_1   (BASE + 0x18000)
+#define G_L1_2   (BASE + 0x19000)
+#define DATA     0xc0000000ul      // a guest physical address
+#define DATA_1   (BASE + 0x200000) // where DATA is mapped for VMID 1
+#define DATA_2   (BASE + 0x400000) // where DATA is mapped for VMID 2
+#define FLAG     (BASE + 0x600000) // set to switch to VMID 1
+// not walked by the guest, but data accesses of V mode are translated only
+// if satp is not bare
+#define PT_HS    (BASE + 0x1a000)
+
+#define MSTATUS_MPV (1ul << 39)
+#define HGATP(vmid, root) (8ul << 60 | (uint64_t)(vmid) << 44 | (root) >> 12) // Sv39x4
+
+enum { t0 = 5, t1, t2, s0, a0 = 10, a1, a2, a3, a4, a5, a6, a7, t3 = 28 };
+
+void init_monitor(int argc, char *argv[]);
+
+static uint32_t prog[] = {
+  RV_CSRRW(0, 0x3b0, t0),  // 0x00: csrw pmpaddr0, t0
+  RV_CSRRW(0, 0x3a0, t2),  // 0x04: csrw pmpcfg0, t2
+  RV_CSRRW(0, 0x180, t3),  // 0x08: csrw satp, t3
+  RV_CSRRW(0, 0x305, a6),  // 0x0c: csrw mtvec, a6
+  RV_CSRRW(0, 0x680, a3),  // 0x10: csrw hgatp, a3
+  RV_CSRRC(0, 0x300, a7),  // 0x14: csrc mstatus, a7 (MPP = U)
+  RV_CSRRS(0, 0x300, a4),  // 0x18: csrs mstatus, a4 (MPV on, MPP = S)
+  RV_CSRRW(0, 0x341, a5),  // 0x1c: csrw mepc, a5
+  RV_MRET,                 // 0x20: mret
+  RV_LD(s0, a0, 0),        // 0x24: ld s0, 0(a0), the guest
+  RV_LD(t1, a1, 0),        // 0x28: ld t1, 0(a1)
+  RV_BEQ(t1, 0, -8),       // 0x2c: beqz t1, 0x24
+  RV_ECALL,                // 0x30: ecall
+  RV_CSRRW(0, 0x680, a2),  // 0x34: csrw hgatp, a2, the trap handler
+  RV_SD(0, a1, 0),         // 0x38: sd zero, 0(a1)
+  RV_CSRRW(0, 0x341, a5),  // 0x3c: csrw mepc, a5
+  RV_MRET,                 // 0x40: mret
+};
+
+static void store(paddr_t addr, uint64_t val) {
+  memcpy(guest_to_host(addr), &val, 8);
+}
+
+static void map_guest(paddr_t root, paddr_t l1, paddr_t data) {
+  store(root + 2 * 8, (BASE >> 12) << 10 | 0xdf);  // identity gigapage, DAU-XWRV
+  store(root + 3 * 8, (l1 >> 12) << 10 | 0x1);
+  store(l1, (data >> 12) << 10 | 0xdf);            // megapage of DATA
+}
+
+int main() {
+  FILE *fp = fopen("snapshot-vmid.bin", "wb");
+  CHECK(fp && fwrite(prog, sizeof(prog), 1, fp) == 1, "can not write the image");
+  fclose(fp);
+  char *argv[] = { "snapshot-vmid", "-b", "snapshot-vmid.bin", NULL };
+  init_monitor(3, argv);
+
+  map_guest(G_ROOT_1, G_L1_1, DATA_1);
+  map_guest(G_ROOT_2, G_L1_2, DATA_2);
+  store(DATA_1, 0x1111);
+  store(DATA_2, 0x2222);
+
+  cpu.gpr[t0]._64 = -1ul;
+  cpu.gpr[t2]._64 = 0x1f;                       // NAPOT, RWX
+  cpu.gpr[t3]._64 = 8ul << 60 | PT_HS >> 12;    // Sv39
+  cpu.gpr[a0]._64 = DATA;
+  cpu.gpr[a1]._64 = FLAG;
+  cpu.gpr[a2]._64 = HGATP(1, G_ROOT_1);
+  cpu.gpr[a3]._64 = HGATP(2, G_ROOT_2);
+  cpu.gpr[a4]._64 = MSTATUS_MPV | 1ul << 11;    // MPP = S
+  cpu.gpr[a5]._64 = BASE + 0x24;
+  cpu.gpr[a6]._64 = BASE + 0x34;
+  cpu.gpr[a7]._64 = MSTATUS_MPP;
+  cpu_exec(100);
+  CHECK(cpu.v && cpu.gpr[s0]._64 == 0x2222, "v = %ld, s0 = %lx", cpu.v, cpu.gpr[s0]._64);
+  snapshot_save("snapshot-vmid.gz", true);
+
+  store(FLAG, 1);
+  cpu_exec(100);
+  CHECK(cpu.v && cpu.gpr[s0]._64 == 0x1111, "v = %ld, s0 = %lx", cpu.v, cpu.gpr[s0]._64);
+
+  snapshot_load("snapshot-vmid.gz");
+  cpu.gpr[s0]._64 = 0;
+  cpu_exec(100);
+  CHECK(cpu.gpr[s0]._64 == 0x2222, "s0 = %lx", cpu.gpr[s0]._64);
+
+  store(FLAG, 1);
+  cpu_exec(100);
+  CHECK(cpu.gpr[s0]._64 == 0x1111, "s0 = %lx", cpu.gpr[s0]._64);
+  return 0;
+}
@@ -0,0 +1,53 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// Every byte of a big block of SparseRam, from the first one to the last one,
+// is kept in the block, and none of them goes to the pages.
+
+#include <memory/sparseram.h>
+#include "test.h"
+
+#define BLK_START 0x80001000ul
+#define BLK_END   0x80003000ul
+
+int main() {
+  void *mem = sparse_mem_new(SP_PAGE_SIZE / 1024, 1024);
+  sparse_mem_blk_add(mem, "blk", BLK_START, BLK_END);
+  uint8_t *blk = sparse_mem_blk_get(mem, "blk");
+
+  sparse_mem_wwrite(mem, BLK_START, 8, 0x1111);
+  sparse_mem_wwrite(mem, BLK_END - 8, 8, 0x2222);
+  uint8_t byte = 0x33;
+  sparse_mem_write(mem, BLK_START + 8, 1, &byte);
+
+  CHECK(*(uint64_t *)blk == 0x1111, "first word = %lx", *(uint64_t *)blk);
+  CHECK(*(uint64_t *)(blk + (BLK_END - BLK_START) - 8) == 0x2222, "last word wrong");
+  CHECK(blk[8] == 0x33, "byte = %x", blk[8]);
+  CHECK(sparse_mem_wread(mem, BLK_START, 8) == 0x1111, "read = %lx", sparse_mem_wread(mem, BLK_START, 8));
+
+  // the page at the start of the block is served by the block
+  CHECK(sparse_mem_host_addr(mem, BLK_START, false) == blk, "host address of the first page");
+  CHECK(sparse_mem_host_addr(mem, BLK_START, true) == blk, "host address of the first page");
+
+  // bytes around the block are in the pages
+  sparse_mem_wwrite(mem, BLK_START - 8, 8, 0x4444);
+  sparse_mem_wwrite(mem, BLK_END, 8, 0x5555);
+  CHECK(sparse_mem_wread(mem, BLK_START - 8, 8) == 0x4444, "word before the block");
+  CHECK(sparse_mem_wread(mem, BLK_END, 8) == 0x5555, "word after the block");
+  CHECK(*(uint64_t *)blk == 0x1111, "first word = %lx", *(uint64_t *)blk);
+
+  sparse_mem_del(mem);
+  return 0;
+}
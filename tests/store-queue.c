@@ -0,0 +1,58 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+// More stores than the ring holds are committed before the DUT checks
+// them. None of them may be lost, and they must come out in order.
+
+#include <memory/store_queue_wrapper.h>
+#include "test.h"
+
+#define NR_STORE (STORE_QUEUE_SIZE * 4 + 3)
+
+int difftest_store_commit_batch(uint64_t *saddr, uint64_t *sdata, uint8_t *smask, int n);
+
+static uint64_t addr[NR_STORE], data[NR_STORE];
+static uint8_t mask[NR_STORE];
+
+int main() {
+  for (int i = 0; i < NR_STORE; i ++) {
+    store_commit_queue_push(0x80000000 + i * 8, i, 8, 0);
+    addr[i] = 0x80000000 + i * 8;
+    data[i] = i;
+    mask[i] = 0xff;
+  }
+  CHECK(store_queue_nr_overflow() == 3, "overflow = %ld", store_queue_nr_overflow());
+  CHECK(store_queue_size() == NR_STORE, "size = %ld", store_queue_size());
+
+  // the first stores are drained, the others are checked as a batch
+  store_commit_t buf[3];
+  CHECK(store_queue_drain(buf, 3) == 3, "drain");
+  for (int i = 0; i < 3; i ++) {
+    CHECK(buf[i].addr == addr[i] && buf[i].data == data[i], "store %d", i);
+  }
+  int n = difftest_store_commit_batch(addr + 3, data + 3, mask + 3, NR_STORE - 3);
+  CHECK(n == NR_STORE - 3, "mismatch at store %d", n + 3);
+  CHECK(store_queue_empty(), "size = %ld", store_queue_size());
+
+  // the queue keeps working across the end of the grown ring
+  for (int i = 0; i < NR_STORE; i ++) {
+    store_commit_queue_push(0x80000000, i, 8, 0);
+    store_commit_t s = store_queue_fornt();
+    store_queue_pop();
+    CHECK(s.data == i, "store %d: data = %ld", i, s.data);
+  }
+  CHECK(store_queue_nr_overflow() == 3, "overflow = %ld", store_queue_nr_overflow());
+  return 0;
+}
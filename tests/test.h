@@ -0,0 +1,100 @@
+/***************************************************************************************
+* Copyright (c) 2020-2022 Institute of Computing Technology, Chinese Academy of Sciences
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <isa.h>
+
+#define CHECK(cond, ...) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__); \
+      fprintf(stderr, "\n"); \
+      exit(1); \
+    } \
+  } while (0)
+
+// encoders of the RISC-V instructions used by the tests
+#define RV_I(imm, rs1, funct3, rd, opcode) \
+  (((uint32_t)(imm) & 0xfff) << 20 | (rs1) << 15 | (funct3) << 12 | (rd) << 7 | (opcode))
+#define RV_R(funct7, rs2, rs1, funct3, rd, opcode) \
+  ((uint32_t)(funct7) << 25 | (rs2) << 20 | (rs1) << 15 | (funct3) << 12 | (rd) << 7 | (opcode))
+#define RV_S(imm, rs2, rs1, funct3, opcode) \
+  (((uint32_t)(imm) >> 5 & 0x7f) << 25 | (rs2) << 20 | (rs1) << 15 | (funct3) << 12 | \
+   ((uint32_t)(imm) & 0x1f) << 7 | (opcode))
+#define RV_B(imm, rs2, rs1, funct3, opcode) \
+  (((uint32_t)(imm) >> 12 & 1) << 31 | ((uint32_t)(imm) >> 5 & 0x3f) << 25 | (rs2) << 20 | \
+   (rs1) << 15 | (funct3) << 12 | ((uint32_t)(imm) >> 1 & 0xf) << 8 | \
+   ((uint32_t)(imm) >> 11 & 1) << 7 | (opcode))
+#define RV_J(imm, rd, opcode) \
+  (((uint32_t)(imm) >> 20 & 1) << 31 | ((uint32_t)(imm) >> 1 & 0x3ff) << 21 | \
+   ((uint32_t)(imm) >> 11 & 1) << 20 | ((uint32_t)(imm) >> 12 & 0xff) << 12 | (rd) << 7 | (opcode))
+
+#define RV_ADDI(rd, rs1, imm)  RV_I(imm, rs1, 0, rd, 0x13)
+#define RV_LD(rd, rs1, imm)    RV_I(imm, rs1, 3, rd, 0x03)
+#define RV_SD(rs2, rs1, imm)   RV_S(imm, rs2, rs1, 3, 0x23)
+#define RV_BEQ(rs1, rs2, imm)  RV_B(imm, rs2, rs1, 0, 0x63)
+#define RV_JAL(rd, imm)        RV_J(imm, rd, 0x6f)
+#define RV_CSRRW(rd, csr, rs1) RV_I(csr, rs1, 1, rd, 0x73)
+#define RV_CSRRS(rd, csr, rs1) RV_I(csr, rs1, 2, rd, 0x73)
+#define RV_CSRRC(rd, csr, rs1) RV_I(csr, rs1, 3, rd, 0x73)
+#define RV_FMV_D_X(rd, rs1)    RV_R(0x79, 0, rs1, 0, rd, 0x53)
+#define RV_SFENCE_VMA(rs1, rs2) RV_R(0x09, rs2, rs1, 0, 0, 0x73)
+#define RV_ECALL               0x00000073
+#define RV_MRET                0x30200073
+#define RVC_LI(rd, imm)        (0x4001 | (rd) << 7 | ((imm) & 0x1f) << 2)
+#define RVC_NOP                0x0001
+
+#define MSTATUS_FS   (3ul << 13)
+#define MSTATUS_MPP  (3ul << 11)
+#define MSTATUS_MPRV (1ul << 17)
+
+// The tests translating data accesses use an Sv39 page table at PT_ROOT. The
+// gigapage of 0x80000000 points to PT_L1, whose entries are megapages set by
+// sv39_map(). The program starts with SV39_PROLOGUE in M mode, and loads and
+// stores are translated once the registers set by setup_sv39() are written to
+// mstatus: csrc mstatus, a7, then csrs mstatus, a4.
+#define PT_ROOT (0x80000000ul + 0x10000)
+#define PT_L1   (0x80000000ul + 0x11000)
+
+#define SV39_PROLOGUE \
+  RV_CSRRW(0, 0x3b0, 11),  /* csrw pmpaddr0, a1 */ \
+  RV_CSRRW(0, 0x3a0, 12),  /* csrw pmpcfg0, a2 */ \
+  RV_CSRRW(0, 0x180, 13)   /* csrw satp, a3 */
+
+// writes the memory of the machine tested, which differs with the API used
+typedef void (*test_write_t)(paddr_t addr, const void *buf, size_t n);
+
+static inline void sv39_map(test_write_t write, int idx, paddr_t paddr) {
+  uint64_t pte = ((paddr & ~0x1ffffful) >> 12) << 10 | 0xcf; // DA--XWRV
+  write(PT_L1 + idx * 8, &pte, 8);
+}
+
+static inline void setup_sv39(test_write_t write, CPU_state *s) {
+  uint64_t pte = (PT_L1 >> 12) << 10 | 0x1;
+  write(PT_ROOT + 2 * 8, &pte, 8);
+  s->gpr[11]._64 = -1ul;                      // a1: pmpaddr0 covers all
+  s->gpr[12]._64 = 0x1f;                      // a2: NAPOT, RWX
+  s->gpr[13]._64 = 8ul << 60 | PT_ROOT >> 12; // a3: Sv39
+  s->gpr[14]._64 = MSTATUS_MPRV | 1ul << 11;  // a4: MPRV on, MPP = S
+  s->gpr[17]._64 = MSTATUS_MPP;               // a7: MPP = U
+}
+
+#endif
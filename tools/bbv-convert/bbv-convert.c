@@ -0,0 +1,68 @@
+// Convert a binary SimPoint BBV (simpoint_bbv.zst) written by
+// --simpoint-bbv-format=bin to the text format of simpoint_bbv.gz.
+//   usage: bbv-convert simpoint_bbv.zst | gzip > simpoint_bbv.gz
+
+#include <profiling/zstd_reader.h>
+
+static zstd_reader_t in;
+
+static void fatal(const char *msg) {
+  fprintf(stderr, "bbv-convert: %s\n", msg);
+  exit(1);
+}
+
+// return the next decompressed byte, or -1 at the end of the file
+static int next_byte() {
+  int c = zstd_reader_getc(&in);
+  if (c < 0 && in.error != NULL) fatal(in.error);
+  return c;
+}
+
+static bool get_varint(uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; ; shift += 7) {
+    int c = next_byte();
+    if (c < 0) {
+      if (shift == 0) return false;
+      fatal("truncated file");
+    }
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s simpoint_bbv.zst\n", argv[0]);
+    return 1;
+  }
+  FILE *fp = fopen(argv[1], "rb");
+  if (fp == NULL) fatal("cannot open the input file");
+  zstd_reader_init(&in, fp);
+
+  char magic[8];
+  for (int i = 0; i < 8; i ++) {
+    int c = next_byte();
+    if (c < 0) fatal("not a binary BBV file");
+    magic[i] = c;
+  }
+  if (memcmp(magic, "NEMUBBV1", 8) != 0) fatal("not a binary BBV file");
+  uint64_t interval;
+  if (!get_varint(&interval)) fatal("truncated file");
+  fprintf(stderr, "bbv-convert: interval size = %lu\n", interval);
+
+  uint64_t n;
+  while (get_varint(&n)) {
+    uint64_t id = 0, delta, count;
+    fputs("T", stdout);
+    for (uint64_t i = 0; i < n; i ++) {
+      if (!get_varint(&delta) || !get_varint(&count)) fatal("truncated file");
+      id += delta;
+      printf(":%lu:%lu ", id, count);
+    }
+    fputs("\n", stdout);
+  }
+
+  zstd_reader_close(&in);
+  return 0;
+}
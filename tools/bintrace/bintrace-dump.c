@@ -0,0 +1,53 @@
+// Print a binary trace written by --bin-trace as text, one record per line.
+//   usage: bintrace-dump [-n max_records] trace.zst
+
+#include "bintrace-reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const char *type_name[] = {
+  [BINTRACE_TYPE_N] = "-", [BINTRACE_TYPE_J] = "j",
+  [BINTRACE_TYPE_B] = "b", [BINTRACE_TYPE_I] = "i",
+};
+
+static void dump_inst(const bintrace_inst_t *r) {
+  printf("%016lx %08x %s%s", r->pc, r->instr, type_name[r->type & 3], r->taken ? " taken" : "");
+  for (int i = 0; i < r->nr_load && i < BINTRACE_NR_MEM; i ++) printf(" ld:%lx", r->load[i]);
+  if (r->nr_load > BINTRACE_NR_MEM) printf(" ld:+%d", r->nr_load - BINTRACE_NR_MEM);
+  for (int i = 0; i < r->nr_store && i < BINTRACE_NR_MEM; i ++) printf(" st:%lx", r->store[i]);
+  if (r->nr_store > BINTRACE_NR_MEM) printf(" st:+%d", r->nr_store - BINTRACE_NR_MEM);
+  putchar('\n');
+}
+
+static void dump_bb(const bintrace_bb_t *r) {
+  printf("%lu %016lx -> %016lx %s%s\n", r->icount, r->pc, r->target,
+      type_name[r->type & 3], r->taken ? " taken" : "");
+}
+
+int main(int argc, char *argv[]) {
+  uint64_t max = UINT64_MAX;
+  int o;
+  while ((o = getopt(argc, argv, "n:")) != -1) {
+    if (o == 'n') max = strtoull(optarg, NULL, 0);
+    else break;
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "usage: %s [-n max_records] trace.zst\n", argv[0]);
+    return 1;
+  }
+  bintrace_reader_t *r = bintrace_reader_open(argv[optind]);
+  if (r == NULL) return 1;
+
+  union { bintrace_inst_t inst; bintrace_bb_t bb; } rec;
+  uint64_t n = 0;
+  bool is_inst = bintrace_reader_kind(r) == BINTRACE_INST;
+  for (; n < max && bintrace_reader_next(r, &rec); n ++) {
+    if (is_inst) dump_inst(&rec.inst);
+    else dump_bb(&rec.bb);
+  }
+  fprintf(stderr, "bintrace-dump: %lu records\n", n);
+
+  bintrace_reader_close(r);
+  return 0;
+}
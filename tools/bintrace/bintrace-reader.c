@@ -0,0 +1,56 @@
+#include "bintrace-reader.h"
+#include <profiling/zstd_reader.h>
+
+struct bintrace_reader {
+  zstd_reader_t in;
+  int kind;
+  uint32_t record_size;
+};
+
+// copy the next len decompressed bytes to dst, return false at the end of the file
+static bool read_bytes(bintrace_reader_t *r, void *dst, size_t len) {
+  if (zstd_reader_read(&r->in, dst, len)) return true;
+  if (r->in.error != NULL) fprintf(stderr, "bintrace: %s\n", r->in.error);
+  return false;
+}
+
+bintrace_reader_t *bintrace_reader_open(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "bintrace: cannot open %s\n", path);
+    return NULL;
+  }
+  bintrace_reader_t *r = calloc(1, sizeof(*r));
+  zstd_reader_init(&r->in, fp);
+
+  bintrace_header_t header;
+  if (!read_bytes(r, &header, sizeof(header)) ||
+      memcmp(header.magic, BINTRACE_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "bintrace: %s is not a NEMU binary trace\n", path);
+    bintrace_reader_close(r);
+    return NULL;
+  }
+  size_t expected = header.kind == BINTRACE_INST ? sizeof(bintrace_inst_t) :
+                    header.kind == BINTRACE_BB   ? sizeof(bintrace_bb_t) : 0;
+  if (expected == 0 || header.record_size != expected) {
+    fprintf(stderr, "bintrace: unknown record kind %u of size %u\n", header.kind, header.record_size);
+    bintrace_reader_close(r);
+    return NULL;
+  }
+  r->kind = header.kind;
+  r->record_size = header.record_size;
+  return r;
+}
+
+int bintrace_reader_kind(bintrace_reader_t *r) {
+  return r->kind;
+}
+
+bool bintrace_reader_next(bintrace_reader_t *r, void *rec) {
+  return read_bytes(r, rec, r->record_size);
+}
+
+void bintrace_reader_close(bintrace_reader_t *r) {
+  zstd_reader_close(&r->in);
+  free(r);
+}
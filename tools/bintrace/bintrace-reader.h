@@ -0,0 +1,26 @@
+// Read the binary traces written by --bin-trace of NEMU.
+//
+//   bintrace_reader_t *r = bintrace_reader_open("trace.zst");
+//   bintrace_inst_t rec;
+//   while (bintrace_reader_next(r, &rec)) { ... }
+//   bintrace_reader_close(r);
+//
+// The record type follows bintrace_reader_kind(): bintrace_inst_t for
+// BINTRACE_INST and bintrace_bb_t for BINTRACE_BB, see
+// include/profiling/bintrace.h.
+
+#ifndef __BINTRACE_READER_H__
+#define __BINTRACE_READER_H__
+
+#include <profiling/bintrace.h>
+
+typedef struct bintrace_reader bintrace_reader_t;
+
+// return NULL with a message on stderr if the file is not a trace
+bintrace_reader_t *bintrace_reader_open(const char *path);
+int bintrace_reader_kind(bintrace_reader_t *r);
+// read the next record into rec, return false at the end of the trace
+bool bintrace_reader_next(bintrace_reader_t *r, void *rec);
+void bintrace_reader_close(bintrace_reader_t *r);
+
+#endif
@@ -0,0 +1,228 @@
+// Cluster the BBVs written by --simpoint-profile and choose simpoints.
+//   usage: simpoint-cluster [options] simpoint_bbv.{gz,zst}
+//
+// See include/checkpoint/simpoint_cluster.h for the method, which is shared
+// with --simpoint-profile-cpt of NEMU.
+//
+// simpoints0 and weights0 are written in the format of SimPoint, i.e. lines
+// of "interval cluster" and "weight cluster", which Serializer::init() reads.
+
+#include <checkpoint/simpoint_cluster.h>
+#include <profiling/zstd_reader.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <string>
+#include <zlib.h>
+
+static void fatal(const char *msg) {
+  fprintf(stderr, "simpoint-cluster: %s\n", msg);
+  exit(1);
+}
+
+static SimPointCluster::Options opt;
+static const char *output_dir = ".";
+
+/* ------------------------------ reading BBVs ------------------------------ */
+
+// Both formats are read byte by byte, the text format from a buffer refilled
+// by gzread(), which also reads an uncompressed file.
+static gzFile gz_in;
+static zstd_reader_t zst_in;
+static std::vector<uint8_t> outbuf;
+static size_t outpos, outsize;
+
+static int next_byte() {
+  if (!gz_in) {
+    int c = zstd_reader_getc(&zst_in);
+    if (c < 0 && zst_in.error != NULL) fatal(zst_in.error);
+    return c;
+  }
+  if (outpos == outsize) {
+    int ret = gzread(gz_in, outbuf.data(), outbuf.size());
+    if (ret < 0) fatal("failed to read the gzip file");
+    outpos = 0;
+    outsize = ret;
+    if (outsize == 0) return -1;
+  }
+  return outbuf[outpos ++];
+}
+
+static bool get_varint(uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; ; shift += 7) {
+    int c = next_byte();
+    if (c < 0) {
+      if (shift == 0) return false;
+      fatal("truncated file");
+    }
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+}
+
+static bool get_number(int *c, uint64_t *v) {
+  if (*c < '0' || *c > '9') return false;
+  *v = 0;
+  for (; *c >= '0' && *c <= '9'; *c = next_byte()) *v = *v * 10 + (*c - '0');
+  return true;
+}
+
+typedef std::vector<std::pair<uint64_t, uint64_t>> BBV;
+
+// read the next "T:id:count :id:count ..." line
+static bool read_text_bbv(BBV &bbv) {
+  int c;
+  do { c = next_byte(); } while (c == '\n' || c == '\r' || c == ' ');
+  if (c < 0) return false;
+  if (c != 'T') fatal("not a SimPoint BBV file");
+  c = next_byte();
+  while (c != '\n' && c >= 0) {
+    if (c == ' ' || c == '\r') { c = next_byte(); continue; }
+    uint64_t id, count;
+    if (c != ':') fatal("malformed BBV line");
+    c = next_byte();
+    if (!get_number(&c, &id) || c != ':') fatal("malformed BBV line");
+    c = next_byte();
+    if (!get_number(&c, &count)) fatal("malformed BBV line");
+    bbv.emplace_back(id, count);
+  }
+  return true;
+}
+
+static bool read_binary_bbv(BBV &bbv) {
+  uint64_t n, id = 0, delta, count;
+  if (!get_varint(&n)) return false;
+  for (uint64_t i = 0; i < n; i ++) {
+    if (!get_varint(&delta) || !get_varint(&count)) fatal("truncated file");
+    id += delta;
+    bbv.emplace_back(id, count);
+  }
+  return true;
+}
+
+// load the BBVs, normalize and project them
+static std::vector<double> load_points(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) fatal("cannot open the input file");
+  uint8_t magic[4] = {};
+  size_t nr_magic = fread(magic, 1, 4, fp);
+  bool is_zstd = nr_magic == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+                 magic[2] == 0x2f && magic[3] == 0xfd;
+  rewind(fp);
+
+  outbuf.resize(1 << 17);
+  bool binary = is_zstd;
+  if (is_zstd) {
+    zstd_reader_init(&zst_in, fp);
+    char bbv_magic[8];
+    for (int i = 0; i < 8; i ++) {
+      int c = next_byte();
+      if (c < 0) fatal("not a binary BBV file");
+      bbv_magic[i] = c;
+    }
+    if (memcmp(bbv_magic, "NEMUBBV1", 8) != 0) fatal("not a binary BBV file");
+    uint64_t interval;
+    if (!get_varint(&interval)) fatal("truncated file");
+  } else {
+    fclose(fp);
+    gz_in = gzopen(path, "rb");
+    if (gz_in == NULL) fatal("cannot open the input file");
+  }
+
+  std::vector<double> points;
+  BBV bbv;
+  size_t n = 0;
+  while (bbv.clear(), binary ? read_binary_bbv(bbv) : read_text_bbv(bbv)) {
+    points.resize(points.size() + opt.dim, 0);
+    SimPointCluster::project(opt, bbv, &points[n * opt.dim]);
+    n ++;
+  }
+
+  if (is_zstd) {
+    zstd_reader_close(&zst_in);
+  } else {
+    gzclose(gz_in);
+  }
+  return points;
+}
+
+/* ---------------------------------- main ---------------------------------- */
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+      "usage: %s [options] simpoint_bbv.{gz,zst}\n"
+      "  -o, --output=DIR          write simpoints0 and weights0 to DIR (default: .)\n"
+      "  -k, --max-k=N             try 1 to N clusters (default: %d)\n"
+      "  -n, --init-seeds=N        number of k-means runs for each k (default: %d)\n"
+      "  -i, --iters=N             maximum iterations of a k-means run (default: %d)\n"
+      "  -d, --dim=N               dimensions of the random projection (default: %d)\n"
+      "  -t, --bic-threshold=F     pick the smallest k reaching this fraction of the BIC range (default: %g)\n"
+      "      --seed-km=N           seed of k-means++\n"
+      "      --seed-proj=N         seed of the random projection\n"
+      "  -j, --jobs=N              number of threads (default: number of cores)\n",
+      prog, opt.maxK, opt.nrInitSeeds, opt.maxIters, opt.dim, opt.bicThreshold);
+  exit(1);
+}
+
+static void parse_args(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"output"       , required_argument, NULL, 'o'},
+    {"max-k"        , required_argument, NULL, 'k'},
+    {"init-seeds"   , required_argument, NULL, 'n'},
+    {"iters"        , required_argument, NULL, 'i'},
+    {"dim"          , required_argument, NULL, 'd'},
+    {"bic-threshold", required_argument, NULL, 't'},
+    {"jobs"         , required_argument, NULL, 'j'},
+    {"seed-km"      , required_argument, NULL, 1},
+    {"seed-proj"    , required_argument, NULL, 2},
+    {"help"         , no_argument      , NULL, 'h'},
+    {0              , 0                , NULL,  0 },
+  };
+  int o;
+  while ((o = getopt_long(argc, argv, "o:k:n:i:d:t:j:h", table, NULL)) != -1) {
+    switch (o) {
+      case 'o': output_dir = optarg; break;
+      case 'k': opt.maxK = atoi(optarg); break;
+      case 'n': opt.nrInitSeeds = atoi(optarg); break;
+      case 'i': opt.maxIters = atoi(optarg); break;
+      case 'd': opt.dim = atoi(optarg); break;
+      case 't': opt.bicThreshold = atof(optarg); break;
+      case 'j': opt.nrJobs = atoi(optarg); break;
+      case 1: opt.seedKM = strtoull(optarg, NULL, 0); break;
+      case 2: opt.seedProj = strtoull(optarg, NULL, 0); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+  if (opt.maxK < 1 || opt.nrInitSeeds < 1 || opt.maxIters < 1 || opt.dim < 1) usage(argv[0]);
+}
+
+int main(int argc, char *argv[]) {
+  parse_args(argc, argv);
+
+  std::vector<double> points = load_points(argv[optind]);
+  size_t nr_points = points.size() / opt.dim;
+  if (nr_points == 0) fatal("no interval in the input file");
+  fprintf(stderr, "simpoint-cluster: %zu intervals, trying k = 1..%zu with %d seeds\n",
+      nr_points, std::min<size_t>(opt.maxK, nr_points), opt.nrInitSeeds);
+
+  SimPointCluster::Result res = SimPointCluster::cluster(opt, points);
+  for (size_t k = 1; k < res.bic.size(); k ++) {
+    fprintf(stderr, "  k = %2zu, distortion = %-12g BIC = %g%s\n", k,
+        res.distortion[k], res.bic[k], (int)k == res.k ? " <- chosen" : "");
+  }
+
+  std::string dir = output_dir;
+  FILE *sf = fopen((dir + "/simpoints0").c_str(), "w");
+  FILE *wf = fopen((dir + "/weights0").c_str(), "w");
+  if (sf == NULL || wf == NULL) fatal("cannot open the output files");
+  for (size_t i = 0; i < res.clusters.size(); i ++) {
+    fprintf(sf, "%zu %d\n", res.simpoints[i], res.clusters[i]);
+    fprintf(wf, "%f %d\n", res.weights[i], res.clusters[i]);
+  }
+  fclose(sf);
+  fclose(wf);
+  return 0;
+}